@@ -0,0 +1,254 @@
+#ifndef SERVER_FRAMEWORK_CALLABLE_H
+#define SERVER_FRAMEWORK_CALLABLE_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+namespace zjl
+{
+
+/**
+ * @brief 内联缓冲区的默认大小
+ * 足够放下捕获了若干指针、智能指针以及整数的 lambda
+*/
+static constexpr size_t CALLABLE_INLINE_SIZE = 64;
+
+template <typename Signature, size_t InlineSize = CALLABLE_INLINE_SIZE>
+class Callable;
+
+template <typename T>
+struct IsStdFunction : std::false_type
+{
+};
+
+template <typename Signature>
+struct IsStdFunction<std::function<Signature>> : std::true_type
+{
+};
+
+/**
+ * @brief 只可移动的函数对象包装类
+ * 用于替代调度器、协程、定时器与 IO 事件等热点路径上的 std::function。
+ * 与 std::function 的区别：
+ *  1. 只可移动，不可拷贝，因此可以包装捕获了 std::unique_ptr 等只可移动对象的 lambda；
+ *  2. 内联缓冲区更大，大小不超过 InlineSize 且移动构造不抛异常的函数对象直接存放在缓冲区内，不会分配堆内存，
+ *     超出的部分才退化为堆分配。
+*/
+template <typename R, typename... Args, size_t InlineSize>
+class Callable<R(Args...), InlineSize>
+{
+private:
+    // 类型擦除后的操作表，每种被包装的类型对应一个静态实例
+    struct Operations
+    {
+        R (*invoke)(void* storage, Args&&... args);
+        // 用 src 的内容移动构造 dst，并析构 src
+        void (*relocate)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+        bool is_inline;
+        const std::type_info* type;
+    };
+
+    template <typename F>
+    static constexpr bool FitsInline =
+        sizeof(F) <= InlineSize &&
+        alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible_v<F>;
+
+    // 直接存放在内联缓冲区的函数对象
+    template <typename F>
+    struct InlineOperations
+    {
+        static R invoke(void* storage, Args&&... args)
+        {
+            return std::invoke(*static_cast<F*>(storage), std::forward<Args>(args)...);
+        }
+
+        static void relocate(void* dst, void* src) noexcept
+        {
+            F* from = static_cast<F*>(src);
+            ::new (dst) F(std::move(*from));
+            from->~F();
+        }
+
+        static void destroy(void* storage) noexcept
+        {
+            static_cast<F*>(storage)->~F();
+        }
+
+        static constexpr Operations table{&invoke, &relocate, &destroy, true, &typeid(F)};
+    };
+
+    // 缓冲区放不下，内联缓冲区里只存放指向堆上对象的指针
+    template <typename F>
+    struct HeapOperations
+    {
+        static F*& pointer(void* storage)
+        {
+            return *static_cast<F**>(storage);
+        }
+
+        static R invoke(void* storage, Args&&... args)
+        {
+            return std::invoke(*pointer(storage), std::forward<Args>(args)...);
+        }
+
+        static void relocate(void* dst, void* src) noexcept
+        {
+            ::new (dst) F*(pointer(src));
+        }
+
+        static void destroy(void* storage) noexcept
+        {
+            delete pointer(storage);
+        }
+
+        static constexpr Operations table{&invoke, &relocate, &destroy, false, &typeid(F)};
+    };
+
+    template <typename F>
+    using EnableIfInvocable = std::enable_if_t<
+        !std::is_same_v<std::decay_t<F>, Callable> &&
+        std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>;
+
+public:
+    Callable() noexcept = default;
+
+    Callable(std::nullptr_t) noexcept {}
+
+    /**
+     * @brief 包装任意可调用对象
+     * 空的函数指针、成员指针以及空的 std::function 会得到一个空的 Callable；
+     * 函数的引用不可能为空，不做检查
+    */
+    template <typename F, typename = EnableIfInvocable<F>>
+    Callable(F&& fn)
+    {
+        using Functor = std::decay_t<F>;
+        if constexpr (!std::is_function_v<std::remove_reference_t<F>> &&
+                      (std::is_pointer_v<Functor> ||
+                       std::is_member_pointer_v<Functor> ||
+                       IsStdFunction<Functor>::value))
+        {
+            if (!fn)
+            {
+                return;
+            }
+        }
+        if constexpr (FitsInline<Functor>)
+        {
+            ::new (static_cast<void*>(m_storage)) Functor(std::forward<F>(fn));
+            m_ops = &InlineOperations<Functor>::table;
+        }
+        else
+        {
+            ::new (static_cast<void*>(m_storage)) Functor*(new Functor(std::forward<F>(fn)));
+            m_ops = &HeapOperations<Functor>::table;
+        }
+    }
+
+    Callable(Callable&& rhs) noexcept
+    {
+        moveFrom(rhs);
+    }
+
+    Callable(const Callable&) = delete;
+
+    ~Callable()
+    {
+        reset();
+    }
+
+    Callable& operator=(Callable&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            reset();
+            moveFrom(rhs);
+        }
+        return *this;
+    }
+
+    Callable& operator=(const Callable&) = delete;
+
+    Callable& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    template <typename F, typename = EnableIfInvocable<F>>
+    Callable& operator=(F&& fn)
+    {
+        *this = Callable(std::forward<F>(fn));
+        return *this;
+    }
+
+    void swap(Callable& rhs) noexcept
+    {
+        Callable tmp(std::move(rhs));
+        rhs = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    R operator()(Args... args)
+    {
+        if (!m_ops)
+        {
+            throw std::bad_function_call();
+        }
+        return m_ops->invoke(m_storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+    // 被包装的函数对象是否存放在内联缓冲区内，空对象返回 false
+    bool isInline() const noexcept { return m_ops && m_ops->is_inline; }
+
+    // 被包装的函数对象的类型，空对象返回 typeid(void)，同 std::function::target_type
+    const std::type_info& target_type() const noexcept { return m_ops ? *m_ops->type : typeid(void); }
+
+private:
+    void reset() noexcept
+    {
+        if (m_ops)
+        {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    void moveFrom(Callable& rhs) noexcept
+    {
+        if (rhs.m_ops)
+        {
+            rhs.m_ops->relocate(m_storage, rhs.m_storage);
+            m_ops = rhs.m_ops;
+            rhs.m_ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char m_storage[InlineSize];
+    const Operations* m_ops = nullptr;
+};
+
+template <typename Signature, size_t InlineSize>
+bool operator==(const Callable<Signature, InlineSize>& fn, std::nullptr_t) noexcept
+{
+    return !fn;
+}
+
+template <typename Signature, size_t InlineSize>
+bool operator!=(const Callable<Signature, InlineSize>& fn, std::nullptr_t) noexcept
+{
+    return static_cast<bool>(fn);
+}
+
+} // namespace zjl
+
+#endif // SERVER_FRAMEWORK_CALLABLE_H
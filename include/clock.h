@@ -0,0 +1,50 @@
+#ifndef SERVER_FRAMEWORK_CLOCK_H
+#define SERVER_FRAMEWORK_CLOCK_H
+
+#include <cstdint>
+
+namespace zjl
+{
+
+/**
+ * @brief 定时器与超时使用的单调时钟，不随系统时间的调整而跳变
+ * 时间源由配置 clock.source 选择：
+ *   monotonic  CLOCK_MONOTONIC，精确到微秒，默认
+ *   coarse     CLOCK_MONOTONIC_COARSE，只读取内核在时钟中断时更新的时间，开销更低，
+ *              但精度只有一个时钟中断周期(通常 1~4ms)，定时器可能相差这么多
+ * 两个时间源的起点相同，timerfd 使用 CLOCK_MONOTONIC 的绝对时间即可。
+ * 事件循环每轮唤醒后调用 UpdateCachedUS() 缓存当前时间，本轮处理定时器时直接使用缓存，
+ * 让出执行权之前调用 ClearCachedUS()，协程中添加的定时器仍然读取最新的时间
+*/
+class Clock
+{
+public:
+    enum Source
+    {
+        MONOTONIC = 0,
+        COARSE = 1,
+    };
+
+    // 当前的时间源
+    static Source GetSource();
+    static const char* GetSourceName();
+    // 切换时间源，两个时间源的起点相同，已有的定时器不受影响
+    static void SetSource(Source source);
+    // 时间源的精度(us)
+    static uint64_t GetResolutionUS();
+
+    // 按时间源读取当前时间
+    static uint64_t NowUS();
+    static uint64_t NowMS() { return NowUS() / 1000; }
+
+    // 本线程缓存的当前时间(us)，没有缓存时读取时间源
+    static uint64_t CachedUS();
+    // 读取时间源并缓存在本线程，返回读取的时间(us)
+    static uint64_t UpdateCachedUS();
+    // 清除本线程缓存的时间
+    static void ClearCachedUS();
+};
+
+} // namespace zjl
+
+#endif // SERVER_FRAMEWORK_CLOCK_H
@@ -334,7 +334,7 @@ public:
             // 值被修改，调用所有的变更事件处理器
             for (const auto& pair : m_callback_map)
             {
-                pair.second(old_value, m_value);
+                pair.second(old_value, value);
             }
         }
         // 上写锁
@@ -390,10 +390,11 @@ public:
     // thread-safe 增加配置项变更事件处理器，返回处理器的唯一编号
     uint64_t addListener(onChangeCallback cb)
     {
-        static uint64_t s_cb_id = 0;
         WriteScopedLock lock(&m_mutex);
-        m_callback_map[s_cb_id] = cb;
-        return s_cb_id;
+        // 每个处理器使用不同的编号，否则后加入的处理器会覆盖之前的，删除时也会误删别人的
+        uint64_t id = m_next_listener_id++;
+        m_callback_map[id] = cb;
+        return id;
     }
     // thread-safe 删除配置项变更事件处理器
     void delListener(uint64_t key)
@@ -424,6 +425,7 @@ public:
 private:
     T m_value; // 配置项的值
     std::map<uint64_t, onChangeCallback> m_callback_map;
+    uint64_t m_next_listener_id = 0; // 下一个变更事件处理器的编号，由 m_mutex 保护
     mutable RWLock m_mutex;
 };
 
@@ -1,7 +1,9 @@
 #ifndef SERVER_FRAMEWORK_FD_MANAGER_H
 #define SERVER_FRAMEWORK_FD_MANAGER_H
 
+#include <deque>
 #include <memory>
+#include <utility>
 #include "thread.h"
 #include "io_manager.h"
 #include "singleton.h"
@@ -17,12 +19,22 @@ class FileDescriptor : public std::enable_shared_from_this<FileDescriptor>
 public:
     using ptr = std::shared_ptr<FileDescriptor>;
 
-    FileDescriptor(int fd);
+    /**
+     * @param passthrough 为 true 时不探测 fd 的类型，也不修改 fd 的标志，之后的操作都直接调用系统函数，
+     *                    用于记录 hook 之外打开的、无法等待也不是普通文件的 fd（终端、他人创建的管道等）
+    */
+    FileDescriptor(int fd, bool passthrough = false);
     ~FileDescriptor();
 
     bool init();
     bool isInit() const { return m_is_init; };
     bool isSocket() const { return m_is_socket; };
+    // 是否可以通过就绪事件等待，socket、管道与 eventfd 由 hook 挂起协程等待
+    bool isPollable() const { return m_is_pollable; }
+    // 标记为可等待的 fd，并强制为非阻塞模式，用于 fstat 无法识别类型的 fd（如 eventfd）
+    void setPollable();
+    bool isRegularFile() const { return m_is_regular; }
+    bool isPassthrough() const { return m_is_passthrough; }
     bool isClosed() const { return m_is_closed; };
     bool close();
 
@@ -35,9 +47,20 @@ public:
     void setTimeout(int type, uint64_t v);
     uint64_t getTimeout(int type);
 
+    /**
+     * @brief 获取文件 IO 的执行权，保证同一个文件上的异步 IO 按调用顺序逐个执行
+     * 前面的操作尚未完成时挂起当前协程，由 unlockFileIO 按先来后到的顺序直接转交执行权，
+     * 只能在可以挂起的协程中调用
+    */
+    void lockFileIO();
+    void unlockFileIO();
+
 private:
     bool m_is_init;
     bool m_is_socket;
+    bool m_is_regular = false;
+    bool m_is_pollable = false;
+    bool m_is_passthrough = false;
     bool m_system_non_block;
     bool m_user_non_block;
     bool m_is_closed;
@@ -48,6 +71,10 @@ private:
     uint64_t m_send_timeout;
 
     zjl::IOManager* m_iom;
+
+    Mutex m_file_io_mutex{};
+    bool m_file_io_busy = false; // 是否有协程持有文件 IO 的执行权
+    std::deque<std::pair<Scheduler*, Fiber::ptr>> m_file_io_waiters{};
 };
 
 /**
@@ -62,9 +89,10 @@ public:
 
     /**
      * @brief 获取文件描述符 fd 对应的包装对象，若指定参数 auto_create 为 true, 当该包装对象不在管理类中时，自动创建一个新的包装对象
+     * @param passthrough 自动创建时是否创建直通的包装对象，见 FileDescriptor 的构造函数
      * @return 返回指定的文件描述符的包装对象；当指定的文件描述符不存在时，返回 nullptr，如果指定 auto_create 为 true，则为这个文件描述符创建新的包装对象并返回。
     */
-    FileDescriptor::ptr get(int fd, bool auto_create = false);
+    FileDescriptor::ptr get(int fd, bool auto_create = false, bool passthrough = false);
 
     /**
      * @brief 将一个文件描述符从管理类中删除
@@ -1,6 +1,7 @@
 #ifndef SERVER_FRAMEWORK_FIBER_H
 #define SERVER_FRAMEWORK_FIBER_H
 
+#include "callable.h"
 #include "config.h"
 #include "thread.h"
 #include <atomic>
@@ -22,7 +23,7 @@ class Fiber : public std::enable_shared_from_this<Fiber>, public zjl::noncopyabl
 public:
     using ptr = std::shared_ptr<Fiber>;
     using uptr = std::unique_ptr<Fiber>;
-    using FiberFunc = std::function<void()>;
+    using FiberFunc = Callable<void()>;
 
     // 协程状态，用于调度
     enum State
@@ -35,6 +36,18 @@ public:
         EXCEPTION // 异常
     };
 
+    /**
+     * @brief 标记允许强制抢占的代码区域，RAII
+     * 调度器开启强制抢占后，协程在区域内耗尽时间片时，会直接在信号处理函数中被换出。
+     * 区域内的代码必须是异步信号安全的：不加锁、不分配内存、不调用不可重入的函数，通常是纯计算的循环
+    */
+    class PreemptibleScope : public zjl::noncopyable
+    {
+    public:
+        PreemptibleScope();
+        ~PreemptibleScope();
+    };
+
 public:
     /**
      * @brief 创建新协程
@@ -81,6 +94,9 @@ public:
     // 判断协程是否执行结束
     bool finish() const noexcept;
 
+    // 记录协程被事件唤醒的时间(us)，调度器恢复执行该协程时统计唤醒到恢复执行的延迟
+    void setReadyTime(uint64_t ready_us) { m_ready_us = ready_us; }
+
 private:
     // 用于创建 master fiber
     Fiber();
@@ -100,6 +116,32 @@ public:
     static uint64_t GetFiberID();
     // 协程入口函数
     static void MainFunc();
+    /**
+     * @brief 抢占检查点，当前协程已经耗尽调度器设置的时间片时，挂起为 READY 状态，让出工作线程
+     * 被 hook 的系统函数会自动调用，长时间计算的协程也可以在循环中手动调用
+    */
+    static void CheckPreempt();
+    /**
+     * @brief 为当前工作线程开启时间片抢占，由调度器在工作线程上调用
+     * @param forced 是否允许在 PreemptibleScope 区域内强制抢占
+    */
+    static void EnablePreempt(bool forced);
+    // 获取时间片信号编号，为 SIGRTMIN 加上配置项 fiber.preempt_signal_offset，第一次调用后不再改变
+    static int GetPreemptSignal();
+    /**
+     * @brief 在所有协程中屏蔽信号，只支持 1 到 64 号信号
+     * ucontext 每次切换都会恢复目标上下文保存的信号屏蔽字，只修改线程的屏蔽字会在下一次切换时失效，
+     * 因此屏蔽的信号记录在全局，协程在每次被换入之前把它们加入自己保存的屏蔽字
+    */
+    static void BlockSignals(const sigset_t& mask);
+
+private:
+    // 把全局屏蔽的信号加入保存的上下文，换入之前调用，异步信号安全
+    void syncSignalMask();
+
+private:
+    // 时间片信号处理函数
+    static void OnPreemptSignal(int signo);
 
 private:
     // 协程 id
@@ -112,6 +154,18 @@ private:
     ucontext_t m_ctx;
     // 协程栈空间指针
     void* m_stack;
+    // 上次执行该协程的工作线程序号，由调度器维护，用于亲和性调度
+    int m_last_worker = -1;
+    // 是否有工作线程正在执行该协程，由调度器维护，直到协程的上下文完全换出才清除
+    std::atomic_bool m_running{false};
+    // 协程被事件唤醒的时间(us)，0 表示未记录，由调度器在恢复执行时统计并清除
+    uint64_t m_ready_us = 0;
+    // 已经加入 m_ctx 的全局屏蔽信号
+    uint64_t m_blocked_signals = 0;
+    // 是否在信号处理函数中被强制抢占，这样的协程只能在原线程上恢复执行
+    bool m_forced_preempted = false;
+    // 被强制抢占时所处的 PreemptibleScope 嵌套层数，恢复执行时还原
+    int m_preemptible_depth = 0;
     // 协程执行函数
     FiberFunc m_callback;
 };
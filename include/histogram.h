@@ -0,0 +1,67 @@
+#ifndef SERVER_FRAMEWORK_HISTOGRAM_H
+#define SERVER_FRAMEWORK_HISTOGRAM_H
+
+#include "noncopyable.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zjl
+{
+
+/**
+ * @brief 直方图的快照，用于计算分位数
+*/
+struct HistogramSnapshot
+{
+    uint64_t count = 0;             // 记录的样本数量
+    uint64_t sum = 0;               // 样本之和
+    uint64_t max = 0;               // 最大的样本
+    std::vector<uint64_t> buckets;  // 每个桶中的样本数量，与 Histogram 的桶一一对应
+
+    double mean() const { return count ? static_cast<double>(sum) / count : 0; }
+    /**
+     * @brief 估算分位数，返回值是所在桶的上界（不超过最大样本），相对误差不超过 1/8
+     * @param percent 百分比，例如 99 表示 p99
+    */
+    uint64_t percentile(double percent) const;
+    // 以 "count=... mean=... p50=... p90=... p99=... p999=... max=..." 的形式输出
+    std::string toString() const;
+};
+
+/**
+ * @brief 无锁的对数-线性直方图，用于统计延迟等非负整数样本
+ * 每个 2 的幂区间均分为 8 个桶，record 只有几次 relaxed 原子操作，可以在热路径上由多个线程并发调用
+*/
+class Histogram : public noncopyable
+{
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    // 样本所在桶的序号
+    static size_t BucketIndex(uint64_t value);
+    // 桶能容纳的最大样本
+    static uint64_t BucketUpperBound(size_t index);
+
+    Histogram() { reset(); }
+
+    // thread-safe 记录一个样本
+    void record(uint64_t value);
+    // thread-safe 清空所有样本，与 record 并发时快照可能包含部分被清空的样本
+    void reset();
+    // thread-safe 获取快照
+    HistogramSnapshot snapshot() const;
+
+private:
+    std::atomic_uint64_t m_buckets[BUCKET_COUNT];
+    std::atomic_uint64_t m_sum{0};
+    std::atomic_uint64_t m_max{0};
+};
+
+} // namespace zjl
+
+#endif // SERVER_FRAMEWORK_HISTOGRAM_H
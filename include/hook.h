@@ -5,6 +5,11 @@
 #include <sys/socket.h>
 #include <sys/uio.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
@@ -47,6 +52,12 @@ extern connect_func connect_f;
 typedef int (*accept_func)(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 extern accept_func accept_f;
 
+typedef int (*accept4_func)(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+extern accept4_func accept4_f;
+
+typedef int (*socketpair_func)(int domain, int type, int protocol, int sv[2]);
+extern socketpair_func socketpair_f;
+
 typedef ssize_t (*recv_func)(int sockfd, void *buf, size_t len, int flags);
 extern recv_func recv_f;
 
@@ -82,9 +93,36 @@ extern read_func read_f;
 typedef ssize_t (*write_func)(int fd, const void *buf, size_t count);
 extern write_func write_f;
 
+typedef ssize_t (*pread_func)(int fd, void *buf, size_t count, off_t offset);
+extern pread_func pread_f;
+
+typedef ssize_t (*pwrite_func)(int fd, const void *buf, size_t count, off_t offset);
+extern pwrite_func pwrite_f;
+
+typedef int (*fsync_func)(int fd);
+extern fsync_func fsync_f;
+
+typedef int (*fdatasync_func)(int fd);
+extern fdatasync_func fdatasync_f;
+
 typedef int (*close_func)(int fd);
 extern close_func close_f;
 
+typedef int (*pipe_func)(int pipefd[2]);
+extern pipe_func pipe_f;
+
+typedef int (*pipe2_func)(int pipefd[2], int flags);
+extern pipe2_func pipe2_f;
+
+typedef int (*dup_func)(int oldfd);
+extern dup_func dup_f;
+
+typedef int (*dup2_func)(int oldfd, int newfd);
+extern dup2_func dup2_f;
+
+typedef int (*dup3_func)(int oldfd, int newfd, int flags);
+extern dup3_func dup3_f;
+
 
 //////// sys/uio.h
 typedef ssize_t (*readv_func)(int fd, const struct iovec *iov, int iovcnt);
@@ -93,11 +131,57 @@ extern readv_func readv_f;
 typedef ssize_t (*writev_func)(int fd, const struct iovec *iov, int iovcnt);
 extern writev_func writev_f;
 
+typedef ssize_t (*preadv_func)(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+extern preadv_func preadv_f;
+
+typedef ssize_t (*pwritev_func)(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+extern pwritev_func pwritev_f;
+
+
+//////// sys/sendfile.h
+typedef ssize_t (*sendfile_func)(int out_fd, int in_fd, off_t *offset, size_t count);
+extern sendfile_func sendfile_f;
+
+
+//////// sys/eventfd.h
+typedef int (*eventfd_func)(unsigned int initval, int flags);
+extern eventfd_func eventfd_f;
+
+
+//////// poll.h
+typedef int (*poll_func)(struct pollfd *fds, nfds_t nfds, int timeout);
+extern poll_func poll_f;
+
+typedef int (*ppoll_func)(struct pollfd *fds, nfds_t nfds,
+                          const struct timespec *tmo_p, const sigset_t *sigmask);
+extern ppoll_func ppoll_f;
+
+
+//////// sys/select.h
+typedef int (*select_func)(int nfds, fd_set *readfds, fd_set *writefds,
+                           fd_set *exceptfds, struct timeval *timeout);
+extern select_func select_f;
+
+
+//////// sys/epoll.h
+typedef int (*epoll_create_func)(int size);
+extern epoll_create_func epoll_create_f;
+
+typedef int (*epoll_create1_func)(int flags);
+extern epoll_create1_func epoll_create1_f;
+
+typedef int (*epoll_wait_func)(int epfd, struct epoll_event *events, int maxevents, int timeout);
+extern epoll_wait_func epoll_wait_f;
+
 
 //////// fcntl.h
 typedef int (*fcntl_func)(int fd, int cmd, ... /* arg */ );
 extern fcntl_func fcntl_f;
 
+typedef ssize_t (*splice_func)(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+                               size_t len, unsigned int flags);
+extern splice_func splice_f;
+
 
 //////// sys/ioctl.h
 typedef int (*ioctl_func)(int fd, unsigned long request, ...);
@@ -1,85 +1,471 @@
 #ifndef SERVER_FRAMEWORK_IO_MANAGER_H
 #define SERVER_FRAMEWORK_IO_MANAGER_H
 
+#include "config.h"
+#include "histogram.h"
+#include "noncopyable.h"
+#include "poller.h"
 #include "scheduler.h"
 #include "thread.h"
 #include "timer.h"
 #include <atomic>
+#include <csignal>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <sys/signalfd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace zjl
 {
 
+/**
+ * @brief fd 上可以等待的事件，取值与对应的 epoll 事件相同
+*/
 enum FDEventType
 {
     NONE = 0x0,
-    READ = 0x1,
-    WRITE = 0x4
+    READ = 0x1,      // 可读，EPOLLIN；对端关闭写端时同样触发，读取会立即返回 0
+    PRI = 0x2,       // 有紧急数据（例如 TCP 带外数据）可读，EPOLLPRI
+    WRITE = 0x4,     // 可写，EPOLLOUT
+    RDHUP = 0x2000,  // 对端关闭了连接或者写端，EPOLLRDHUP，用于及早发现失效的连接
+    ALL = READ | PRI | WRITE | RDHUP
 };
 
-// 记录与 fd 相关的信息
+/**
+ * @brief 记录与 fd 相关的信息
+ * 每个事件可以有多个等待者，例如一个读数据的协程加上一个监视对端关闭的协程。
+ * 每个事件的第一个等待者就地存放，只通过 m_events 中的原子位同步，不需要互斥量：
+ *   事件位  就地的等待者已经写好，认领者原子地清除它来取得该等待者
+ *   忙碌位  有线程正在读写就地的等待者，持有的时间只有几条指令，其他线程短暂自旋
+ * 同一事件同时有多个等待者时，其余的等待者放在按需分配的 Overflow 中，由其中的互斥量保护，并置上额外位，
+ * 认领者只有看到额外位时才加锁。大多数 fd 从不需要 Overflow，FDContext 只占几个缓存行，
+ * 按段整体分配时百万级的 fd 也只占用约 200MB。就绪分发、移除与取消通过 claimEvents 一次取出该事件的全部等待者。
+ * 常驻注册时，没有等待者的就绪边缘记录在 m_ready 中：分发先置位 m_ready 再认领等待者，
+ * 等待者先置位 m_events 再检查 m_ready，两者至少有一方能看到对方，边缘不会丢失
+*/
 struct FDContext
 {
-    using MutexType = zjl::Mutex;
+    static constexpr size_t EVENT_COUNT = 4; // 可以等待的事件种类
+
     struct EventHandler
     {
-        Scheduler* m_scheduler;      // 指定处理该事件的调度器
-        Fiber::ptr m_fiber;          // 要跑的协程
-        Fiber::FiberFunc m_callback; // 要跑的函数，fiber 和 callback 只需要存在一个
+        Scheduler* m_scheduler = nullptr; // 指定处理该事件的调度器
+        Fiber::ptr m_fiber;               // 要跑的协程
+        // 要跑的函数，fiber 和 callback 只需要存在一个。回调只用于少数场景，装箱存放以缩小每个事件的槽位
+        std::unique_ptr<Fiber::FiberFunc> m_callback;
+        uint64_t m_id = 0;                // 等待者的编号，用于移除单个等待者
+    };
+    /**
+     * @brief 一个事件的全部等待者
+     * 第一个等待者就地存放，同时有多个等待者时才分配内存
+    */
+    struct WaiterList
+    {
+        EventHandler m_first;
+        std::vector<EventHandler> m_rest;
+
+        bool empty() const { return m_first.m_scheduler == nullptr && m_rest.empty(); }
+        size_t size() const { return (m_first.m_scheduler ? 1 : 0) + m_rest.size(); }
+    };
+    using Waiters = WaiterList[EVENT_COUNT];
+    /**
+     * @brief 同一事件的第二个及之后的等待者，第一次需要时分配，之后随 FDContext 一直保留
+    */
+    struct Overflow
+    {
+        Mutex m_mutex;
+        std::vector<EventHandler> m_rest[EVENT_COUNT];
     };
-    // 获取指定事件的处理器
-    EventHandler& getEventHandler(FDEventType type);
+
+    FDContext() = default;
+    ~FDContext();
+
+    // 事件在等待者数组中的下标
+    static size_t EventIndex(FDEventType type);
+    // m_events 中事件的额外位与忙碌位，事件本身的取值都小于 1 << 16
+    static uint32_t ExtraBit(size_t index) { return 1u << (16 + index); }
+    static uint32_t BusyBit(size_t index) { return 1u << (24 + index); }
     // 清除指定的事件处理器
-    void resetHandler(EventHandler& handler);
-    // 触发事件，然后删除
-    void triggerEvent(FDEventType type);
-
-    MutexType m_mutex;
-    EventHandler m_read_handler;  // 处理读事件的
-    EventHandler m_write_handler; // 处理写事件的
-    int m_fd;                     // 要监听的文件描述符
-    FDEventType m_events = FDEventType::NONE;
+    static void ResetHandler(EventHandler& handler);
+    // 把处理器中的协程或函数对象交给它的调度器，然后清除处理器
+    static void TriggerHandler(EventHandler& handler, long thread_id, uint64_t ready_us);
+    /**
+     * @brief 唤醒 claimEvents 取出的等待者
+     * @param thread_id 不为 -1 时被唤醒的任务绑定在该线程上执行
+     * @param ready_us 不为 0 时记录为被唤醒协程的唤醒时间
+     * @return 被唤醒的等待者数量
+    */
+    static size_t TriggerWaiters(Waiters& waiters, long thread_id = -1, uint64_t ready_us = 0);
+
+    // thread-safe 添加等待者并把事件标记为等待中，返回等待者的编号
+    uint64_t addWaiter(FDEventType type, EventHandler&& handler);
+    // thread-safe 移除指定编号的等待者，最后一个等待者被移除时清除事件标记，返回是否找到。
+    // removed 不为空时把找到的处理器移动到其中
+    bool removeWaiter(FDEventType type, uint64_t id, EventHandler* removed = nullptr);
+    // thread-safe 认领指定的等待中的事件，把它们的全部等待者移动到 waiters 中，返回认领成功的事件
+    uint32_t claimEvents(uint32_t events, Waiters& waiters);
+    // thread-safe 认领指定的等待中的事件并唤醒全部等待者，返回被唤醒的等待者数量
+    size_t triggerEvents(uint32_t events, long thread_id = -1, uint64_t ready_us = 0)
+    {
+        Waiters waiters;
+        claimEvents(events, waiters);
+        return TriggerWaiters(waiters, thread_id, ready_us);
+    }
+    // thread-safe 认领指定的等待中的事件并丢弃全部等待者，返回被丢弃的等待者数量
+    size_t discardEvents(uint32_t events);
+    // 自旋置上忙碌位，取得就地等待者的独占访问权，返回置位之前的 m_events
+    uint32_t acquireFirst(size_t index);
+    // 取得 Overflow，不存在时分配
+    Overflow* getOverflow();
+
+    EventHandler m_first[EVENT_COUNT];        // 每个事件就地存放的第一个等待者，下标见 EventIndex，由忙碌位保护
+    std::atomic<Overflow*> m_overflow{nullptr};
+    std::atomic_uint64_t m_next_waiter_id{0};
+    int m_fd = -1;                // 要监听的文件描述符
+    std::atomic_uint32_t m_events{FDEventType::NONE};     // 有等待者的事件，以及额外位与忙碌位
+    std::atomic_uint32_t m_registered{FDEventType::NONE}; // 已经注册到轮询器的事件
+    std::atomic_uint32_t m_ready{FDEventType::NONE};      // 常驻注册时，到来后还没有被消费的就绪事件
+    std::atomic_int m_owner{-1};  // 独占事件循环时负责该 fd 的事件循环序号，-1 表示还没有分配
+};
+
+/**
+ * @brief fd 上下文表，直接以 fd 为下标
+ * 按段分配，段一旦分配就不再搬移或释放，取得的 FDContext 指针在表的生命周期内始终有效，
+ * 查找只需要一次原子读，不需要加锁
+*/
+class FDContextTable : public noncopyable
+{
+public:
+    static constexpr size_t SEGMENT_BITS = 10;
+    static constexpr size_t SEGMENT_SIZE = 1 << SEGMENT_BITS; // 每段的 FDContext 数量
+    static constexpr size_t MAX_SEGMENTS = 1 << 14;           // 最多支持 16M 个 fd
+
+    FDContextTable();
+    ~FDContextTable();
+
+    // 获取 fd 的上下文，所在的段不存在时按 auto_create 决定是否分配，fd 超出范围返回 nullptr
+    FDContext* get(int fd, bool auto_create);
+
+    // 遍历所有已经分配的 FDContext
+    template <typename Func>
+    void forEach(Func&& func)
+    {
+        size_t count = m_segment_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
+        {
+            FDContext* segment = m_segments[i].load(std::memory_order_acquire);
+            if (!segment)
+            {
+                continue;
+            }
+            for (size_t j = 0; j < SEGMENT_SIZE; j++)
+            {
+                func(segment[j]);
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<std::atomic<FDContext*>[]> m_segments;
+    std::atomic_size_t m_segment_count{0}; // 已经分配的最大段序号加一
+};
+
+/**
+ * @brief 事件循环的运行统计
+*/
+struct ReactorStats
+{
+    uint64_t loops = 0;        // 轮询次数
+    uint64_t events = 0;       // 取出的就绪事件数量
+    uint64_t full_batches = 0; // 就绪事件填满整个批次的轮询次数
+    size_t batch_size = 0;     // 当前每次轮询最多取出的事件数量
+    uint64_t busy_poll_us = 0;     // 忙轮询消耗的时间
+    uint64_t busy_poll_hits = 0;   // 忙轮询期间等到就绪事件或新任务的次数，每次都省去了一次阻塞与唤醒
+    uint64_t busy_poll_misses = 0; // 忙轮询超时后转为阻塞等待的次数
+    uint64_t tickles_saved = 0;    // 唤醒忙轮询中的线程而省去的管道写入次数
+};
+
+/**
+ * @brief 事件循环的延迟分布，用于定位尾延迟来自轮询、任务队列还是任务本身
+*/
+struct LatencyStats
+{
+    HistogramSnapshot poll_wait_us;      // 每次阻塞在轮询上的时间，不包括忙轮询
+    HistogramSnapshot events_per_wakeup; // 每次轮询返回时取出的就绪事件数量
+    HistogramSnapshot resume_latency_us; // 事件循环取出就绪事件到协程恢复执行的延迟，主要是任务队列的排队时间
+    HistogramSnapshot timer_lateness_us; // 定时器到期到被事件循环取出的延迟
+    HistogramSnapshot loop_duration_us;  // 一次事件循环迭代的时间，从轮询返回到下一次轮询，包括执行任务的时间
+};
+
+/**
+ * @brief IOManager::drain 的执行结果，记录排空过程中被强制中断的工作
+*/
+struct DrainResult
+{
+    bool completed = true;       // 是否在期限内自然排空，false 表示发生了强制取消
+    uint64_t elapsed_ms = 0;     // 排空耗时
+    size_t cancelled_events = 0; // 被强制取消的 IO 事件数量
+    size_t cancelled_timers = 0; // 被提前触发或丢弃的定时器数量
+    size_t pending_tasks = 0;    // 强制取消后仍在排队的任务数量
 };
 
 class IOManager final : public Scheduler, public TimerManager
 {
 public: // 内部类型
     using ptr = std::shared_ptr<IOManager>;
-    using LockType = zjl::RWLock;
+    using SignalHandler = Callable<void(const signalfd_siginfo&)>;
+
+    /**
+     * @brief 事件循环，由一个轮询器与一条唤醒管道组成
+     * 默认所有工作线程共享一个事件循环；开启 iomanager.per_worker_reactor 后每个工作线程独占一个，
+     * socket()、accept() 得到的 fd 依次轮流分配给工作线程，其他 fd 在第一次使用时分配，
+     * 它的注册、就绪事件的分发与协程的恢复都在该线程上完成。
+     * 序号为 i 的事件循环负责 分片 % 事件循环数量 == i 的定时器分片，共享时负责全部分片
+    */
+    struct Reactor
+    {
+        size_t m_index = 0;                 // 事件循环的序号，与所属工作线程的序号相同
+        Poller::ptr m_poller;               // IO 事件轮询器
+        int m_tickle_fds[2]{-1, -1};        // 唤醒阻塞在轮询上的工作线程用的管道
+        std::atomic_bool m_idle{false};     // 所属工作线程是否处于空闲状态
+        std::atomic_size_t m_batch_size{0};      // 每次轮询最多取出的事件数量
+        std::atomic_size_t m_full_streak{0};     // 连续填满批次的轮询次数
+        std::atomic_uint64_t m_loop_count{0};
+        std::atomic_uint64_t m_event_count{0};
+        std::atomic_uint64_t m_full_batch_count{0};
+        std::atomic_int m_spinning{0};           // 正在忙轮询的工作线程数量
+        std::atomic_bool m_wakeup{false};        // 忙轮询期间收到的唤醒，代替管道写入
+        std::atomic_uint64_t m_busy_poll_time_us{0};
+        std::atomic_uint64_t m_busy_poll_hits{0};
+        std::atomic_uint64_t m_busy_poll_misses{0};
+        std::atomic_uint64_t m_tickles_saved{0};
+        int m_timer_fd = -1;                     // 以负责的定时器分片的最早到期时间唤醒事件循环，-1 表示不使用
+        Mutex m_timer_mutex{};                   // 保证 timerfd 最终设置的是最早的到期时间
+        uint64_t m_timer_armed = ~0ull;          // timerfd 当前设置的到期时间(us)，~0ull 表示未设置
+    };
 
 public: // 实例方法
     explicit IOManager(size_t thread_size, bool use_caller = false, std::string name = "");
     ~IOManager() override;
 
-    // thread-safe 给指定的 fd 增加事件监听，当 callback 是 nullptr 时，将当前上下文转换为协程，并作为事件回调使用
-    int addEventListener(int fd, FDEventType event, std::function<void()> callback = nullptr);
-    // thread-safe 给指定的 fd 移除指定的事件监听
+    // thread-safe 给指定的 fd 增加事件监听，当 callback 是 nullptr 时，将当前上下文转换为协程，并作为事件回调使用。
+    // 同一个事件可以有多个等待者，事件就绪时全部被唤醒。
+    // waiter_id 不为空且在负责 fd 的线程上加入时写入等待者的编号，供 cancelEventListener 单独唤醒
+    int addEventListener(int fd, FDEventType event, Fiber::FiberFunc callback = nullptr,
+                         uint64_t* waiter_id = nullptr);
+    // thread-safe 给指定的 fd 移除指定事件的全部等待者
     bool removeEventListener(int fd, FDEventType event);
-    // thread-safe 立即触发指定 fd 的指定的事件，然后移除该事件
+    // thread-safe 立即唤醒指定 fd 的指定事件的全部等待者，然后移除该事件
     bool cancelEventListener(int fd, FDEventType event);
+    // thread-safe 只唤醒并移除指定编号的等待者，例如单个等待者的超时，同一事件的其他等待者不受影响
+    bool cancelEventListener(int fd, FDEventType event, uint64_t waiter_id);
     // thread-safe 立即触发指定 fd 的所有事件，然后移除所有的事件
     bool cancelAll(int fd);
+    /**
+     * @brief 挂起当前协程，直到 fds 中任意一个 fd 的任意一个事件就绪、超时或监听被取消，用于 hook 后的 poll/select
+     * 每个 fd 等待的事件可以是多个 FDEventType 的组合；唤醒后只移除本次加入的等待者，同一事件的其他等待者不受影响。
+     * 协程不迁移，负责其他线程上的 fd 的等待者交给该线程加入与移除。只能在本调度器的任务协程中调用
+     * @param timeout_ms 超时时间，~0ull 表示不超时
+     * @return 被事件唤醒返回 0，超时返回 -1 并设置 errno 为 ETIMEDOUT，无法监听时返回 -1
+    */
+    int waitEvents(const std::vector<std::pair<int, uint32_t>>& fds, uint64_t timeout_ms);
+
+    /**
+     * @brief 通过 signalfd 接收信号，信号到达时 handler 作为普通的任务在工作线程上执行，
+     * 处理器中可以像其他协程一样加锁、分配内存、调用 drain 等，不受异步信号安全的限制
+     * 信号在调用线程与本调度器的所有工作线程中被屏蔽，不再中断这些线程上的系统调用；
+     * 调度器运行期间从工作线程以外调用时，等待其他工作线程完成屏蔽后才返回。
+     * 其他线程需要在创建之前屏蔽，因此最好在主线程创建其他线程之前调用。
+     * 同一个信号只保留最后设置的处理器；多个调度器监听同一个信号时，由先读到的调度器处理。
+     * 时间片抢占使用的实时信号(Fiber::GetPreemptSignal())不能监听
+     * @return 成功返回 0，失败返回 -1 并设置 errno
+    */
+    int addSignalHandler(int signo, SignalHandler handler);
+    // 移除信号处理器，信号仍然保持屏蔽，之后到达的该信号不再被处理
+    bool removeSignalHandler(int signo);
+
+    /**
+     * @brief 排空调度器，用于平滑重启
+     * 首先停止接受来自外部线程的新任务，然后等待挂起在 IO 事件上的协程和排队的任务执行完毕；
+     * 超过期限仍未排空时，强制取消所有 IO 事件监听（被唤醒的 IO 操作以 ECANCELED 失败），
+     * 提前触发单次定时器并丢弃周期定时器。该函数不会停止调度器，调用后仍需调用 stop()
+     * @param timeout_ms 等待期限，~0ull 表示一直等待
+     * @return 排空结果，记录被强制中断的工作
+    */
+    DrainResult drain(uint64_t timeout_ms);
+
+    // 当前使用的 IO 后端名称，"epoll" 或 "io_uring"
+    const char* getBackendName() const { return m_reactors[0]->m_poller->getName(); }
+    // 是否支持完成式 IO，hook 层据此决定挂起时提交 IO 请求还是等待就绪事件
+    bool isCompletionBased() const { return m_reactors[0]->m_poller->isCompletionBased(); }
+    // 是否每个工作线程独占一个事件循环
+    bool isPerWorkerReactor() const { return m_per_worker; }
+    // 是否对 fd 使用常驻的边缘触发注册
+    bool isPersistentRegistration() const { return m_persistent; }
+    // 定时器是否由 timerfd 唤醒
+    bool isTimerfdEnabled() const { return m_reactors[0]->m_timer_fd != -1; }
+    // 所有轮询器累计修改注册的系统调用次数
+    uint64_t getPollerCtlCount() const;
+    // 所有轮询器累计等待就绪事件的系统调用次数
+    uint64_t getPollerWaitCount() const;
+    // 事件循环的数量
+    size_t getReactorCount() const { return m_reactors.size(); }
+    // 指定事件循环的运行统计
+    ReactorStats getReactorStats(size_t index) const;
+    // 是否记录事件循环的延迟分布，由 iomanager.latency_stats 在创建时决定
+    bool isLatencyStatsEnabled() const { return m_latency_stats; }
+    // thread-safe 所有事件循环合计的延迟分布，单位为微秒
+    LatencyStats getLatencyStats() const;
+    // thread-safe 清空延迟分布，便于按时间窗口观察，定时器的统计也一并清空
+    void resetLatencyStats();
+    // 按配置设置新建 socket 的选项，开启 iomanager.socket_busy_poll 时让内核在读取时忙轮询网卡队列
+    void setupSocket(int fd);
+    /**
+     * @brief 独占事件循环时，把新建立的 fd 轮流分配给下一个工作线程，共享事件循环时什么都不做
+     * fd 关闭后被复用时重新分配，覆盖上一个 fd 留下的分配
+    */
+    void assignOwner(int fd);
+    // 负责 fd 的工作线程的线程 id，共享事件循环时返回 -1
+    long getOwnerThreadId(int fd)
+    {
+        return m_per_worker ? getWorkerThreadId(getOwnerIndex(fd)) : -1;
+    }
+
+    /**
+     * @brief 把当前协程迁移到负责 fd 的工作线程上
+     * 共享事件循环或已经位于该线程时直接返回 true；
+     * 当前是本调度器的任务协程时，挂起协程并绑定到该线程重新调度，恢复执行后返回 true；
+     * 其他情况（外部线程、调度协程、内联任务）无法迁移，返回 false
+    */
+    bool moveToOwner(int fd);
+
+    /**
+     * @brief 提交一个完成式 IO 请求并挂起当前协程，直到请求完成、超时或被取消
+     * 只能在本调度器的协程中调用，仅在 isCompletionBased() 为 true 时可用
+     * @return 成功时返回 IO 操作的结果，失败返回 -1 并设置 errno，超时为 ETIMEDOUT；
+     *         请求无法提交时 errno 为 EAGAIN，调用者可退回到就绪式的等待
+    */
+    ssize_t submitAndWait(IORequest& request);
+
+    /**
+     * @brief 异步执行会阻塞在磁盘上的文件 IO，挂起当前协程直到操作完成
+     * 支持完成式 IO 时提交给 io_uring，否则交给文件 IO 线程池（iomanager.file_io_threads）执行。
+     * 同一个文件上的操作的顺序由调用者保证，见 FileDescriptor::lockFileIO
+     * @return 成功时返回 IO 操作的结果，失败返回 -1 并设置 errno；
+     *         当前上下文不能挂起时 errno 为 EAGAIN，调用者应直接执行系统调用
+    */
+    ssize_t submitFileIO(IORequest& request);
+
+    // 当前上下文是否是本调度器中可以挂起的任务协程（不是外部线程、调度协程或内联任务）
+    bool canSuspend() const;
 
 public: // 类方法
     static IOManager* GetThis();
 
 protected:
     void tickle() override;
+    // 独占事件循环时只唤醒该工作线程的事件循环，共享时无法指定线程，唤醒任意一个
+    void tickleWorker(size_t worker_index) override;
+    // 唤醒阻塞在事件循环上的线程
+    void wakeReactor(Reactor& reactor);
 //    bool onStop() override;
     void onIdle() override;
     bool isStop() override;
     bool isStop(uint64_t& timeout);
-    void contextListResize(size_t size);
+    /**
+     * @brief 把事件加入 fd 的注册集合，并以完整的集合重新注册，重新激活边缘触发
+     * 注册集合只增不减，就绪分发与事件移除都不会修改轮询器，直到 cancelAll 移除 fd；
+     * 多个线程同时注册时，各自在注册后检查集合是否变化，保证轮询器最终注册的是完整的集合。
+     * 常驻注册时 fd 第一次等待就注册全部的读写事件，之后直接返回，不再产生系统调用
+    */
+    int registerEvent(FDContext* fd_ctx, uint32_t events);
+    /**
+     * @brief 把等待者加入 fd 的指定事件并注册到轮询器，只能在负责 fd 的线程上调用
+     * @param waiter_id 不为空时写入等待者的编号，供 removeEventWaiter 单独移除
+    */
+    int addEventWaiter(int fd, FDEventType event, FDContext::EventHandler&& handler, uint64_t* waiter_id);
+    // 只移除指定编号的等待者，只能在负责 fd 的线程上调用，返回等待者是否还没有被唤醒
+    bool removeEventWaiter(int fd, FDEventType event, uint64_t waiter_id);
+    // 负责 fd 的事件循环的序号，还没有分配时轮流分配一个
+    size_t getOwnerIndex(int fd);
+    // 当前工作线程使用的事件循环
+    Reactor& getCurrentReactor()
+    {
+        return m_per_worker ? *m_reactors[GetWorkerIndex()] : *m_reactors[0];
+    }
+    // 取消事件循环中所有的事件监听，只能在负责该事件循环的线程上调用，返回被取消的等待者数量
+    size_t cancelReactor(Reactor& reactor);
+    // 移除 fd 的注册并唤醒它的全部等待者，只能在负责 fd 的线程上调用，返回被唤醒的等待者数量
+    size_t cancelWaiters(int fd);
+    /**
+     * @brief 根据本次轮询取出的事件数量调整批次大小
+     * 批次不小于配置的 max_events；连续填满时加倍，直到 iomanager.max_events_limit
+    */
+    void adjustBatchSize(Reactor& reactor, size_t ready_count);
+    /**
+     * @brief 阻塞等待之前，以零超时反复轮询就绪事件，直到取得事件、收到唤醒或者超过忙轮询时间
+     * 忙轮询期间 tickle 只设置唤醒标志，不写管道，省去了阻塞线程被唤醒的延迟
+     * @param timeout_ms 本次等待的期限，忙轮询时间不超过它
+     * @param result 取得的就绪事件数量
+     * @return 是否取得了事件或者收到了唤醒，false 时调用者应当阻塞等待
+    */
+    bool busyPoll(Reactor& reactor, epoll_event* event_list, int max_events,
+                  uint64_t timeout_ms, int& result);
 
-    void onTimerInsertedAtFirst() override;
+    void onTimerInsertedAtFirst(size_t shard) override;
+    void onFiberResume(uint64_t latency_us) override;
+    // 工作线程使用自己序号对应的分片，外部线程依次分配到各个分片上
+    size_t getCurrentTimerShard() const override;
+    // 事件循环负责的定时器分片中，下一个定时器的等待时间(ms)，不加锁
+    uint64_t getReactorTimeout(const Reactor& reactor);
+    // 事件循环负责的定时器分片中，最早的到期时间(us)，不加锁
+    uint64_t getReactorDeadline(const Reactor& reactor);
+    /**
+     * @brief 把事件循环的 timerfd 设置为它负责的定时器分片中最早的到期时间
+     * 已经设置的时间不晚于它时直接返回，提前醒来的线程会再次调用本函数设置正确的时间
+     * @param fired timerfd 是否已经到期，到期后必须重新设置
+    */
+    void armTimer(Reactor& reactor, bool fired = false);
+    // 在调用线程与本调度器的所有工作线程中屏蔽信号
+    void blockSignals(const sigset_t& mask);
+    // 读出 signalfd 中所有的信号，调度对应的处理器
+    void dispatchSignals();
+    // 文件 IO 线程池的线程函数
+    void runFileIO();
 
 private: // 私有成员
-    LockType m_lock{};
-    int m_epoll_fd = 0;                          // epoll 文件标识符
-    int m_tickle_fds[2]{0};                      // 主线程给子线程发消息用的管道
+    FDContextTable m_fd_contexts{};              // fd 上下文表
+    bool m_per_worker = false;                   // 是否每个工作线程独占一个事件循环
+    bool m_persistent = false;                   // 是否使用常驻的边缘触发注册
+    size_t m_owner_count = 1;                    // 负责 fd 的事件循环数量
+    std::atomic_size_t m_next_owner{0};          // 下一个分配 fd 的事件循环，轮流递增
+    std::vector<std::unique_ptr<Reactor>> m_reactors{}; // 事件循环，下标对应工作线程序号
     std::atomic_size_t m_pending_event_count{0}; // 等待执行的事件的数量
-    std::vector<std::unique_ptr<FDContext>> m_fd_context_list{}; // FDContext 的对象池，下标对应 fd id
+    std::atomic_bool m_drain_cancelled{false};   // 排空超时，拒绝新的事件监听
+    int m_signal_fd = -1;                        // 第一次添加信号处理器时创建
+    Mutex m_signal_mutex{};
+    sigset_t m_signal_mask{};                    // signalfd 监听的信号
+    std::unordered_map<int, std::shared_ptr<SignalHandler>> m_signal_handlers{};
+    Mutex m_file_io_mutex{};
+    std::vector<Thread::ptr> m_file_io_threads{}; // 文件 IO 线程池，第一次使用时创建
+    std::deque<IORequest*> m_file_io_queue{};     // 等待执行的文件 IO 请求
+    Semaphore m_file_io_sem{0};
+    bool m_file_io_stopping = false;
+    bool m_latency_stats = false;                // 是否记录下面的延迟分布
+    Histogram m_poll_wait_hist{};
+    Histogram m_events_hist{};
+    Histogram m_resume_hist{};
+    Histogram m_loop_hist{};
+    // 调度器专属的配置项，名称不能作为配置项名称时为 nullptr
+    ConfigVar<int>::ptr m_max_events;            // 每次轮询取出的事件数量的初始值
+    ConfigVar<int>::ptr m_max_timeout_ms;        // 每次轮询最长的阻塞时间
+    ConfigVar<int>::ptr m_busy_poll_us;          // 空闲线程阻塞之前忙轮询的时间，0 表示不忙轮询
+    // 忙轮询时间在每次空闲时都要读取，缓存在原子变量中，由两个配置项的变更事件更新，不必每次加读锁
+    std::atomic_int m_busy_poll_cache{0};
+    uint64_t m_busy_poll_listeners[2]{};         // 全局与专属配置项上的变更事件处理器编号
 };
 } // namespace zjl
 
@@ -0,0 +1,223 @@
+#ifndef SERVER_FRAMEWORK_POLLER_H
+#define SERVER_FRAMEWORK_POLLER_H
+
+#include "fiber.h"
+#include "noncopyable.h"
+#include "thread.h"
+#include <atomic>
+#include <linux/time_types.h>
+#include <memory>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace zjl
+{
+
+/**
+ * @brief 完成式 IO 请求
+ * 由发起 IO 的协程在自己的栈上创建，请求完成之前该协程一直挂起，因此请求对象在完成前始终有效
+*/
+struct IORequest
+{
+    enum Opcode
+    {
+        READ,
+        WRITE,
+        READV,
+        WRITEV,
+        RECV,
+        SEND,
+        RECVMSG,
+        SENDMSG,
+        ACCEPT,
+        CONNECT,
+        FSYNC
+    };
+
+    /**
+     * @param addr 缓冲区、iovec 数组、msghdr 或 sockaddr，取决于 opcode
+     * @param len 缓冲区长度、iovec 数量或 sockaddr 长度
+     * @param flags recv/send 系列函数的 flags，FSYNC 时非 0 表示 fdatasync
+     * @param addr2 accept 的 socklen_t* 参数
+    */
+    IORequest(Opcode op, int fd, const void* addr = nullptr, uint64_t len = 0,
+              int flags = 0, void* addr2 = nullptr)
+        : m_opcode(op), m_fd(fd), m_addr(const_cast<void*>(addr)), m_len(len),
+          m_flags(flags), m_addr2(addr2)
+    {
+    }
+
+    /**
+     * @brief socket 上的 read/write 系列请求转换为 recv/send 系列
+     * 内核对非阻塞文件上的 read/write 请求直接返回 EAGAIN，recv/send 请求在 socket 未就绪时由 io_uring 自行等待
+    */
+    void useSocketOpcode();
+
+    Opcode m_opcode;
+    int m_fd;
+    void* m_addr;
+    uint64_t m_len;
+    int m_flags;
+    void* m_addr2;
+    int64_t m_offset = -1;          // 文件读写的偏移，-1 表示使用并更新文件的当前偏移
+    uint64_t m_timeout_ms = ~0ull;  // 超时时间，~0ull 表示不超时
+    int m_result = 0;               // 完成结果，失败时为 -errno
+    Fiber::ptr m_fiber;             // 挂起等待请求完成的协程
+    __kernel_timespec m_timeout_ts{}; // 提交给内核的超时期限(CLOCK_MONOTONIC 绝对时间)，请求完成前必须保持有效
+    msghdr m_msg{};                 // readv/writev 转换为 recvmsg/sendmsg 时使用的消息头
+    bool m_polling = false;         // 请求返回 EAGAIN 后正在等待 fd 就绪，就绪后重新提交
+    IORequest* m_prev = nullptr;    // 未完成请求链表
+    IORequest* m_next = nullptr;
+};
+
+/**
+ * @brief IO 事件轮询器接口
+ * 就绪式接口与 epoll 的语义一致；支持完成式 IO 的实现额外提供请求的提交与收割
+*/
+class Poller : public noncopyable
+{
+public:
+    using ptr = std::unique_ptr<Poller>;
+
+    /**
+     * @brief 按名称创建轮询器，可选 "epoll" 与 "io_uring"
+     * io_uring 不可用（内核版本过低、被禁用或缺少所需的操作码）时回退到 epoll
+    */
+    static ptr Create(const std::string& backend);
+
+    virtual ~Poller() = default;
+
+    virtual const char* getName() const = 0;
+
+    // 注册 fd 的就绪事件监听，事件就绪时 data 原样返回
+    virtual int add(int fd, uint32_t events, void* data) = 0;
+    // 修改 fd 监听的事件
+    virtual int modify(int fd, uint32_t events, void* data) = 0;
+    // 移除 fd 的所有事件监听
+    virtual int remove(int fd) = 0;
+    // 等待就绪事件，返回就绪事件的数量，出错返回 -1
+    virtual int wait(epoll_event* events, int max_events, int timeout_ms) = 0;
+
+    // 是否支持完成式 IO
+    virtual bool isCompletionBased() const { return false; }
+    // 缓冲一个完成式 IO 请求，请求在下一次 flush() 或缓冲区写满时批量提交，失败返回 false
+    virtual bool submit(IORequest* /*request*/) { return false; }
+    // 把缓冲的请求批量提交给内核
+    virtual void flush() {}
+    // 取出已经完成的请求
+    virtual void reap(std::vector<IORequest*>& /*done*/) {}
+    // 取消所有未完成的请求，被取消的请求以 -ECANCELED 完成，返回取消的请求数量
+    virtual size_t cancelAll() { return 0; }
+
+    // 累计修改注册（add、modify、remove）的系统调用次数
+    uint64_t getCtlCount() const { return m_ctl_count.load(std::memory_order_relaxed); }
+    // 累计等待就绪事件的系统调用次数
+    uint64_t getWaitCount() const { return m_wait_count.load(std::memory_order_relaxed); }
+
+protected:
+    Poller() = default;
+
+protected:
+    std::atomic_uint64_t m_ctl_count{0};
+    std::atomic_uint64_t m_wait_count{0};
+};
+
+/**
+ * @brief 基于 epoll 的就绪式轮询器
+*/
+class EpollPoller : public Poller
+{
+public:
+    EpollPoller();
+    ~EpollPoller() override;
+
+    const char* getName() const override { return "epoll"; }
+    int add(int fd, uint32_t events, void* data) override;
+    int modify(int fd, uint32_t events, void* data) override;
+    int remove(int fd) override;
+    int wait(epoll_event* events, int max_events, int timeout_ms) override;
+
+protected:
+    int m_epoll_fd = -1;
+};
+
+/**
+ * @brief 基于 io_uring 的完成式轮询器
+ * 直接使用系统调用操作 io_uring，不依赖 liburing。
+ * 就绪式监听（tickle 管道、addEventListener 的回调）仍由 epoll 完成，
+ * io_uring 通过注册的 eventfd 接入 epoll，完成队列有新结果时唤醒 epoll_wait
+*/
+class UringPoller final : public EpollPoller
+{
+public:
+    UringPoller() = default;
+    ~UringPoller() override;
+
+    /**
+     * @brief 创建并映射 io_uring，注册 eventfd 并接入 epoll
+     * @param entries 提交队列的长度
+     * @return 内核不支持或资源不足时返回 false，此时对象不可用
+    */
+    bool init(unsigned entries);
+
+    const char* getName() const override { return "io_uring"; }
+    int wait(epoll_event* events, int max_events, int timeout_ms) override;
+
+    bool isCompletionBased() const override { return true; }
+    bool submit(IORequest* request) override;
+    void flush() override;
+    void reap(std::vector<IORequest*>& done) override;
+    size_t cancelAll() override;
+
+private:
+    // 检查内核是否支持所需的全部操作码
+    bool probe();
+    /**
+     * @brief 从提交队列取一个空闲的 SQE，调用前需持有 m_mutex
+     * @param reserve 需要连续使用的 SQE 数量，空闲数量不足时先提交已缓冲的 SQE，
+     *        保证随后的 reserve - 1 次调用不会触发提交，用于提交链接在一起的请求
+    */
+    io_uring_sqe* getSqe(unsigned reserve = 1);
+    // 把缓冲的 SQE 提交给内核，调用前需持有 m_mutex
+    void flushLocked();
+    /**
+     * @brief 为请求填充 SQE，请求带有超时时间时再链接一个超时请求，调用前需持有 m_mutex
+     * @param poll 为 true 时不提交请求本身，而是等待 fd 就绪，就绪后再重新提交请求
+    */
+    bool prepare(IORequest* request, bool poll);
+
+private:
+    Mutex m_mutex{};
+    int m_ring_fd = -1;
+    int m_event_fd = -1;           // 注册到 io_uring 的 eventfd，有完成事件时可读
+
+    void* m_sq_ring = nullptr;     // 提交队列的共享内存
+    size_t m_sq_ring_size = 0;
+    void* m_cq_ring = nullptr;     // 完成队列的共享内存，内核支持时与提交队列共用一块
+    size_t m_cq_ring_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    unsigned* m_sq_head = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned* m_sq_flags = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned m_sq_entries = 0;
+    unsigned m_sqe_tail = 0;       // 已填充但尚未提交的 SQE 的尾部
+
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    IORequest* m_inflight = nullptr; // 已提交但尚未完成的请求
+};
+
+} // namespace zjl
+
+#endif // SERVER_FRAMEWORK_POLLER_H
@@ -21,44 +21,46 @@ class Scheduler : public noncopyable
 private: // 内部类
     /**
      * @brief 任务类
-     * 等待分配线程执行的任务，可以是 zjl::Fiber 或 std::function
+     * 等待分配线程执行的任务，可以是 zjl::Fiber 或 zjl::Callable
      * */
     struct Task
     {
         using ptr = std::shared_ptr<Task>;
         using uptr = std::unique_ptr<Task>;
-        using TaskFunc = std::function<void()>;
+        using TaskFunc = Fiber::FiberFunc;
 
         Fiber::ptr fiber;
         TaskFunc callback;
         long thread_id; // 任务要绑定执行线程的 id
+        bool run_inline = false; // 是否直接在调度协程上执行 callback，不为其创建协程
+        uint64_t affinity_deadline_us = 0; // 因为亲和性留给上次运行的工作线程的期限，0 表示还没有让出过
 
         Task()
             : thread_id(-1) {}
 
-        Task(const Task& rhs) = default;
+        Task(Task&& rhs) = default;
 
         Task(Fiber::ptr f, long tid)
             : fiber(std::move(f)), thread_id(tid) {}
 
-        Task(const TaskFunc& cb, long tid)
-            : callback(cb), thread_id(tid) {}
-
         Task(TaskFunc&& cb, long tid)
             : callback(std::move(cb)), thread_id(tid) {}
 
-        Task& operator=(const Task& rhs) = default;
+        Task& operator=(Task&& rhs) = default;
 
         void reset()
         {
             fiber = nullptr;
             callback = nullptr;
             thread_id = -1;
+            run_inline = false;
+            affinity_deadline_us = 0;
         }
     };
 
 public: // 内部类型、静态方法、友元声明
     friend class Fiber;
+    friend struct FDContext;
     using ptr = std::shared_ptr<Scheduler>;
     using uptr = std::unique_ptr<Scheduler>;
 
@@ -66,6 +68,15 @@ public: // 内部类型、静态方法、友元声明
     static Scheduler* GetThis();
     // 获取调度器的调度工作协程
     static Fiber* GetMainFiber();
+    // 当前线程是否正在执行内联任务，仅在 Debug 构建下有效，Release 构建始终返回 false
+    static bool IsRunningInlineTask();
+    // 获取当前线程在所属调度器中的工作线程序号，不是调度器的工作线程时返回 -1
+    static int GetWorkerIndex();
+    /**
+     * @brief 挂起当前协程，并把它绑定到指定线程上重新调度，用于把协程迁移到其他工作线程
+     * 只能在调度器的任务协程中调用，之后协程的每次重新调度都绑定在该线程上
+    */
+    static void YieldToThread(long thread_id);
 
 public: // 实例方法
     /**
@@ -84,22 +95,130 @@ public: // 实例方法
     {
         return m_idle_thread_count > 0;
     }
+    // 调度器是否处于排空状态，排空状态下不再接受来自调度器外部的新任务
+    bool isDraining() const { return m_draining; }
+    // 工作线程数量，包括 use_caller 为 true 时的主线程
+    size_t getWorkerCount() const { return m_worker_count; }
+    /**
+     * @brief 获取工作线程的线程 id
+     * 线程池的线程使用 [0, 线程池大小) 的序号，use_caller 为 true 时主线程使用最后一个序号
+     * @return 工作线程尚未开始运行时返回 -1
+    */
+    long getWorkerThreadId(size_t index) const { return m_worker_thread_ids[index]; }
+    // 阻塞到线程池的线程全部登记了线程 id，之后 getWorkerThreadId() 不再返回 -1，只能在 start() 之后调用
+    void waitForWorkers();
+    // 协程在上次运行的工作线程上恢复执行的次数
+    uint64_t getLocalResumeCount() const { return m_local_resume_count; }
+    // 协程迁移到其他工作线程上恢复执行的次数
+    uint64_t getMigratedResumeCount() const { return m_migrated_resume_count; }
+
+    /**
+     * @brief 设置协程的时间片，可以在调度器运行期间修改
+     * 工作线程的 CPU 时间每经过一个时间片会收到一次信号，期间没有发生协程切换时，
+     * 当前协程会在下一个抢占检查点（被 hook 的系统函数或者 Fiber::CheckPreempt()）被挂起
+     * @param slice_us 时间片长度（线程 CPU 时间，微秒），0 表示关闭抢占
+     * @param forced 是否允许在 Fiber::PreemptibleScope 区域内直接在信号处理函数中强制抢占
+     * */
+    void setTimeSlice(uint64_t slice_us, bool forced = false)
+    {
+        m_forced_preempt = forced;
+        m_time_slice_us = slice_us;
+    }
+    uint64_t getTimeSlice() const { return m_time_slice_us; }
+    // 协程因为耗尽时间片被抢占的次数
+    uint64_t getPreemptCount() const { return m_preempt_count; }
 
     /**
      * @brief 添加任务 thread-safe
-     * @param Executable 模板类型必须是 std::unique_ptr<zjl::Fiber> 或者 std::function
+     * @param Executable 模板类型必须是 zjl::Fiber::ptr 或者可以转换为 zjl::Callable 的可调用对象
      * @param exec Executable 的实例
      * @param instant 是否优先调度
      * @param thread_id 任务要绑定执行线程的 id
+     * @return 任务是否被接受，调度器排空时会拒绝来自外部线程的任务
      * */
     template <typename Executable>
-    void schedule(Executable&& exec, long thread_id = -1, bool instant = false)
+    bool schedule(Executable&& exec, long thread_id = -1, bool instant = false)
+    {
+        if (isExternalRejected())
+        {
+            return false;
+        }
+        scheduleInternal(std::forward<Executable>(exec), thread_id, instant);
+        return true;
+    }
+
+    /**
+     * @brief 添加多个任务 thread-safe
+     * 任务会从迭代器指向的元素中移动出来，调用后区间内的元素处于被移动后的状态
+     * @param begin 单向迭代器
+     * @param end 单向迭代器
+     * @return 任务是否被接受，调度器排空时会拒绝来自外部线程的任务
+    */
+    template <typename InputIterator>
+    bool schedule(InputIterator begin, InputIterator end)
+    {
+        if (isExternalRejected())
+        {
+            return false;
+        }
+        scheduleInternal(begin, end);
+        return true;
+    }
+
+    /**
+     * @brief 添加内联任务 thread-safe
+     * 内联任务直接在调度协程上执行，不会为其创建新的协程，也省去了两次上下文切换，
+     * 适用于不会阻塞的小任务，例如修改标志位、投递后续任务。
+     * 内联任务中禁止挂起协程（包括调用会被 hook 的阻塞函数），Debug 构建下会触发断言
+     * @param cb 可以转换为 zjl::Callable 的可调用对象
+     * @param thread_id 任务要绑定执行线程的 id
+     * @return 任务是否被接受，调度器排空时会拒绝来自外部线程的任务
+     * */
+    template <typename Func>
+    bool scheduleInline(Func&& cb, long thread_id = -1)
+    {
+        if (isExternalRejected())
+        {
+            return false;
+        }
+        scheduleInlineInternal(std::forward<Func>(cb), thread_id);
+        return true;
+    }
+
+protected:
+    /**
+     * @brief 添加内联任务 thread-safe，不受排空状态的限制
+     * */
+    template <typename Func>
+    void scheduleInlineInternal(Func&& cb, long thread_id = -1)
+    {
+        bool need_tickle = false;
+        {
+            ScopedLock lock(&m_mutex);
+            need_tickle = m_task_list.empty();
+            auto task = std::make_unique<Task>(Task::TaskFunc(std::forward<Func>(cb)), thread_id);
+            if (task->callback)
+            {
+                task->run_inline = true;
+                m_task_list.push_back(std::move(task));
+            }
+        }
+        if (need_tickle)
+            tickle();
+    }
+
+    /**
+     * @brief 添加任务 thread-safe，不受排空状态的限制，
+     * 供调度器内部使用，例如重新调度被唤醒的协程、触发 IO 事件与定时器
+     * */
+    template <typename Executable>
+    void scheduleInternal(Executable&& exec, long thread_id = -1, bool instant = false)
     {
         bool need_tickle = false;
         {
             ScopedLock lock(&m_mutex);
             // std::forward
-            need_tickle = scheduleNonBlock(std::forward<Executable>(exec), thread_id);
+            need_tickle = scheduleNonBlock(std::forward<Executable>(exec), thread_id, instant);
         }
         // 该工作了
         if (need_tickle)
@@ -107,19 +226,17 @@ public: // 实例方法
     }
 
     /**
-     * @brief 添加多个任务 thread-safe
-     * @param begin 单向迭代器
-     * @param end 单向迭代器
+     * @brief 添加多个任务 thread-safe，不受排空状态的限制
     */
     template <typename InputIterator>
-    void schedule(InputIterator begin, InputIterator end)
+    void scheduleInternal(InputIterator begin, InputIterator end)
     {
         bool need_tickle = false;
         {
             ScopedLock lock(&m_mutex);
             while (begin != end)
             {
-                need_tickle = scheduleNonBlock(*begin) || need_tickle;
+                need_tickle = scheduleNonBlock(std::move(*begin)) || need_tickle;
                 ++begin;
             }
         }
@@ -129,9 +246,28 @@ public: // 实例方法
         }
     }
 
-protected:
+    // 当前是否应该拒绝新任务：处于排空状态，并且调用方不是本调度器的线程
+    bool isExternalRejected() const
+    {
+        return m_draining && GetThis() != this;
+    }
+
+    // thread-safe 获取排队等待执行的任务数量
+    size_t pendingTaskCount() const;
+    // thread-safe 是否有当前线程可以执行的任务，即未绑定线程或绑定到当前线程的任务，
+    // 因为亲和性留给其他工作线程、还没有到期限的任务不算
+    bool hasRunnableTask() const;
+
     void run();
+    // 工作线程根据调度器当前的时间片设置，创建、修改或停止本线程的时间片定时器
+    void updateTimeSlice();
+    // 在调度协程上直接执行内联任务
+    void runInline(Task::TaskFunc& callback);
     virtual void tickle();
+    // 唤醒指定序号的工作线程，默认唤醒任意一个空闲的工作线程
+    virtual void tickleWorker(size_t /*worker_index*/) { tickle(); }
+    // 被事件唤醒的协程即将恢复执行时的回调函数，latency_us 为唤醒到恢复执行的延迟
+    virtual void onFiberResume(uint64_t /*latency_us*/) {}
     // 调度器停止时的回调函数，返回调度器当前是否处于停止工作的状态
     virtual bool onStop() { return isStop(); }
     // 调度器空闲时的回调函数
@@ -147,7 +283,7 @@ protected:
 private:
     /**
      * @brief 添加任务 non-thread-safe
-     * @param Executable 模板类型必须是 std::unique_ptr<zjl::Fiber> 或者 std::function
+     * @param Executable 模板类型必须是 zjl::Fiber::ptr 或者可以转换为 zjl::Callable 的可调用对象
      * @param exec Executable 的实例
      * @param thread_id 任务要绑定执行线程的 id
      * @param instant 是否优先调度
@@ -159,7 +295,7 @@ private:
         bool need_tickle = m_task_list.empty();
         // std::forward
         auto task = std::make_unique<Task>(std::forward<Executable>(exec), thread_id);
-        // 创建的任务实例存在有效的 zjl::Fiber 或 std::function
+        // 创建的任务实例存在有效的 zjl::Fiber 或 zjl::Callable
         if (task->fiber || task->callback)
         {
             if (instant)
@@ -186,8 +322,33 @@ protected:
     bool m_stopping = true;
     // 是否自动停止
     bool m_auto_stop = false;
+    // 是否处于排空状态
+    std::atomic_bool m_draining{false};
+    // 工作线程数量，包括 use_caller 为 true 时的主线程
+    size_t m_worker_count = 0;
 
 private:
+    // 工作线程是否空闲，下标是工作线程序号
+    std::unique_ptr<std::atomic_bool[]> m_worker_idle;
+    // 工作线程的线程 id，下标是工作线程序号
+    std::unique_ptr<std::atomic_long[]> m_worker_thread_ids;
+    // 下一个启动的线程池线程的序号
+    std::atomic_int m_worker_seq{0};
+    // 线程池的线程登记线程 id 之后各通知一次
+    Semaphore m_worker_registered{0};
+    Mutex m_register_mutex;
+    bool m_workers_registered = false; // 由 m_register_mutex 保护
+    // 协程在上次运行的工作线程上恢复执行的次数
+    std::atomic_uint64_t m_local_resume_count{0};
+    // 协程迁移到其他工作线程上恢复执行的次数
+    std::atomic_uint64_t m_migrated_resume_count{0};
+    // 协程时间片（微秒），0 表示关闭抢占
+    std::atomic_uint64_t m_time_slice_us{0};
+    // 是否允许强制抢占
+    std::atomic_bool m_forced_preempt{false};
+    // 协程被抢占的次数
+    std::atomic_uint64_t m_preempt_count{0};
+
     mutable Mutex m_mutex;
     // 负责调度的协程，仅在类实例化参数中 use_caller 为 true 时有效
     Fiber::ptr m_root_fiber;
@@ -32,24 +32,23 @@ private:
 
 /**
  * @brief 作用域线程锁包装器
- * T 需要实现 lock() 与 unlock() 方法
+ * T 需要实现 lock() 与 unlock() 方法，mutex 为 nullptr 时不加锁
 */
 template <typename T>
 class ScopedLockImpl
 {
 public:
     explicit ScopedLockImpl(T* mutex)
-        : m_mutex(mutex)
+        : m_mutex(mutex), m_locked(false)
     {
-        m_mutex->lock();
-        m_locked = true;
+        lock();
     }
 
     ~ScopedLockImpl() { unlock(); }
 
     void lock()
     {
-        if (!m_locked)
+        if (!m_locked && m_mutex)
         {
             m_mutex->lock();
             m_locked = true;
@@ -79,17 +78,16 @@ class ReadScopedLockImpl
 {
 public:
     explicit ReadScopedLockImpl(T* mutex)
-        : m_mutex(mutex)
+        : m_mutex(mutex), m_locked(false)
     {
-        m_mutex->readLock();
-        m_locked = true;
+        lock();
     }
 
     ~ReadScopedLockImpl() { unlock(); }
 
     void lock()
     {
-        if (!m_locked)
+        if (!m_locked && m_mutex)
         {
             m_mutex->readLock();
             m_locked = true;
@@ -119,17 +117,16 @@ class WriteScopedLockImpl
 {
 public:
     explicit WriteScopedLockImpl(T* mutex)
-        : m_mutex(mutex)
+        : m_mutex(mutex), m_locked(false)
     {
-        m_mutex->writeLock();
-        m_locked = true;
+        lock();
     }
 
     ~WriteScopedLockImpl() { unlock(); }
 
     void lock()
     {
-        if (!m_locked)
+        if (!m_locked && m_mutex)
         {
             m_mutex->writeLock();
             m_locked = true;
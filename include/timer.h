@@ -1,15 +1,21 @@
 #ifndef SERVER_FRAMEWORK_TIMER_H
 #define SERVER_FRAMEWORK_TIMER_H
 
-#include <set>
+#include <atomic>
+#include <chrono>
+#include <string>
 #include <vector>
 #include <memory>
+#include "callable.h"
+#include "histogram.h"
+#include "noncopyable.h"
 #include "thread.h"
 
 namespace zjl 
 {
 
 class TimerManager;
+class TimerQueue;
 
 /**
  * @brief 定时器类
@@ -17,9 +23,12 @@ class TimerManager;
 class Timer : public std::enable_shared_from_this<Timer>
 {
 friend class TimerManager;
+friend class SetTimerQueue;
+friend class TimingWheel;
 
 public:
     typedef std::shared_ptr<Timer> ptr;
+    using TimerFunc = Callable<void()>;
 
     /**
      * @brief 取消定时器
@@ -32,34 +41,74 @@ public:
      * @param from_now 是否立即开始倒计时
     */
     bool reset(uint64_t ms, bool from_now);
+    // 以微秒精度重设定时间隔
+    bool reset(std::chrono::microseconds delay, bool from_now);
 
     /**
      * @brief 重新计时
     */
     bool refresh();
 
+    /**
+     * @brief 设置定时器的松弛时间，到期时间向上取整到 slack_us 的整数倍，从下一次到期开始生效
+     * 统计刷新、缓存清理等不要求准时的定时器可以设置较大的松弛时间，与其他定时器在同一时刻一起到期
+     * @param slack_us 松弛时间(us)，0 表示准时到期
+    */
+    bool setSlack(uint64_t slack_us);
+
 private:
     /**
      * @brief Constructor
-     * @param ms 延迟时间
+     * @param us 延迟时间(us)
      * @param fn 回调函数
      * @param cyclic 是否重复执行
      * @param manager 执行环境
     */
-    Timer(uint64_t ms, std::function<void()> fn, 
+    Timer(uint64_t us, TimerFunc fn, 
         bool cyclic, TimerManager* manager);
 
     /**
      * @brief 用于创建只有时间信息的定时器，基本是用于查找超时的定时器，无其他作用
+     * @param next 到期的绝对时间戳(us)
     */
     Timer(uint64_t next);
 
 private:
     bool m_cyclic = false;  // 是否重复
-    uint64_t m_ms = 0;      // 执行周期
-    uint64_t m_next = 0;    // 执行的绝对时间戳
-    std::function<void()> m_fn;
+    uint64_t m_us = 0;      // 执行周期(us)
+    uint64_t m_start = 0;   // 本周期开始计时的 Clock 时间戳(us)
+    uint64_t m_slack_us = 0; // 松弛时间(us)，到期时间向上取整到它的整数倍
+    uint64_t m_next = 0;    // 执行的 Clock 时间戳(us)，精确到微秒，到期时间不受毫秒取整的影响
+    TimerFunc m_fn;         // 单次定时器的回调，到期时直接移动给调度器
+    std::shared_ptr<TimerFunc> m_cyclic_fn; // 周期定时器的回调，每次到期时共享给调度器执行，执行可能重叠
+    bool m_conditional = false;   // 是否是条件定时器
+    std::weak_ptr<void> m_weak_cond; // 条件定时器的执行条件
     TimerManager* m_manager = nullptr;
+    size_t m_shard = 0;     // 所属的分片，创建后不再改变
+    // 在时间轮中的链表节点与所在的槽位，-1 表示不在时间轮中，只由 TimingWheel 维护
+    Timer* m_wheel_prev = nullptr;
+    Timer* m_wheel_next = nullptr;
+    int m_wheel_slot = -1;
+    Timer::ptr m_wheel_ref; // 挂在时间轮上时持有自身的引用
+
+private:
+    // 定时器是否仍然有效（未被取消、未执行完毕）
+    bool isValid() const { return m_fn || m_cyclic_fn; }
+    // 清除回调函数，定时器失效
+    void clearCallback();
+    // 从 start 开始计时，按松弛时间计算到期时间
+    void restart(uint64_t start);
+    // 统计用的类型，条件定时器优先于周期定时器
+    size_t getType() const { return m_conditional ? CONDITIONAL : m_cyclic ? CYCLIC : ONESHOT; }
+
+private:
+    enum Type
+    {
+        ONESHOT = 0,
+        CYCLIC = 1,
+        CONDITIONAL = 2,
+        TYPE_COUNT = 3,
+    };
 
 private:
     struct Comparator {
@@ -67,74 +116,251 @@ private:
     };
 };
 
+/**
+ * @brief 执行最慢的定时器回调
+*/
+struct SlowTimerCallback
+{
+    std::string name;          // 回调的类型名，lambda 的类型名中包含定义它的函数
+    uint64_t duration_us = 0;  // 执行耗时
+};
+
+/**
+ * @brief TimerManager 的统计信息
+*/
+struct TimerStats
+{
+    size_t oneshot = 0;     // 等待到期的单次定时器数量
+    size_t cyclic = 0;      // 周期定时器数量
+    size_t conditional = 0; // 条件定时器数量，包括周期执行的条件定时器
+    size_t timeouts = 0;    // 侵入式超时节点数量
+    HistogramSnapshot lateness_us;     // 定时器到期到被取出的延迟
+    HistogramSnapshot fired_per_batch; // 每次从一个分片取出的到期回调数量，突增说明定时器扎堆到期
+    std::vector<SlowTimerCallback> slowest; // 执行最慢的回调，从慢到快，需开启 timer.profile_callbacks
+};
+
+/**
+ * @brief 侵入式的超时节点，嵌入在等待者的栈帧或对象中，不由智能指针管理
+ * 用于每次挂起都要设置、唤醒后立即取消的 IO 超时：设置与取消都不分配内存，
+ * 回调不超过 Callable 的内联缓冲区时也不分配。到期时回调在持有分片锁时被移出节点，
+ * 之后不再访问节点，因此 cancel() 返回后节点可以立即销毁
+*/
+class TimeoutNode : public noncopyable
+{
+friend class TimerManager;
+public:
+    static constexpr size_t NPOS = ~static_cast<size_t>(0);
+
+    TimeoutNode() = default;
+    // 析构时取消仍在等待的超时
+    ~TimeoutNode();
+
+    /**
+     * @brief 取消超时
+     * @return 节点是否仍在等待；返回 false 表示已经到期（回调已经或即将执行）或者没有设置
+    */
+    bool cancel();
+
+private:
+    TimerManager* m_manager = nullptr; // 最近一次设置超时的定时器调度器
+    size_t m_shard = 0;                // 所在的分片
+    size_t m_heap_index = NPOS;        // 在分片的最小堆中的位置，NPOS 表示不在等待
+    uint64_t m_next = 0;               // 到期的 Clock 时间戳(us)
+    Timer::TimerFunc m_fn;             // 到期时移动给调度器的回调
+};
+
 /**
  * @brief 定时器调度类
+ * 定时器按分片存放，每个分片有自己的锁与定时器队列。定时器属于创建它的线程所在的分片，
+ * 之后的取消、重设都在该分片中进行；每个工作线程只操作自己的分片，互不竞争同一把锁。
+ * 每个分片维护一个不晚于最早到期时间的下界，查询等待时间与检查是否有定时器到期都不需要加锁
 */
 class TimerManager  
 {
 friend class Timer;
 public:
-    using RWLockType = RWLock;
+    using MutexType = Mutex;
 
-    TimerManager();
+    /**
+     * @param shard_count 分片数量，至少为 1
+    */
+    explicit TimerManager(size_t shard_count = 1);
     virtual ~TimerManager();
 
     /**
      * @brief 新增一个普通定时器
+     * 周期定时器的每次执行共享同一个回调对象，上一次还没有执行完时下一次到期会在其他线程上并发调用它，
+     * 回调需要自行保证线程安全，例如不要在 mutable lambda 中修改捕获的变量
      * @param ms 延迟毫秒数
      * @param fn 回调函数
      * @param weak_cond 执行条件
      * @param cyclic 是否重复执行
     */
-    Timer::ptr addTimer(uint64_t ms, std::function<void()> fn, bool cyclic = false);
+    Timer::ptr addTimer(uint64_t ms, Timer::TimerFunc fn, bool cyclic = false);
+    /**
+     * @brief 以微秒精度新增定时器，可以直接传入 std::chrono::milliseconds、seconds 等时长
+     * 纳秒精度的时长需要先用 std::chrono::ceil 转换，避免截断后提前到期
+    */
+    Timer::ptr addTimer(std::chrono::microseconds delay, Timer::TimerFunc fn, bool cyclic = false);
 
     /**
      * @brief 新增一个条件定时器。当到达执行时间时，提供的条件变量依旧有效，则执行，否则不执行
+     * 条件在定时器到期、取出回调时检查，因此不需要额外包装一层回调函数
      * @param ms 延迟毫秒数
      * @param fn 回调函数
      * @param weak_cond 条件变量，利用智能指针是否有效作为判断条件
      * @param cyclic 是否重复执行
     */
-    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> fn,
+    Timer::ptr addConditionTimer(uint64_t ms, Timer::TimerFunc fn,
         std::weak_ptr<void> weak_cond, bool cyclic = false);
+    // 以微秒精度新增条件定时器
+    Timer::ptr addConditionTimer(std::chrono::microseconds delay, Timer::TimerFunc fn,
+        std::weak_ptr<void> weak_cond, bool cyclic = false);
+
+    /**
+     * @brief 设置侵入式的超时节点，delay 后把 fn 交给调度器执行，节点已经在等待时先取消
+     * 节点放在当前线程的分片中，与普通定时器一起按到期时间取出
+    */
+    void armTimeout(TimeoutNode& node, std::chrono::microseconds delay, Timer::TimerFunc fn);
 
     /**
-     * @brief 获取下一个定时器的等待时间
+     * @brief 取消超时节点，同 TimeoutNode::cancel()
+    */
+    bool disarmTimeout(TimeoutNode& node);
+
+    /**
+     * @brief 获取下一个定时器的等待时间，不加锁
      * @return 返回结果分为三种：无定时器等待执行返回 ~0ull，存在超时未执行的定时器返回 0，存在等待执行的定时器返回剩余的等待时间
     */
     uint64_t getNextTimer();
+    // 只考虑指定分片的 getNextTimer()
+    uint64_t getNextTimer(size_t shard);
+
+    /**
+     * @brief 获取最早到期的定时器的 Clock 时间戳(us)，无定时器时返回 ~0ull，不加锁
+     * 定时器被取消后返回值可能早于实际的到期时间，但不会晚于它
+    */
+    uint64_t getNextDeadline();
+    // 只考虑指定分片的 getNextDeadline()
+    uint64_t getNextDeadline(size_t shard);
 
     /**
      * @brief 获取所有等待超时的定时器的回调函数对象，并将定时器从队列中移除，这个函数会自动将周期调用的定时器存回队列
+     * 单次定时器的回调直接移动到 fns 中，不会产生拷贝
     */
-    void listExpiredCallback(std::vector<std::function<void()>>& fns);
+    void listExpiredCallback(std::vector<Timer::TimerFunc>& fns);
+    // 只取出指定分片中到期的定时器，该分片没有定时器到期时不加锁
+    void listExpiredCallback(size_t shard, std::vector<Timer::TimerFunc>& fns);
+
+    /**
+     * @brief 立即取出所有定时器并清空队列，单次定时器的回调移动到 fns 中提前执行，周期定时器直接取消
+     * @return 被移除的定时器数量
+    */
+    size_t listAllCallback(std::vector<Timer::TimerFunc>& fns);
 
     /**
      * @brief 检查是否有等待执行的定时器
     */
     bool hasTimer();
 
+    /**
+     * @brief 设置之后新增的定时器的松弛时间，类似 prctl(PR_SET_TIMERSLACK)
+     * 到期时间向上取整到松弛时间的整数倍，相近的定时器落在同一时刻，在同一批中取出，
+     * 事件循环只被唤醒一次。定时器只会推迟到期，不会提前
+     * @param slack_us 松弛时间(us)，0 表示准时到期，默认取配置 timer.slack_us
+    */
+    void setTimerSlack(uint64_t slack_us) { m_slack_us.store(slack_us, std::memory_order_relaxed); }
+    uint64_t getTimerSlack() const { return m_slack_us.load(std::memory_order_relaxed); }
+
+    // 定时器存储结构的名称，"set" 或 "wheel"
+    const char* getTimerBackendName() const;
+    // 分片数量
+    size_t getTimerShardCount() const { return m_shards.size(); }
+
+    // thread-safe 获取各类定时器的数量、到期延迟与批次大小的分布，以及执行最慢的回调
+    TimerStats getTimerStats() const;
+    // thread-safe 清空延迟、批次的分布与最慢的回调，定时器数量不受影响
+    void resetTimerStats();
+    /**
+     * @brief 是否记录回调的执行耗时，默认取配置 timer.profile_callbacks
+     * 开启后每个到期的回调都要再包装一层，会多一次堆分配，只建议排查问题时开启
+    */
+    void setCallbackProfiling(bool enable) { m_profile_callbacks.store(enable, std::memory_order_relaxed); }
+    // thread-safe 指定分片中的定时器数量
+    size_t getTimerCount(size_t shard);
+
 protected:
     /**
-     * @brief 当创建了延迟时间最短的定时任务时，会调用此函数
+     * @brief 当创建了分片中延迟时间最短的定时任务时，会调用此函数
+     * @param shard 定时器所在的分片
     */
-    virtual void onTimerInsertedAtFirst() = 0;
+    virtual void onTimerInsertedAtFirst(size_t shard) = 0;
+
+    /**
+     * @brief 当前线程创建的定时器所属的分片，默认全部放在第一个分片中
+    */
+    virtual size_t getCurrentTimerShard() const { return 0; }
 
     /**
      * @brief 添加已有的定时器对象，该函数只是为了代码复用
+     * @param lock 持有定时器所在分片的锁，函数返回前释放
     */
-    void addTimer(Timer::ptr timer, WriteScopedLock& lock);
+    void addTimer(Timer::ptr timer, ScopedLock& lock);
 
 private:
     /**
-     * @brief 检查系统时间是否被修改成更早的时间
+     * @brief 一个分片的定时器，队列与到期时间下界的修改都在 m_mutex 中进行
     */
-    bool detectClockRollover(uint64_t now_ms);
+    struct TimerShard
+    {
+        MutexType m_mutex;
+        std::unique_ptr<TimerQueue> m_queue; // 由 timer.backend 在创建时选择
+        // 超时节点按到期时间组成的最小堆，数组只在容量增长时分配
+        std::vector<TimeoutNode*> m_timeouts;
+        // 按类型统计的定时器数量
+        size_t m_counts[Timer::TYPE_COUNT]{};
+        // 不晚于最早到期时间的下界(us)，~0ull 表示没有定时器。加入定时器时提前，
+        // 取出到期的定时器后更新为准确的值，取消时只在分片变空时更新
+        std::atomic_uint64_t m_deadline_hint{~0ull};
+
+        // 加入定时器，返回它是否早于之前的下界
+        bool insert(const Timer::ptr& timer);
+        // 移除定时器，返回定时器是否在队列中
+        bool erase(Timer* timer);
+        // 加入超时节点，返回它是否早于之前的下界
+        bool pushTimeout(TimeoutNode* node);
+        // 移除超时节点，返回节点是否在堆中
+        bool eraseTimeout(TimeoutNode* node);
+        // 取出堆顶的超时节点
+        TimeoutNode* popTimeout();
+        // 定时器与超时节点中最早的到期时间
+        uint64_t nextDeadline();
+        // 分片中是否没有定时器与超时节点
+        bool empty() const;
+        void siftUp(size_t index);
+        void siftDown(size_t index);
+    };
+
+    // 把新创建的定时器加入当前线程的分片
+    Timer::ptr addNewTimer(Timer* timer);
+    // 开启回调耗时统计时，包装到期的回调以记录执行时间
+    Timer::TimerFunc profile(Timer::TimerFunc fn, const std::type_info& type);
+    // 记录一次回调的执行耗时，只保留最慢的几种回调，每种回调保留其最大耗时
+    void recordCallbackDuration(const std::type_info& type, uint64_t duration_us);
 
 private:
-    RWLockType m_lock;
-    std::set<Timer::ptr, Timer::Comparator> m_timers;
-    uint64_t m_previous_time = 0;
+    // 保留的最慢回调的数量
+    static constexpr size_t SLOW_CALLBACK_COUNT = 8;
+
+    std::vector<std::unique_ptr<TimerShard>> m_shards;
+    std::atomic_uint64_t m_slack_us{0}; // 新增定时器的松弛时间(us)
+    Histogram m_lateness_hist{};
+    Histogram m_batch_hist{};
+    std::atomic_bool m_profile_callbacks{false};
+    mutable MutexType m_slow_mutex;
+    std::vector<SlowTimerCallback> m_slowest; // 从慢到快排列，每种回调最多一项
+    // 最慢的回调已满时其中最快的耗时，更快的回调不必加锁
+    std::atomic_uint64_t m_slow_threshold{0};
 };
 
 } // end namespace zjl
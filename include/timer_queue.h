@@ -0,0 +1,115 @@
+#ifndef SERVER_FRAMEWORK_TIMER_QUEUE_H
+#define SERVER_FRAMEWORK_TIMER_QUEUE_H
+
+#include "noncopyable.h"
+#include "timer.h"
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace zjl
+{
+
+/**
+ * @brief 定时器的存储结构，由 TimerManager 在持有写锁时调用，本身不需要加锁
+*/
+class TimerQueue : public noncopyable
+{
+public:
+    using ptr = std::unique_ptr<TimerQueue>;
+
+    /**
+     * @brief 按名称创建定时器队列
+     * @param backend "set" 为按到期时间排序的集合，"wheel" 为分层时间轮，未知的名称使用 set
+    */
+    static ptr Create(const std::string& backend);
+
+    virtual ~TimerQueue() = default;
+
+    // 后端名称
+    virtual const char* getName() const = 0;
+    // 加入定时器，返回它是否可能成为最早到期的定时器
+    virtual bool insert(const Timer::ptr& timer) = 0;
+    // 移除定时器，返回定时器是否在队列中
+    virtual bool erase(Timer* timer) = 0;
+    // 最早的到期时间(us)，可以早于实际的到期时间但不会晚于它，空队列返回 ~0ull
+    virtual uint64_t nextDeadline() = 0;
+    // 取出到期时间不晚于 now_us 的定时器，追加到 expired 中
+    virtual void popExpired(uint64_t now_us, std::vector<Timer::ptr>& expired) = 0;
+    // 取出全部定时器，追加到 timers 中
+    virtual void popAll(std::vector<Timer::ptr>& timers) = 0;
+    // 定时器数量
+    virtual size_t size() const = 0;
+
+    bool empty() const { return size() == 0; }
+};
+
+/**
+ * @brief 按到期时间排序的集合，加入与移除都是 O(log n)，每个定时器分配一个树节点
+*/
+class SetTimerQueue final : public TimerQueue
+{
+public:
+    const char* getName() const override { return "set"; }
+    bool insert(const Timer::ptr& timer) override;
+    bool erase(Timer* timer) override;
+    uint64_t nextDeadline() override;
+    void popExpired(uint64_t now_us, std::vector<Timer::ptr>& expired) override;
+    void popAll(std::vector<Timer::ptr>& timers) override;
+    size_t size() const override { return m_timers.size(); }
+
+private:
+    std::set<Timer::ptr, Timer::Comparator> m_timers;
+};
+
+/**
+ * @brief 分层时间轮，加入与移除都是 O(1)，不分配内存，到期时按槽位批量取出
+ * 每层 64 个槽位，第 0 层每个槽位 1ms，之后每层的槽位跨度是上一层的 64 倍，6 层覆盖约 2.2 年。
+ * 定时器以侵入式双向链表挂在槽位上；时间推进到高层槽位的起点时，该槽位的定时器重新分配到低层。
+ * 到期判断使用定时器精确到微秒的到期时间，当前毫秒内的定时器只取出已经到期的部分，不会提前执行
+*/
+class TimingWheel final : public TimerQueue
+{
+public:
+    static constexpr uint64_t TICK_US = 1000;    // 第 0 层槽位的跨度(us)
+    static constexpr size_t SLOT_BITS = 6;
+    static constexpr size_t SLOT_COUNT = 1 << SLOT_BITS;
+    static constexpr size_t LEVEL_COUNT = 6;
+    // 一次推进超过这么多个刻度时直接重建，避免逐个刻度地推进
+    static constexpr uint64_t MAX_ADVANCE_TICKS = 1 << 16;
+
+    TimingWheel();
+    ~TimingWheel() override;
+
+    const char* getName() const override { return "wheel"; }
+    bool insert(const Timer::ptr& timer) override;
+    bool erase(Timer* timer) override;
+    uint64_t nextDeadline() override;
+    void popExpired(uint64_t now_us, std::vector<Timer::ptr>& expired) override;
+    void popAll(std::vector<Timer::ptr>& timers) override;
+    size_t size() const override { return m_count; }
+
+private:
+    // 按当前刻度把定时器挂到对应的槽位上，定时器必须已经持有自身的引用
+    void link(Timer* timer);
+    // 把定时器从所在的槽位上摘下，不释放引用
+    void unlink(Timer* timer);
+    // 取出槽位上的全部定时器
+    void takeSlot(size_t slot, std::vector<Timer::ptr>& timers);
+    // 当前刻度到达高层槽位的起点时，把这些槽位的定时器重新分配到低层，返回是否移动了定时器
+    bool cascade();
+    // 计算最早的到期时间
+    uint64_t computeNextDeadline() const;
+
+private:
+    Timer* m_slots[LEVEL_COUNT * SLOT_COUNT]{}; // 每个槽位的链表头，下标为 层 * SLOT_COUNT + 槽位
+    uint64_t m_current = 0;                     // 当前刻度，之前的刻度都已经处理完毕
+    size_t m_count = 0;
+    uint64_t m_cached_deadline = ~0ull;         // 缓存的最早到期时间，只在 m_cache_valid 时有效
+    bool m_cache_valid = false;
+};
+
+} // namespace zjl
+
+#endif // SERVER_FRAMEWORK_TIMER_QUEUE_H
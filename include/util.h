@@ -37,12 +37,12 @@ void Backtrace(std::vector<std::string>& out, int size = 200, int skip = 1);
 std::string BacktraceToString(int size = 200, int skip = 2);
 
 /**
- * @brief 获取ms时间
+ * @brief 获取ms时间，来自 CLOCK_MONOTONIC，只能用于计算时间间隔
 */
 uint64_t GetCurrentMS();
 
 /**
- * @brief 获取us时间
+ * @brief 获取us时间，来自 CLOCK_MONOTONIC，只能用于计算时间间隔
 */
 uint64_t GetCurrentUS();
 
@@ -0,0 +1,97 @@
+#include "clock.h"
+#include "config.h"
+#include "log.h"
+#include <atomic>
+#include <time.h>
+
+namespace zjl
+{
+
+static Logger::ptr system_logger = GET_LOGGER("system");
+
+static ConfigVar<std::string>::ptr g_clock_source =
+    Config::Lookup<std::string>("clock.source", "monotonic",
+                                "定时器与超时使用的时间源，monotonic 或 coarse");
+
+// 每次读取时间都要判断时间源，不直接读取配置项
+static std::atomic_int s_source{Clock::MONOTONIC};
+// 事件循环本轮唤醒时的时间，0 表示没有缓存
+static thread_local uint64_t t_cached_us = 0;
+
+static Clock::Source ParseSource(const std::string& name)
+{
+    if (name == "coarse")
+    {
+        return Clock::COARSE;
+    }
+    if (name != "monotonic")
+    {
+        LOG_FMT_WARN(system_logger, "未知的时间源 %s，使用 monotonic", name.c_str());
+    }
+    return Clock::MONOTONIC;
+}
+
+static inline clockid_t GetClockId(int source)
+{
+    return source == Clock::COARSE ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC;
+}
+
+struct _ClockIniter
+{
+    _ClockIniter()
+    {
+        Clock::SetSource(ParseSource(g_clock_source->getValue()));
+        g_clock_source->addListener([](const std::string& /*old_value*/, const std::string& new_value) {
+            Clock::SetSource(ParseSource(new_value));
+        });
+    }
+};
+static _ClockIniter s_clock_initer;
+
+Clock::Source Clock::GetSource()
+{
+    return static_cast<Source>(s_source.load(std::memory_order_relaxed));
+}
+
+const char* Clock::GetSourceName()
+{
+    return GetSource() == COARSE ? "coarse" : "monotonic";
+}
+
+void Clock::SetSource(Source source)
+{
+    s_source.store(source, std::memory_order_relaxed);
+}
+
+uint64_t Clock::GetResolutionUS()
+{
+    timespec ts{};
+    clock_getres(GetClockId(s_source.load(std::memory_order_relaxed)), &ts);
+    uint64_t us = ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+    return us == 0 ? 1 : us;
+}
+
+uint64_t Clock::NowUS()
+{
+    timespec ts;
+    clock_gettime(GetClockId(s_source.load(std::memory_order_relaxed)), &ts);
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+uint64_t Clock::CachedUS()
+{
+    return t_cached_us != 0 ? t_cached_us : NowUS();
+}
+
+uint64_t Clock::UpdateCachedUS()
+{
+    t_cached_us = NowUS();
+    return t_cached_us;
+}
+
+void Clock::ClearCachedUS()
+{
+    t_cached_us = 0;
+}
+
+} // namespace zjl
@@ -6,7 +6,7 @@
 namespace zjl
 {
 
-FileDescriptor::FileDescriptor(int fd)
+FileDescriptor::FileDescriptor(int fd, bool passthrough)
     : m_is_init(false),
       m_is_socket(false),
       m_system_non_block(false),
@@ -17,6 +17,12 @@ FileDescriptor::FileDescriptor(int fd)
       m_send_timeout(-1),
       m_iom(nullptr)
 {
+    if (passthrough)
+    {
+        m_is_init = true;
+        m_is_passthrough = true;
+        return;
+    }
     init();
 }
 
@@ -43,27 +49,32 @@ bool  FileDescriptor::init()
     {
         m_is_init = true;
         m_is_socket = S_ISSOCK(fd_stat.st_mode);
+        m_is_regular = S_ISREG(fd_stat.st_mode);
     }
 
-    if (m_is_socket)
-    {
-        int flags = fcntl_f(m_fd, F_GETFL, 0);
-        // 强制 socket 文件描述符为非阻塞模式
-        if (!(flags & O_NONBLOCK))
-        {
-             fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);
-        }
-        m_system_non_block = true;
-    }
-    else
+    m_system_non_block = false;
+    m_is_pollable = false;
+    if (m_is_init && (m_is_socket || S_ISFIFO(fd_stat.st_mode)))
     {
-        m_system_non_block = false;
+        setPollable();
     }
     m_user_non_block = false;
     m_is_closed = false;
     return m_is_init;
 }
 
+void FileDescriptor::setPollable()
+{
+    int flags = fcntl_f(m_fd, F_GETFL, 0);
+    // 强制为非阻塞模式，数据未就绪时由 hook 挂起协程
+    if (!(flags & O_NONBLOCK))
+    {
+        fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);
+    }
+    m_is_pollable = true;
+    m_system_non_block = true;
+}
+
 bool FileDescriptor::close()
 {
     return false;
@@ -81,6 +92,37 @@ void FileDescriptor::setTimeout(int type, uint64_t v)
     }
 }
 
+void FileDescriptor::lockFileIO()
+{
+    {
+        ScopedLock lock(&m_file_io_mutex);
+        if (!m_file_io_busy)
+        {
+            m_file_io_busy = true;
+            return;
+        }
+        m_file_io_waiters.emplace_back(Scheduler::GetThis(), Fiber::GetThis());
+    }
+    // 被唤醒时执行权已经转交给本协程
+    Fiber::YieldToHold();
+}
+
+void FileDescriptor::unlockFileIO()
+{
+    std::pair<Scheduler*, Fiber::ptr> next;
+    {
+        ScopedLock lock(&m_file_io_mutex);
+        if (m_file_io_waiters.empty())
+        {
+            m_file_io_busy = false;
+            return;
+        }
+        next = std::move(m_file_io_waiters.front());
+        m_file_io_waiters.pop_front();
+    }
+    next.first->schedule(std::move(next.second));
+}
+
 uint64_t FileDescriptor::getTimeout(int type)
 {
     if (type == SO_RCVTIMEO)
@@ -98,8 +140,12 @@ FileDescriptorManagerImpl::FileDescriptorManagerImpl()
     m_data.resize(64);
 }
 
-FileDescriptor::ptr FileDescriptorManagerImpl::get(int fd, bool auto_create)
+FileDescriptor::ptr FileDescriptorManagerImpl::get(int fd, bool auto_create, bool passthrough)
 {
+    if (fd < 0)
+    {
+        return nullptr;
+    }
     ReadScopedLock lock(&m_lock);
     if (m_data.size() <= static_cast<size_t>(fd))
     {
@@ -117,10 +163,17 @@ FileDescriptor::ptr FileDescriptorManagerImpl::get(int fd, bool auto_create)
     }
     lock.unlock();
 
-    assert(m_data.size() > static_cast<size_t>(fd) && "vector FileDescriptorManagerImpl::m_data 越界访问");
-
     WriteScopedLock lock2(&m_lock);
-    FileDescriptor::ptr fdp(new FileDescriptor(fd));
+    if (m_data.size() <= static_cast<size_t>(fd))
+    {
+        m_data.resize(fd * 3 / 2 + 1);
+    }
+    // 其他线程已经创建
+    if (m_data[fd])
+    {
+        return m_data[fd];
+    }
+    FileDescriptor::ptr fdp(new FileDescriptor(fd, passthrough));
     m_data[fd] = fdp;
     return fdp;
 }
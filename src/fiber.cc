@@ -4,7 +4,9 @@
 #include "scheduler.h"
 #include <cassert>
 #include <cerrno>
+#include <csignal>
 #include <cstring>
+#include <mutex>
 #include <utility>
 
 namespace zjl
@@ -12,6 +14,23 @@ namespace zjl
 
 static Logger::ptr g_logger = GET_LOGGER("system");
 
+// 时间片信号相对 SIGRTMIN 的偏移。使用实时信号，不占用 SIGURG 这类有固定含义的信号，
+// 例如带外数据到达时通过 F_SETOWN 发送的 SIGURG；应用自己使用了该实时信号时修改这个配置项
+static ConfigVar<int>::ptr g_preempt_signal_offset =
+    Config::Lookup<int>("fiber.preempt_signal_offset", 0, "时间片抢占使用的实时信号相对 SIGRTMIN 的偏移");
+// 当前协程是否已经耗尽时间片，等待在检查点让出
+static thread_local volatile sig_atomic_t t_preempt_requested = 0;
+// 协程切换次数，信号处理函数据此判断两次信号之间是否发生过切换
+static thread_local volatile sig_atomic_t t_switch_count = 0;
+// 上一次时间片信号到达时的协程切换次数
+static thread_local sig_atomic_t t_switch_seen = 0;
+// 当前线程是否允许强制抢占
+static thread_local bool t_forced_preempt = false;
+// 当前线程所处的 PreemptibleScope 嵌套层数
+static thread_local volatile sig_atomic_t t_preemptible_depth = 0;
+// 所有协程都要屏蔽的信号，第 n 位对应 n + 1 号信号
+static std::atomic_uint64_t s_blocked_signals{0};
+
 /**
  * @brief 对 malloc/free 简单封装的内存分配器
 */
@@ -23,7 +42,7 @@ public:
         return ::malloc(size);
     }
 
-    static void Dealloc(void* ptr, uint64_t size)
+    static void Dealloc(void* ptr, uint64_t /*size*/)
     {
         free(ptr);
     }
@@ -150,11 +169,15 @@ void Fiber::swapIn()
     //           Scheduler::GetThis()->m_root_thread_id != GetThreadID());
     // 只有协程是等待执行的状态才能被换入
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
+    // 新的协程开始执行，重新计算时间片
+    t_switch_count = t_switch_count + 1;
+    t_preempt_requested = 0;
     SetThis(this);
     m_state = EXEC;
     // 挂起 master fiber，切换到当前 fiber
     // if (swapcontext(&(FiberInfo::t_master_fiber->m_ctx), &m_ctx))
     assert(Scheduler::GetMainFiber() && "请勿手动调用该函数");
+    syncSignalMask();
     if (swapcontext(&(Scheduler::GetMainFiber()->m_ctx), &m_ctx))
     {
         throw Exception(std::string(::strerror(errno)));
@@ -170,6 +193,7 @@ void Fiber::swapOut()
     // 挂起当前 fiber，切换到 master fiber
     // if (swapcontext(&m_ctx, &(FiberInfo::t_master_fiber->m_ctx)))
     assert(Scheduler::GetMainFiber() && "请勿手动调用该函数");
+    Scheduler::GetMainFiber()->syncSignalMask();
     if (swapcontext(&m_ctx, &(Scheduler::GetMainFiber()->m_ctx)))
     {
         throw Exception(std::string(::strerror(errno)));
@@ -182,6 +206,7 @@ void Fiber::call()
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
     SetThis(this);
     m_state = EXEC;
+    syncSignalMask();
     if (swapcontext(&(FiberInfo::t_master_fiber->m_ctx), &m_ctx))
     {
         throw Exception(std::string(::strerror(errno)));
@@ -193,6 +218,7 @@ void Fiber::back()
     assert(FiberInfo::t_master_fiber && "当前线程不存在主协程");
     assert(m_stack);
     SetThis(FiberInfo::t_master_fiber.get());
+    FiberInfo::t_master_fiber->syncSignalMask();
     if (swapcontext(&m_ctx, &(FiberInfo::t_master_fiber->m_ctx)))
     {
         throw Exception(std::string(::strerror(errno)));
@@ -204,6 +230,7 @@ void Fiber::swapIn(Fiber::ptr fiber)
     assert(m_state == INIT || m_state == READY || m_state == HOLD);
     SetThis(this);
     m_state = EXEC;
+    syncSignalMask();
     if (swapcontext(&(fiber->m_ctx), &m_ctx))
     {
         throw Exception(std::string(::strerror(errno)));
@@ -214,12 +241,46 @@ void Fiber::swapOut(Fiber::ptr fiber)
 {
     assert(m_state);
     SetThis(fiber.get());
+    fiber->syncSignalMask();
     if (swapcontext(&m_ctx, &(fiber->m_ctx)))
     {
         throw Exception(std::string(::strerror(errno)));
     }
 }
 
+void Fiber::BlockSignals(const sigset_t& mask)
+{
+    uint64_t bits = 0;
+    for (int signo = 1; signo <= 64; signo++)
+    {
+        if (sigismember(&mask, signo) == 1)
+        {
+            bits |= 1ull << (signo - 1);
+        }
+    }
+    s_blocked_signals.fetch_or(bits);
+    // 正在执行的上下文直接修改线程的屏蔽字，换出时随上下文一起保存
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+}
+
+void Fiber::syncSignalMask()
+{
+    uint64_t blocked = s_blocked_signals.load(std::memory_order_acquire);
+    uint64_t missing = blocked & ~m_blocked_signals;
+    if (!missing)
+    {
+        return;
+    }
+    for (int signo = 1; signo <= 64; signo++)
+    {
+        if (missing & (1ull << (signo - 1)))
+        {
+            sigaddset(&m_ctx.uc_sigmask, signo);
+        }
+    }
+    m_blocked_signals = blocked;
+}
+
 bool Fiber::finish() const noexcept
 {
     return (m_state == TERM || m_state == EXCEPTION);
@@ -245,6 +306,7 @@ void Fiber::SetThis(Fiber* fiber)
 
 void Fiber::Yield()
 {
+    assert(!Scheduler::IsRunningInlineTask() && "内联任务中不允许挂起协程");
     /* FIXME: 可能会造成  shared_ptr 的引用计数只增不减 */
     Fiber::ptr current_fiber = GetThis();
     current_fiber->m_state = HOLD;
@@ -262,6 +324,7 @@ void Fiber::Yield()
 
 void Fiber::YieldToHold()
 {
+    assert(!Scheduler::IsRunningInlineTask() && "内联任务中不允许挂起协程");
     /* FIXME: 可能会造成 shared_ptr 的引用计数只增不减 */
     auto current_fiber = GetThis();
     current_fiber->m_state = HOLD;
@@ -290,6 +353,95 @@ uint64_t Fiber::GetFiberID()
     return 0;
 }
 
+void Fiber::CheckPreempt()
+{
+    if (!t_preempt_requested)
+    {
+        return;
+    }
+    t_preempt_requested = 0;
+    Fiber* current = FiberInfo::t_fiber;
+    Scheduler* scheduler = Scheduler::GetThis();
+    // 只抢占调度器中的任务协程，调度协程本身以及在其上运行的内联任务不可被抢占
+    if (!scheduler || !current || !current->m_stack ||
+        current == Scheduler::GetMainFiber() || current->m_state != EXEC)
+    {
+        return;
+    }
+    ++scheduler->m_preempt_count;
+    current->m_state = READY;
+    current->swapOut();
+}
+
+void Fiber::EnablePreempt(bool forced)
+{
+    static std::once_flag s_install_flag;
+    std::call_once(s_install_flag, []() {
+        struct sigaction action{};
+        action.sa_handler = &Fiber::OnPreemptSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(GetPreemptSignal(), &action, nullptr) == -1)
+        {
+            THROW_EXCEPTION_WHIT_ERRNO;
+        }
+    });
+    t_forced_preempt = forced;
+}
+
+int Fiber::GetPreemptSignal()
+{
+    // 第一次使用时确定，之后修改配置项不再生效，已经安装的信号处理函数与定时器都使用这个信号
+    static const int s_signal = []() {
+        int signo = SIGRTMIN + g_preempt_signal_offset->getValue();
+        if (signo < SIGRTMIN || signo > SIGRTMAX)
+        {
+            LOG_FMT_ERROR(g_logger, "fiber.preempt_signal_offset 超出实时信号的范围，使用 SIGRTMIN = %d", SIGRTMIN);
+            signo = SIGRTMIN;
+        }
+        return signo;
+    }();
+    return s_signal;
+}
+
+void Fiber::OnPreemptSignal(int)
+{
+    int saved_errno = errno;
+    // 两次时间片信号之间没有发生过协程切换，说明当前协程已经连续运行超过一个时间片
+    if (t_switch_count == t_switch_seen)
+    {
+        t_preempt_requested = 1;
+        Fiber* current = FiberInfo::t_fiber;
+        Scheduler* scheduler = Scheduler::GetThis();
+        if (t_forced_preempt && t_preemptible_depth > 0 &&
+            scheduler && current && current->m_stack &&
+            current != Scheduler::GetMainFiber() && current->m_state == EXEC)
+        {
+            // 在信号处理函数中直接换出协程，恢复执行时从这里返回到被打断的位置
+            t_preempt_requested = 0;
+            ++scheduler->m_preempt_count;
+            current->m_forced_preempted = true;
+            current->m_preemptible_depth = t_preemptible_depth;
+            t_preemptible_depth = 0;
+            current->m_state = READY;
+            current->swapOut();
+            t_preemptible_depth = current->m_preemptible_depth;
+        }
+    }
+    t_switch_seen = t_switch_count;
+    errno = saved_errno;
+}
+
+Fiber::PreemptibleScope::PreemptibleScope()
+{
+    t_preemptible_depth = t_preemptible_depth + 1;
+}
+
+Fiber::PreemptibleScope::~PreemptibleScope()
+{
+    t_preemptible_depth = t_preemptible_depth - 1;
+}
+
 void Fiber::MainFunc()
 {
     auto current_fiber = GetThis();
@@ -0,0 +1,97 @@
+#include "histogram.h"
+#include <cmath>
+#include <cstdio>
+
+namespace zjl
+{
+
+uint64_t HistogramSnapshot::percentile(double percent) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    // 第 rank 个样本所在的桶
+    auto rank = static_cast<uint64_t>(std::ceil(percent / 100 * static_cast<double>(count)));
+    rank = rank == 0 ? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t bound = Histogram::BucketUpperBound(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+std::string HistogramSnapshot::toString() const
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "count=%lu mean=%.1f p50=%lu p90=%lu p99=%lu p999=%lu max=%lu",
+             count, mean(), percentile(50), percentile(90), percentile(99), percentile(99.9), max);
+    return buffer;
+}
+
+size_t Histogram::BucketIndex(uint64_t value)
+{
+    if (value < SUB_BUCKET_COUNT)
+    {
+        return static_cast<size_t>(value);
+    }
+    // [2^n, 2^(n+1)) 区间均分为 SUB_BUCKET_COUNT 个桶，每个桶的宽度为 2^shift
+    size_t msb = 63 - static_cast<size_t>(__builtin_clzll(value));
+    size_t shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) & (SUB_BUCKET_COUNT - 1));
+}
+
+uint64_t Histogram::BucketUpperBound(size_t index)
+{
+    if (index < SUB_BUCKET_COUNT)
+    {
+        return index;
+    }
+    size_t shift = index / SUB_BUCKET_COUNT - 1;
+    uint64_t lower = static_cast<uint64_t>(SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+    return lower + ((1ull << shift) - 1);
+}
+
+void Histogram::record(uint64_t value)
+{
+    m_buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Histogram::reset()
+{
+    for (auto& bucket : m_buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+HistogramSnapshot Histogram::snapshot() const
+{
+    HistogramSnapshot result;
+    result.buckets.resize(BUCKET_COUNT);
+    // 样本数量以桶的计数为准，与并发的 record 保持自洽
+    for (size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        result.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        result.count += result.buckets[i];
+    }
+    result.sum = m_sum.load(std::memory_order_relaxed);
+    result.max = m_max.load(std::memory_order_relaxed);
+    return result;
+}
+
+} // namespace zjl
@@ -1,5 +1,7 @@
 #include <dlfcn.h>
+#include <sys/stat.h>
 #include "hook.h"
+#include "clock.h"
 #include "io_manager.h"
 #include "log.h"
 #include "fd_manager.h"
@@ -15,6 +17,10 @@ static Logger::ptr system_logger = GET_LOGGER("system");
 static zjl::ConfigVar<int>::ptr g_tcp_connect_timeout = 
     zjl::Config::Lookup("tcp.connect.timeout", 5000);
 
+// 普通文件的读写是否交给 io_uring 或文件 IO 线程池异步执行
+static zjl::ConfigVar<bool>::ptr g_async_file_io =
+    zjl::Config::Lookup("hook.async_file_io", true, "普通文件的 IO 是否异步执行，不阻塞工作线程");
+
 #define DEAL_FUNC(DO) \
     DO(sleep) \
     DO(usleep) \
@@ -22,6 +28,8 @@ static zjl::ConfigVar<int>::ptr g_tcp_connect_timeout =
     DO(socket) \
     DO(connect) \
     DO(accept) \
+    DO(accept4) \
+    DO(socketpair) \
     DO(recv) \
     DO(recvfrom) \
     DO(recvmsg) \
@@ -32,10 +40,30 @@ static zjl::ConfigVar<int>::ptr g_tcp_connect_timeout =
     DO(setsockopt) \
     DO(read) \
     DO(write) \
+    DO(pread) \
+    DO(pwrite) \
+    DO(fsync) \
+    DO(fdatasync) \
     DO(close) \
+    DO(pipe) \
+    DO(pipe2) \
+    DO(dup) \
+    DO(dup2) \
+    DO(dup3) \
     DO(readv) \
     DO(writev) \
+    DO(preadv) \
+    DO(pwritev) \
+    DO(sendfile) \
+    DO(eventfd) \
     DO(fcntl) \
+    DO(splice) \
+    DO(poll) \
+    DO(ppoll) \
+    DO(select) \
+    DO(epoll_create) \
+    DO(epoll_create1) \
+    DO(epoll_wait) \
     DO(ioctl)
 
 void hook_init()
@@ -77,23 +105,334 @@ void setHookEnable(bool flag)
 
 } // namespace zjl
 
-struct TimerInfo
+/**
+ * @brief 获取 fd 的登记信息，register_file 为 true 时登记没有经过 hook 打开的 fd
+ * 普通文件按文件登记；终端、他人创建的管道等其他 fd 登记为直通，之后的读写直接调用系统函数，不再重复 fstat。
+ * hook 创建 fd 时会先丢弃同一个数字上残留的登记，残留的直通登记不影响之后的 socket、管道
+*/
+static zjl::FileDescriptor::ptr GetFileDescriptor(int fd, bool register_file)
 {
-    int cancelled = 0;
-};
+    auto fdm = zjl::FileDescriptorManager::GetInstance();
+    zjl::FileDescriptor::ptr fdp = fdm->get(fd);
+    struct stat fd_stat;
+    if (!fdp && register_file && fstat(fd, &fd_stat) == 0)
+    {
+        fdp = fdm->get(fd, true, !S_ISREG(fd_stat.st_mode));
+    }
+    return fdp;
+}
+
+/**
+ * @brief 登记经过 hook 创建的 fd，同一个数字上可能残留没有经过 hook 关闭的 fd 的记录，先丢弃
+ * @param user_nonblock 创建时用户是否要求非阻塞（SOCK_NONBLOCK、O_NONBLOCK、EFD_NONBLOCK）
+ * @param pollable fstat 无法识别为可等待的 fd（如 eventfd）由调用者指定
+*/
+static zjl::FileDescriptor::ptr RegisterFileDescriptor(int fd, bool user_nonblock, bool pollable = false)
+{
+    auto fdm = zjl::FileDescriptorManager::GetInstance();
+    fdm->remove(fd);
+    zjl::FileDescriptor::ptr fdp = fdm->get(fd, true);
+    if (pollable && !fdp->isPollable())
+    {
+        fdp->setPollable();
+    }
+    fdp->setUserNonBlock(user_nonblock);
+    return fdp;
+}
+
+/**
+ * @brief 登记 socket()、accept() 得到的 socket，分配负责它的工作线程，并按配置设置 socket 选项
+*/
+static void RegisterSocket(int fd, bool user_nonblock)
+{
+    RegisterFileDescriptor(fd, user_nonblock);
+    if (auto iom = zjl::IOManager::GetThis())
+    {
+        iom->assignOwner(fd);
+        iom->setupSocket(fd);
+    }
+}
+
+/**
+ * @brief 登记 dup 得到的 newfd，它与 oldfd 共享同一个打开的文件，沿用 oldfd 的非阻塞设置与超时
+ * oldfd 没有登记或者是直通的登记时 newfd 也不登记
+*/
+static void RegisterDupFileDescriptor(int oldfd, int newfd)
+{
+    auto fdm = zjl::FileDescriptorManager::GetInstance();
+    zjl::FileDescriptor::ptr old_fdp = fdm->get(oldfd);
+    if (!old_fdp || old_fdp->isPassthrough())
+    {
+        fdm->remove(newfd);
+        return;
+    }
+    zjl::FileDescriptor::ptr fdp = RegisterFileDescriptor(newfd, old_fdp->getUserNonBlock(),
+                                                          old_fdp->isPollable());
+    fdp->setTimeout(SO_RCVTIMEO, old_fdp->getTimeout(SO_RCVTIMEO));
+    fdp->setTimeout(SO_SNDTIMEO, old_fdp->getTimeout(SO_SNDTIMEO));
+}
+
+/**
+ * @brief 注销 fd 的登记，并唤醒等待在 fd 上的协程，用于 close 以及 dup2 覆盖已有的 fd
+*/
+static void UnregisterFileDescriptor(int fd)
+{
+    zjl::FileDescriptor::ptr fdp = zjl::FileDescriptorManager::GetInstance()->get(fd);
+    if (!fdp)
+    {
+        return;
+    }
+    auto iom = zjl::IOManager::GetThis();
+    // 直通的 fd 没有经过 hook 等待，不需要取消
+    if (iom && !fdp->isPassthrough())
+    {
+        // 在负责 fd 的线程上同步取消，避免关闭后 fd 被复用时误取消新的监听
+        iom->moveToOwner(fd);
+        iom->cancelAll(fd);
+    }
+    zjl::FileDescriptorManager::GetInstance()->remove(fd);
+}
+
+/**
+ * @brief 以协程的方式执行普通文件的 IO
+ * 磁盘 IO 没有就绪事件可以等待，交给 io_uring 或文件 IO 线程池执行，期间挂起当前协程；
+ * 同一个文件上的操作按调用顺序逐个执行
+ * @return 是否已经异步执行，false 时调用者应直接执行系统调用
+*/
+static bool doFileIO(const zjl::FileDescriptor::ptr& fdp, zjl::IORequest& request, ssize_t& result)
+{
+    if (!fdp->isRegularFile() || fdp->getUserNonBlock() || !zjl::g_async_file_io->getValue())
+    {
+        return false;
+    }
+    auto iom = zjl::IOManager::GetThis();
+    if (!iom || !iom->canSuspend())
+    {
+        return false;
+    }
+    fdp->lockFileIO();
+    result = iom->submitFileIO(request);
+    int err = errno;
+    fdp->unlockFileIO();
+    errno = err;
+    return true;
+}
+
+/**
+ * @brief 监听 fd 的就绪事件并挂起当前协程，直到事件触发、超时或监听被取消
+ * 超时节点在本栈帧上，挂起时设置、唤醒后取消，不分配内存
+ * @return 事件触发或监听被取消时返回 0，超时或无法监听时返回 -1 并设置 errno
+*/
+static int WaitForEvent(zjl::IOManager* iom, int fd, uint32_t event, uint64_t timeout,
+                        const char* hook_func_name)
+{
+    uint64_t waiter_id = 0;
+    int rt = iom->addEventListener(fd, static_cast<zjl::FDEventType>(event), nullptr, &waiter_id);
+    if (rt == -1)
+    {
+        // 保留 addEventListener 设置的错误码，例如调度器排空超时时的 ECANCELED
+        int err = errno;
+        LOG_FMT_ERROR(zjl::system_logger, "%s addEventListener(%d, %u)", hook_func_name, fd, event);
+        errno = err;
+        return -1;
+    }
+    // 如果设置了超时时间，在指定时间后只唤醒本协程的等待者，同一事件的其他等待者不受影响。
+    // 监听加入之后才设置超时，超时总能唤醒本协程
+    zjl::TimeoutNode timeout_node;
+    bool has_timeout = timeout != static_cast<uint64_t>(-1);
+    if (has_timeout)
+    {
+        iom->armTimeout(timeout_node, std::chrono::milliseconds(timeout), [fd, iom, event, waiter_id]() {
+            iom->cancelEventListener(fd, static_cast<zjl::FDEventType>(event), waiter_id);
+        });
+    }
+    zjl::Fiber::YieldToHold();
+
+    // 超时节点已经到期，说明等待超时
+    if (has_timeout && !timeout_node.cancel())
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief poll 的事件转换为 FDEventType 的组合
+ * 只关心挂断与错误时等待 RDHUP：epoll 总是随等待的事件报告挂断与错误，挂断与错误会唤醒全部等待者；
+ * 等待可读的话，socket 上有未读的数据时会立即唤醒，而 poll 不报告任何事件
+*/
+static uint32_t ToEventTypes(short events)
+{
+    uint32_t types = zjl::FDEventType::NONE;
+    if (events & (POLLIN | POLLRDNORM | POLLRDBAND))
+    {
+        types |= zjl::FDEventType::READ;
+    }
+    if (events & POLLPRI)
+    {
+        types |= zjl::FDEventType::PRI;
+    }
+    if (events & (POLLOUT | POLLWRNORM | POLLWRBAND))
+    {
+        types |= zjl::FDEventType::WRITE;
+    }
+    if (events & POLLRDHUP)
+    {
+        types |= zjl::FDEventType::RDHUP;
+    }
+    return types == zjl::FDEventType::NONE ? static_cast<uint32_t>(zjl::FDEventType::RDHUP) : types;
+}
+
+/**
+ * @brief fd 是否是对端只关闭了写端的 socket
+ * 这时 RDHUP 一直就绪而 poll 不报告，普通注册下每次等待都会重新激活边缘触发并立即唤醒
+*/
+static bool IsHalfClosed(int fd)
+{
+    struct pollfd probe{fd, POLLRDHUP, 0};
+    return poll_f(&probe, 1, 0) == 1 && (probe.revents & POLLRDHUP);
+}
+
+/**
+ * @brief 以协程的方式执行 poll，timeout_ms 小于 0 时不超时
+ * 先不阻塞地检查一次，没有就绪的 fd 时向 IOManager 登记全部的事件并挂起，唤醒后再检查一次，结果与 poll 的格式相同。
+ * 只有一个 fd、一种事件时（多数客户端库的用法）直接以协程等待该事件，不分配内存。
+ * 包含没有经过 hook 登记为可等待的 fd 时（普通文件、外部创建的 fd），IOManager 无法可靠地监听，直接调用系统函数
+*/
+static int doPoll(struct pollfd* fds, nfds_t nfds, int timeout_ms)
+{
+    zjl::Fiber::CheckPreempt();
+    int n = poll_f(fds, nfds, 0);
+    if (n != 0 || timeout_ms == 0)
+    {
+        return n;
+    }
+    auto iom = zjl::IOManager::GetThis();
+    if (!iom || !iom->canSuspend())
+    {
+        return poll_f(fds, nfds, timeout_ms);
+    }
+    auto fdm = zjl::FileDescriptorManager::GetInstance();
+    std::vector<std::pair<int, uint32_t>> interests;
+    int single_fd = -1;
+    uint32_t single_type = zjl::FDEventType::NONE;
+    bool hup_only = false; // 是否有只关心挂断与错误（events 为 0）的 fd
+    for (nfds_t i = 0; i < nfds; i++)
+    {
+        // 负数的 fd 被 poll 忽略
+        if (fds[i].fd < 0)
+        {
+            continue;
+        }
+        zjl::FileDescriptor::ptr fdp = fdm->get(fds[i].fd);
+        if (!fdp || fdp->isClosed() || !fdp->isPollable())
+        {
+            return poll_f(fds, nfds, timeout_ms);
+        }
+        hup_only = hup_only || fds[i].events == 0;
+        uint32_t types = ToEventTypes(fds[i].events);
+        if (single_fd == -1 && interests.empty())
+        {
+            single_fd = fds[i].fd;
+            single_type = types;
+            continue;
+        }
+        if (interests.empty())
+        {
+            interests.emplace_back(single_fd, single_type);
+        }
+        interests.emplace_back(fds[i].fd, types);
+    }
+    // 没有需要等待的 fd 时 poll 只是睡眠
+    if (single_fd == -1)
+    {
+        return poll_f(fds, nfds, timeout_ms);
+    }
+    // 单个事件可以直接以协程等待
+    bool single = interests.empty() && (single_type & (single_type - 1)) == 0;
+    if (interests.empty() && !single)
+    {
+        interests.emplace_back(single_fd, single_type);
+    }
+    uint64_t deadline = timeout_ms < 0 ? ~0ull : zjl::Clock::NowMS() + timeout_ms;
+    while (true)
+    {
+        uint64_t wait_ms = ~0ull;
+        if (deadline != ~0ull)
+        {
+            uint64_t now = zjl::Clock::NowMS();
+            if (now >= deadline)
+            {
+                return 0;
+            }
+            wait_ms = deadline - now;
+        }
+        int rt = 0;
+        if (single)
+        {
+            // 迁移失败时不能安全地监听，退回到阻塞的系统调用
+            if (!iom->moveToOwner(single_fd))
+            {
+                return poll_f(fds, nfds, deadline == ~0ull ? -1 : static_cast<int>(wait_ms));
+            }
+            rt = WaitForEvent(iom, single_fd, single_type, wait_ms, "poll");
+        }
+        else
+        {
+            rt = iom->waitEvents(interests, wait_ms);
+        }
+        if (rt == -1 && errno != ETIMEDOUT)
+        {
+            return -1;
+        }
+        // 唤醒后重新检查，就绪的事件可能已经被其他协程消费
+        n = poll_f(fds, nfds, 0);
+        if (n != 0 || rt == -1)
+        {
+            return n;
+        }
+        // 半关闭的 socket 会让 RDHUP 的等待反复立即唤醒，改为等待 PRI，挂断与错误照样唤醒全部等待者。
+        // 显式关心 POLLRDHUP 的 fd 半关闭时 poll 会报告，走不到这里
+        if (hup_only && !iom->isPersistentRegistration())
+        {
+            for (auto& interest : interests)
+            {
+                if (interest.second == zjl::FDEventType::RDHUP && IsHalfClosed(interest.first))
+                {
+                    interest.second = zjl::FDEventType::PRI;
+                }
+            }
+            if (single && single_type == zjl::FDEventType::RDHUP && IsHalfClosed(single_fd))
+            {
+                single_type = zjl::FDEventType::PRI;
+            }
+        }
+    }
+}
 
+/**
+ * @brief 以协程的方式执行 IO 操作
+ * 先直接调用系统函数，数据未就绪（EAGAIN）时挂起当前协程：
+ * IOManager 支持完成式 IO 且 request 不为空时，把 request 描述的同一个操作提交给内核，完成后直接得到结果；
+ * 否则监听 fd 的就绪事件，事件触发后重新调用系统函数
+ * @param request 与 func 等价的完成式 IO 请求，为 nullptr 时只使用就绪式等待
+*/
 template<typename OriginFunc, typename ...Args>
 static ssize_t doIO(int fd, OriginFunc func, const char* hook_func_name, 
-                    uint32_t event, int fd_timeout_type, Args&& ...args)
+                    uint32_t event, int fd_timeout_type, zjl::IORequest* request, Args&& ...args)
 {
     if (!zjl::t_hook_enabled)
     {
         return func(fd, std::forward<Args>(args)...);
     }
+    // 被 hook 的系统函数是抢占检查点
+    zjl::Fiber::CheckPreempt();
 
     // LOG_FMT_DEBUG(zjl::system_logger, "doIO 代理执行系统函数 %s", hook_func_name);
 
-    zjl::FileDescriptor::ptr fdp = zjl::FileDescriptorManager::GetInstance()->get(fd);
+    // 普通文件不经过 hook 的函数打开，第一次读写时登记
+    zjl::FileDescriptor::ptr fdp = GetFileDescriptor(fd, request != nullptr);
     if (!fdp)
     {
         return func(fd, std::forward<Args>(args)...);
@@ -103,13 +442,23 @@ static ssize_t doIO(int fd, OriginFunc func, const char* hook_func_name,
         errno = EBADF;
         return -1;
     }
-    if (!fdp->isSocket() || fdp->getUserNonBlock())
+    if (!fdp->isPollable() || fdp->getUserNonBlock())
+    {
+        ssize_t result = 0;
+        if (request && doFileIO(fdp, *request, result))
+        {
+            return result;
+        }
+        return func(fd, std::forward<Args>(args)...);
+    }
+    auto iom = zjl::IOManager::GetThis();
+    // 每个工作线程独占事件循环时，先迁移到负责 fd 的线程，无法迁移时直接调用系统函数
+    if (!iom || !iom->moveToOwner(fd))
     {
         return func(fd, std::forward<Args>(args)...);
     }
 
     uint64_t timeout = fdp->getTimeout(fd_timeout_type);
-    auto timer_info = std::make_shared<TimerInfo>();
 RETRY:
     ssize_t n = func(fd, std::forward<Args>(args)...);
     // 出现错误 EINTR，是因为系统 API 在阻塞等待状态下被其他的系统信号中断执行
@@ -123,47 +472,26 @@ RETRY:
     {
         LOG_FMT_DEBUG(zjl::system_logger, "doIO(%s): 开始异步等待", hook_func_name);
 
-        auto iom = zjl::IOManager::GetThis();
-        zjl::Timer::ptr timer;
-        std::weak_ptr<TimerInfo> timer_info_wp(timer_info);
-        // 如果设置了超时时间，在指定时间后取消掉该 fd 的事件监听
-        if (timeout != static_cast<uint64_t>(-1))
-        {
-            timer = iom->addConditionTimer(
-                timeout, 
-                [timer_info_wp, fd, iom, event](){
-                    auto t = timer_info_wp.lock();
-                    if (!t || t->cancelled)
-                    {
-                        return;
-                    }
-                    t->cancelled = ETIMEDOUT;
-                    iom->cancelEventListener(fd, static_cast<zjl::FDEventType>(event));
-                }, 
-                timer_info_wp);
-        }
-        int c = 0;
-        uint64_t now = 0;
-
-        int rt = iom->addEventListener(fd, static_cast<zjl::FDEventType>(event));
-        if (rt == -1)
-        {
-            LOG_FMT_ERROR(zjl::system_logger, "%s addEventListener(%d, %u)", hook_func_name, fd, event);
-            if (timer)
+        if (request && iom->isCompletionBased())
+        {
+            if (fdp->isSocket())
             {
-                timer->cancel();
+                request->useSocketOpcode();
+            }
+            request->m_timeout_ms = timeout;
+            ssize_t rt = iom->submitAndWait(*request);
+            if (rt == -1 && errno == EINTR)
+            {
+                goto RETRY;
+            }
+            // 请求无法提交或内核要求重试时，退回到就绪式等待
+            if (rt != -1 || errno != EAGAIN)
+            {
+                return rt;
             }
-            return -1;
-        }
-        zjl::Fiber::YieldToHold();
-
-        if (timer)
-        {
-            timer->cancel();
         }
-        if (timer_info->cancelled)
+        if (WaitForEvent(iom, fd, event, timeout, hook_func_name) == -1)
         {
-            errno = timer_info->cancelled;
             return -1;
         }
         goto RETRY;
@@ -171,6 +499,21 @@ RETRY:
     return n;
 }
 
+/**
+ * @brief 挂起当前协程 delay 时长，由 IOManager 的定时器重新调度
+ * 定时器精确到微秒，不足 1ms 的睡眠也会真正挂起，而不是立即重新调度
+*/
+static void SleepFor(std::chrono::microseconds delay)
+{
+    zjl::Fiber::ptr fiber = zjl::Fiber::GetThis();
+    auto iom = zjl::IOManager::GetThis();
+    assert(iom != nullptr && "这里的 IOManager 指针不可为空");
+    iom->addTimer(delay, [iom, fiber](){
+        iom->schedule(fiber);
+    });
+    zjl::Fiber::YieldToHold();
+}
+
 extern "C" 
 {
 #define DEF_FUNC_NAME(name) name##_func name##_f = nullptr;
@@ -187,13 +530,7 @@ unsigned int sleep(unsigned int seconds)
     {
         return sleep_f(seconds);
     }
-    zjl::Fiber::ptr fiber = zjl::Fiber::GetThis();
-    auto iom = zjl::IOManager::GetThis();
-    assert(iom != nullptr && "这里的 IOManager 指针不可为空");
-    iom->addTimer(seconds * 1000, [iom, fiber](){
-        iom->schedule(fiber);
-    });
-    zjl::Fiber::YieldToHold();
+    SleepFor(std::chrono::seconds(seconds));
     return 0;
 }
 
@@ -206,30 +543,31 @@ int usleep(useconds_t usec)
     {
         return usleep_f(usec);
     }
-    zjl::Fiber::ptr fiber = zjl::Fiber::GetThis();
-    auto iom = zjl::IOManager::GetThis();
-    assert(iom != nullptr && "这里的 IOManager 指针不可为空");
-    iom->addTimer(usec / 1000, [iom, fiber](){
-        iom->schedule(fiber);
-    });
-    zjl::Fiber::YieldToHold();
+    SleepFor(std::chrono::microseconds(usec));
     return 0;
 }
 
+/**
+ * @brief hook 处理后的 nanosleep，不足 1us 的部分向上取整，协程睡眠不会被信号打断，rem 总是置 0
+*/
 int nanosleep(const struct timespec *req, struct timespec *rem)
 {
     if (!zjl::t_hook_enabled)
     {
         return nanosleep_f(req, rem);
     }
-    int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
-    zjl::Fiber::ptr fiber = zjl::Fiber::GetThis();
-    auto iom = zjl::IOManager::GetThis();
-    assert(iom != nullptr && "这里的 IOManager 指针不可为空");
-    iom->addTimer(timeout_ms, [iom, fiber](){
-        iom->schedule(fiber);
-    });
-    zjl::Fiber::YieldToHold();
+    if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    SleepFor(std::chrono::seconds(req->tv_sec) +
+             std::chrono::ceil<std::chrono::microseconds>(std::chrono::nanoseconds(req->tv_nsec)));
+    if (rem)
+    {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
     return 0;
 }
 
@@ -246,16 +584,32 @@ int socket(int domain, int type, int protocol)
     {
         return fd;
     }
-    zjl::FileDescriptorManager::GetInstance()->get(fd, true);
+    RegisterSocket(fd, type & SOCK_NONBLOCK);
     return fd;
 }
 
+int socketpair(int domain, int type, int protocol, int sv[2])
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return socketpair_f(domain, type, protocol, sv);
+    }
+    int rt = socketpair_f(domain, type, protocol, sv);
+    if (rt == 0)
+    {
+        RegisterFileDescriptor(sv[0], type & SOCK_NONBLOCK);
+        RegisterFileDescriptor(sv[1], type & SOCK_NONBLOCK);
+    }
+    return rt;
+}
+
 int connectWithTimeout(int sockfd, const struct sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms)
 {
     if (!zjl::t_hook_enabled)
     {
         return connect_f(sockfd, addr, addrlen);
     }
+    zjl::Fiber::CheckPreempt();
     auto fdp = zjl::FileDescriptorManager::GetInstance()->get(sockfd);
     if (!fdp || fdp->isClosed())
     {
@@ -270,6 +624,22 @@ int connectWithTimeout(int sockfd, const struct sockaddr *addr, socklen_t addrle
     {
         return connect_f(sockfd, addr, addrlen);
     }
+    auto iom = zjl::IOManager::GetThis();
+    if (!iom || !iom->moveToOwner(sockfd))
+    {
+        return connect_f(sockfd, addr, addrlen);
+    }
+    if (iom->isCompletionBased())
+    {
+        // 完成式 IO 直接提交 connect 请求，连接建立或失败时请求完成，不需要再查询 SO_ERROR
+        zjl::IORequest request(zjl::IORequest::CONNECT, sockfd, addr, addrlen);
+        request.m_timeout_ms = timeout_ms;
+        ssize_t rt = iom->submitAndWait(request);
+        if (rt != -1 || errno != EAGAIN)
+        {
+            return static_cast<int>(rt);
+        }
+    }
     int n = connect_f(sockfd, addr, addrlen);
     if (n == 0)
     {
@@ -283,48 +653,31 @@ int connectWithTimeout(int sockfd, const struct sockaddr *addr, socklen_t addrle
      * 调用 connect，非阻塞形式下会返回-1，但是 errno 被设为 EINPROGRESS，表明 connect 仍旧在进行还没有完成。
      * 下一步就需要为其添加 write 事件监听，当连接成功后会触发该事件。
     */
-    auto iom = zjl::IOManager::GetThis();
-    zjl::Timer::ptr timer;
-    auto timer_info = std::make_shared<TimerInfo>();
-    std::weak_ptr<TimerInfo> weak_timer_info(timer_info);
-
-    if (timeout_ms != static_cast<uint64_t>(-1))
-    {
-        timer = iom->addConditionTimer(
-            timeout_ms, 
-            [weak_timer_info, sockfd, iom](){
-                auto t = weak_timer_info.lock();
-                if (!t || t->cancelled)
-                {
-                    return;
-                }
-                t->cancelled = ETIMEDOUT;
-                iom->cancelEventListener(sockfd, zjl::FDEventType::WRITE);
-            }, 
-            weak_timer_info);
-    }
-
-    int rt = iom->addEventListener(sockfd, zjl::FDEventType::WRITE);
+    uint64_t waiter_id = 0;
+    int rt = iom->addEventListener(sockfd, zjl::FDEventType::WRITE, nullptr, &waiter_id);
     if (rt == 0)
     {
-        zjl::Fiber::YieldToHold();
-        if (timer)
+        zjl::TimeoutNode timeout_node;
+        bool has_timeout = timeout_ms != static_cast<uint64_t>(-1);
+        if (has_timeout)
         {
-            timer->cancel();
+            iom->armTimeout(timeout_node, std::chrono::milliseconds(timeout_ms), [sockfd, iom, waiter_id]() {
+                iom->cancelEventListener(sockfd, zjl::FDEventType::WRITE, waiter_id);
+            });
         }
-        if (timer_info->cancelled)
+        zjl::Fiber::YieldToHold();
+        if (has_timeout && !timeout_node.cancel())
         {
-            errno = timer_info->cancelled;
+            errno = ETIMEDOUT;
             return -1;
         }
     }
     if (rt == -1)
     {
-        if (timer)
-        {
-            timer->cancel();
-        }
+        int err = errno;
         LOG_FMT_ERROR(zjl::system_logger, "connectWithTimeout addEventListener(%d, write) error", sockfd);
+        errno = err;
+        return -1;
     }
 
     int error = 0;
@@ -352,65 +705,405 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
 {
-    int fd = doIO(sockfd, accept_f, "accept", zjl::FDEventType::READ, SO_RCVTIMEO, addr, addrlen);
+    zjl::IORequest request(zjl::IORequest::ACCEPT, sockfd, addr, 0, 0, addrlen);
+    int fd = doIO(sockfd, accept_f, "accept", zjl::FDEventType::READ, SO_RCVTIMEO, &request, addr, addrlen);
+    if (fd >= 0)
+    {
+        RegisterSocket(fd, false);
+    }
+    return fd;
+}
+
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+    // flags 原样交给内核，完成式的 accept 同样支持 SOCK_NONBLOCK 与 SOCK_CLOEXEC
+    zjl::IORequest request(zjl::IORequest::ACCEPT, sockfd, addr, 0, flags, addrlen);
+    int fd = doIO(sockfd, accept4_f, "accept4", zjl::FDEventType::READ, SO_RCVTIMEO, &request,
+                  addr, addrlen, flags);
     if (fd >= 0)
     {
-        zjl::FileDescriptorManager::GetInstance()->get(fd, true);
+        RegisterSocket(fd, flags & SOCK_NONBLOCK);
     }
     return fd;
 }
 
 ssize_t read(int fd, void *buf, size_t count)
 {
-    return doIO(fd, read_f, "read", zjl::FDEventType::READ, SO_RCVTIMEO, buf, count);
+    zjl::IORequest request(zjl::IORequest::READ, fd, buf, count);
+    return doIO(fd, read_f, "read", zjl::FDEventType::READ, SO_RCVTIMEO, &request, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
 {
-    return doIO(fd, readv_f, "readv", zjl::FDEventType::READ, SO_RCVTIMEO, iov, iovcnt);
+    zjl::IORequest request(zjl::IORequest::READV, fd, iov, iovcnt);
+    return doIO(fd, readv_f, "readv", zjl::FDEventType::READ, SO_RCVTIMEO, &request, iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags)
 {
-    return doIO(sockfd, recv_f, "recv", zjl::FDEventType::READ, SO_RCVTIMEO, buf, len, flags);
+    zjl::IORequest request(zjl::IORequest::RECV, sockfd, buf, len, flags);
+    return doIO(sockfd, recv_f, "recv", zjl::FDEventType::READ, SO_RCVTIMEO, &request, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, 
     struct sockaddr* src_addr, socklen_t* addrlen)
 {
+    // 需要对端地址时没有等价的完成式请求，只使用就绪式等待
+    zjl::IORequest request(zjl::IORequest::RECV, sockfd, buf, len, flags);
     return doIO(sockfd, recvfrom_f, "recvfrom", zjl::FDEventType::READ, SO_RCVTIMEO, 
-        buf, len, flags, src_addr, addrlen);
+        src_addr ? nullptr : &request, buf, len, flags, src_addr, addrlen);
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
 {
-    return doIO(sockfd, recvmsg_f, "recvfrom", zjl::FDEventType::READ, SO_RCVTIMEO, msg, flags);
+    zjl::IORequest request(zjl::IORequest::RECVMSG, sockfd, msg, 0, flags);
+    return doIO(sockfd, recvmsg_f, "recvfrom", zjl::FDEventType::READ, SO_RCVTIMEO, &request, msg, flags);
 }
 
 ssize_t write(int fd, const void *buf, size_t count)
 {
-    return doIO(fd, write_f, "write", zjl::FDEventType::WRITE, SO_SNDTIMEO, buf, count);
+    zjl::IORequest request(zjl::IORequest::WRITE, fd, buf, count);
+    return doIO(fd, write_f, "write", zjl::FDEventType::WRITE, SO_SNDTIMEO, &request, buf, count);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+    zjl::IORequest request(zjl::IORequest::READ, fd, buf, count);
+    request.m_offset = offset;
+    return doIO(fd, pread_f, "pread", zjl::FDEventType::READ, SO_RCVTIMEO, &request, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+    zjl::IORequest request(zjl::IORequest::WRITE, fd, buf, count);
+    request.m_offset = offset;
+    return doIO(fd, pwrite_f, "pwrite", zjl::FDEventType::WRITE, SO_SNDTIMEO, &request, buf, count, offset);
+}
+
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    zjl::IORequest request(zjl::IORequest::READV, fd, iov, iovcnt);
+    request.m_offset = offset;
+    return doIO(fd, preadv_f, "preadv", zjl::FDEventType::READ, SO_RCVTIMEO, &request, iov, iovcnt, offset);
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    zjl::IORequest request(zjl::IORequest::WRITEV, fd, iov, iovcnt);
+    request.m_offset = offset;
+    return doIO(fd, pwritev_f, "pwritev", zjl::FDEventType::WRITE, SO_SNDTIMEO, &request, iov, iovcnt, offset);
+}
+
+/**
+ * @brief hook 处理后的 sendfile，out_fd 的发送缓冲区已满时挂起当前协程等待可写
+ * 零拷贝没有等价的完成式请求，只使用就绪式等待；in_fd 一般是普通文件，不会返回 EAGAIN
+*/
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    return doIO(out_fd, sendfile_f, "sendfile", zjl::FDEventType::WRITE, SO_SNDTIMEO, nullptr,
+                in_fd, offset, count);
+}
+
+/**
+ * @brief hook 处理后的 splice，两端中未就绪的一端被等待
+ * EAGAIN 不区分是哪一端未就绪：输入端可等待且没有可读的数据时等待它可读，否则等待输出端可写。
+ * 调用者指定 SPLICE_F_NONBLOCK 或两端都不需要等待时直接调用系统函数
+*/
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    zjl::Fiber::CheckPreempt();
+    auto fdm = zjl::FileDescriptorManager::GetInstance();
+    zjl::FileDescriptor::ptr in_fdp = fdm->get(fd_in);
+    zjl::FileDescriptor::ptr out_fdp = fdm->get(fd_out);
+    if ((in_fdp && in_fdp->isClosed()) || (out_fdp && out_fdp->isClosed()))
+    {
+        errno = EBADF;
+        return -1;
+    }
+    bool in_wait = in_fdp && in_fdp->isPollable() && !in_fdp->getUserNonBlock();
+    bool out_wait = out_fdp && out_fdp->isPollable() && !out_fdp->getUserNonBlock();
+    auto iom = zjl::IOManager::GetThis();
+    if (!iom || (!in_wait && !out_wait) || (flags & SPLICE_F_NONBLOCK))
+    {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    while (true)
+    {
+        ssize_t n = splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n != -1 || errno != EAGAIN)
+        {
+            return n;
+        }
+        int available = 0;
+        bool wait_in = in_wait &&
+            (!out_wait || (ioctl_f(fd_in, FIONREAD, &available) == 0 && available == 0));
+        int fd = wait_in ? fd_in : fd_out;
+        // 两端可能由不同的事件循环负责，等待之前迁移到负责被等待一端的线程
+        if (!iom->moveToOwner(fd))
+        {
+            return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+        }
+        uint64_t timeout = wait_in ? in_fdp->getTimeout(SO_RCVTIMEO) : out_fdp->getTimeout(SO_SNDTIMEO);
+        if (WaitForEvent(iom, fd, wait_in ? zjl::FDEventType::READ : zjl::FDEventType::WRITE,
+                         timeout, "splice") == -1)
+        {
+            return -1;
+        }
+    }
+}
+
+//////// poll.h、sys/select.h、sys/epoll.h
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return poll_f(fds, nfds, timeout);
+    }
+    return doPoll(fds, nfds, timeout);
+}
+
+/**
+ * @brief hook 处理后的 ppoll，超时不足 1ms 的部分向上取整
+ * 协程挂起期间无法原子地替换信号掩码，指定了 sigmask 时直接调用系统函数
+*/
+int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask)
+{
+    if (!zjl::t_hook_enabled || sigmask)
+    {
+        return ppoll_f(fds, nfds, tmo_p, sigmask);
+    }
+    if (tmo_p && (tmo_p->tv_sec < 0 || tmo_p->tv_nsec < 0 || tmo_p->tv_nsec >= 1000000000))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    int timeout = tmo_p ? static_cast<int>(tmo_p->tv_sec * 1000 + (tmo_p->tv_nsec + 999999) / 1000000) : -1;
+    return doPoll(fds, nfds, timeout);
+}
+
+/**
+ * @brief hook 处理后的 select，转换为 poll 等待，再把结果写回三个集合
+ * 与 Linux 一致，返回时 timeout 被更新为剩余的时间
+*/
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
+    if (nfds < 0 || nfds > FD_SETSIZE ||
+        (timeout && (timeout->tv_sec < 0 || timeout->tv_usec < 0 || timeout->tv_usec >= 1000000)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    std::vector<pollfd> fds;
+    for (int fd = 0; fd < nfds; fd++)
+    {
+        short events = 0;
+        if (readfds && FD_ISSET(fd, readfds))
+        {
+            events |= POLLIN;
+        }
+        if (writefds && FD_ISSET(fd, writefds))
+        {
+            events |= POLLOUT;
+        }
+        if (exceptfds && FD_ISSET(fd, exceptfds))
+        {
+            events |= POLLPRI;
+        }
+        if (events)
+        {
+            fds.push_back({fd, events, 0});
+        }
+    }
+    int timeout_ms = timeout ? static_cast<int>(timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000) : -1;
+    uint64_t start = zjl::Clock::NowMS();
+    int n = doPoll(fds.data(), fds.size(), timeout_ms);
+    if (n == -1)
+    {
+        return -1;
+    }
+    for (auto& pfd : fds)
+    {
+        if (pfd.revents & POLLNVAL)
+        {
+            errno = EBADF;
+            return -1;
+        }
+    }
+    int count = 0;
+    for (fd_set* set : {readfds, writefds, exceptfds})
+    {
+        if (set)
+        {
+            FD_ZERO(set);
+        }
+    }
+    // 与内核的转换一致：挂断与错误算作可读，错误算作可写
+    for (auto& pfd : fds)
+    {
+        if ((pfd.events & POLLIN) && (pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            FD_SET(pfd.fd, readfds);
+            ++count;
+        }
+        if ((pfd.events & POLLOUT) && (pfd.revents & (POLLOUT | POLLERR)))
+        {
+            FD_SET(pfd.fd, writefds);
+            ++count;
+        }
+        if ((pfd.events & POLLPRI) && (pfd.revents & POLLPRI))
+        {
+            FD_SET(pfd.fd, exceptfds);
+            ++count;
+        }
+    }
+    if (timeout)
+    {
+        uint64_t elapsed_ms = zjl::Clock::NowMS() - start;
+        uint64_t left_ms = elapsed_ms < static_cast<uint64_t>(timeout_ms) ? timeout_ms - elapsed_ms : 0;
+        timeout->tv_sec = static_cast<time_t>(left_ms / 1000);
+        timeout->tv_usec = static_cast<suseconds_t>(left_ms % 1000 * 1000);
+    }
+    return count;
+}
+
+/**
+ * @brief hook 处理后的 epoll_create，登记 epoll fd，epoll_wait 时可以挂起协程等待它可读
+*/
+int epoll_create(int size)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return epoll_create_f(size);
+    }
+    int fd = epoll_create_f(size);
+    if (fd != -1)
+    {
+        RegisterFileDescriptor(fd, false, true);
+    }
+    return fd;
+}
+
+int epoll_create1(int flags)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return epoll_create1_f(flags);
+    }
+    int fd = epoll_create1_f(flags);
+    if (fd != -1)
+    {
+        RegisterFileDescriptor(fd, false, true);
+    }
+    return fd;
+}
+
+/**
+ * @brief hook 处理后的 epoll_wait，epoll fd 中有就绪的事件时它本身变为可读，以单个 fd 的 poll 等待它
+ * 没有经过 hook 创建的 epoll fd 直接调用系统函数
+*/
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return epoll_wait_f(epfd, events, maxevents, timeout);
+    }
+    pollfd pfd{epfd, POLLIN, 0};
+    uint64_t deadline = timeout < 0 ? ~0ull : zjl::Clock::NowMS() + timeout;
+    while (true)
+    {
+        int n = epoll_wait_f(epfd, events, maxevents, 0);
+        if (n != 0 || timeout == 0)
+        {
+            return n;
+        }
+        int wait_ms = -1;
+        if (deadline != ~0ull)
+        {
+            uint64_t now = zjl::Clock::NowMS();
+            if (now >= deadline)
+            {
+                return 0;
+            }
+            wait_ms = static_cast<int>(deadline - now);
+        }
+        // 可读之后事件可能被其他协程取走，重新等待
+        n = doPoll(&pfd, 1, wait_ms);
+        if (n <= 0)
+        {
+            return n;
+        }
+    }
+}
+
+/**
+ * @brief 同步文件数据，datasync 为 true 时等价于 fdatasync
+*/
+static int doSync(int fd, bool datasync)
+{
+    auto func = datasync ? fdatasync_f : fsync_f;
+    if (!zjl::t_hook_enabled)
+    {
+        return func(fd);
+    }
+    zjl::Fiber::CheckPreempt();
+    zjl::FileDescriptor::ptr fdp = GetFileDescriptor(fd, true);
+    zjl::IORequest request(zjl::IORequest::FSYNC, fd, nullptr, 0, datasync ? 1 : 0);
+    ssize_t result = 0;
+    if (fdp && doFileIO(fdp, request, result))
+    {
+        return static_cast<int>(result);
+    }
+    return func(fd);
+}
+
+int fsync(int fd)
+{
+    return doSync(fd, false);
+}
+
+int fdatasync(int fd)
+{
+    return doSync(fd, true);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 {
-    return doIO(fd, writev_f, "writev_f", zjl::FDEventType::WRITE, SO_SNDTIMEO, iov, iovcnt);
+    zjl::IORequest request(zjl::IORequest::WRITEV, fd, iov, iovcnt);
+    return doIO(fd, writev_f, "writev_f", zjl::FDEventType::WRITE, SO_SNDTIMEO, &request, iov, iovcnt);
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags)
 {
-    return doIO(sockfd, send_f, "send", zjl::FDEventType::WRITE, SO_SNDTIMEO, buf, len, flags);
+    zjl::IORequest request(zjl::IORequest::SEND, sockfd, buf, len, flags);
+    return doIO(sockfd, send_f, "send", zjl::FDEventType::WRITE, SO_SNDTIMEO, &request, buf, len, flags);
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
     const struct sockaddr *dest_addr, socklen_t addrlen)
 {
-    return doIO(sockfd, sendto_f, "sendto", zjl::FDEventType::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);
+    // 指定了目的地址时没有等价的完成式请求，只使用就绪式等待
+    zjl::IORequest request(zjl::IORequest::SEND, sockfd, buf, len, flags);
+    return doIO(sockfd, sendto_f, "sendto", zjl::FDEventType::WRITE, SO_SNDTIMEO,
+        dest_addr ? nullptr : &request, buf, len, flags, dest_addr, addrlen);
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
 {
-    return doIO(sockfd, sendmsg_f, "sendmsg", zjl::FDEventType::WRITE, SO_SNDTIMEO, msg, flags);
+    zjl::IORequest request(zjl::IORequest::SENDMSG, sockfd, msg, 0, flags);
+    return doIO(sockfd, sendmsg_f, "sendmsg", zjl::FDEventType::WRITE, SO_SNDTIMEO, &request, msg, flags);
 }
 
 int close(int fd)
@@ -419,18 +1112,94 @@ int close(int fd)
     {
         return close_f(fd);
     }
-    zjl::FileDescriptor::ptr fdp = zjl::FileDescriptorManager::GetInstance()->get(fd);
-    if (fdp)
+    UnregisterFileDescriptor(fd);
+    return close_f(fd);
+}
+
+int pipe(int pipefd[2])
+{
+    return pipe2(pipefd, 0);
+}
+
+/**
+ * @brief hook 处理后的 pipe2，登记管道的两端，读写时挂起协程等待就绪事件
+*/
+int pipe2(int pipefd[2], int flags)
+{
+    if (!zjl::t_hook_enabled)
     {
-        auto iom = zjl::IOManager::GetThis();
-        if (iom)
-        {
-            iom->cancelAll(fd);
-        }
-        zjl::FileDescriptorManager::GetInstance()->remove(fd);
+        return flags == 0 ? pipe_f(pipefd) : pipe2_f(pipefd, flags);
     }
-    return close_f(fd);
-} 
+    int rt = pipe2_f(pipefd, flags);
+    if (rt == 0)
+    {
+        RegisterFileDescriptor(pipefd[0], flags & O_NONBLOCK);
+        RegisterFileDescriptor(pipefd[1], flags & O_NONBLOCK);
+    }
+    return rt;
+}
+
+int eventfd(unsigned int initval, int flags)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return eventfd_f(initval, flags);
+    }
+    int fd = eventfd_f(initval, flags);
+    if (fd != -1)
+    {
+        RegisterFileDescriptor(fd, flags & EFD_NONBLOCK, true);
+    }
+    return fd;
+}
+
+int dup(int oldfd)
+{
+    if (!zjl::t_hook_enabled)
+    {
+        return dup_f(oldfd);
+    }
+    int fd = dup_f(oldfd);
+    if (fd != -1)
+    {
+        RegisterDupFileDescriptor(oldfd, fd);
+    }
+    return fd;
+}
+
+/**
+ * @brief 复制到指定的 newfd，newfd 已经打开时先像 close 一样注销，再由 newfd 沿用 oldfd 的登记信息
+*/
+static int doDup(int oldfd, int newfd, int flags, bool is_dup3)
+{
+    auto func = [=]() { return is_dup3 ? dup3_f(oldfd, newfd, flags) : dup2_f(oldfd, newfd); };
+    if (!zjl::t_hook_enabled || oldfd == newfd)
+    {
+        return func();
+    }
+    // oldfd 无效时 dup2 不会关闭 newfd，此时保留 newfd 的登记
+    if (zjl::FileDescriptorManager::GetInstance()->get(newfd) && fcntl_f(oldfd, F_GETFD) == -1)
+    {
+        return -1;
+    }
+    UnregisterFileDescriptor(newfd);
+    int fd = func();
+    if (fd != -1)
+    {
+        RegisterDupFileDescriptor(oldfd, fd);
+    }
+    return fd;
+}
+
+int dup2(int oldfd, int newfd)
+{
+    return doDup(oldfd, newfd, 0, false);
+}
+
+int dup3(int oldfd, int newfd, int flags)
+{
+    return doDup(oldfd, newfd, flags, true);
+}
 
 int fcntl(int fd, int cmd, ... /* arg */ )
 {
@@ -447,7 +1216,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
             int arg = va_arg(va, int);
             va_end(va);
             auto fdp = zjl::FileDescriptorManager::GetInstance()->get(fd);
-            if (!fdp || fdp->isClosed() || !fdp->isSocket())
+            if (!fdp || fdp->isClosed() || !fdp->isPollable())
             {
                 return fcntl_f(fd, cmd, arg);
             }
@@ -470,7 +1239,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
             va_end(va);
             int arg = fcntl_f(fd, cmd);
             auto fdp = zjl::FileDescriptorManager::GetInstance()->get(fd);
-            if (!fdp || fdp->isClosed() || !fdp->isSocket())
+            if (!fdp || fdp->isClosed() || !fdp->isPollable())
             {
                 return arg;
             }
@@ -487,6 +1256,18 @@ int fcntl(int fd, int cmd, ... /* arg */ )
 
         case F_DUPFD:
         case F_DUPFD_CLOEXEC:
+        {
+            int arg = va_arg(va, int);
+            va_end(va);
+            int newfd = fcntl_f(fd, cmd, arg);
+            if (newfd != -1 && zjl::t_hook_enabled)
+            {
+                RegisterDupFileDescriptor(fd, newfd);
+            }
+            return newfd;
+        }
+            break;
+
         case F_SETFD:
         case F_SETOWN:
         case F_SETSIG:
@@ -547,13 +1328,13 @@ int ioctl(int fd, unsigned long request, ...)
     {
         bool user_nonblock = !!*(int*)arg;
         auto fdp = zjl::FileDescriptorManager::GetInstance()->get(fd);
-        if (!fdp || fdp->isClosed() || !fdp->isSocket())
+        if (!fdp || fdp->isClosed() || !fdp->isPollable())
         {
             return ioctl_f(fd, request, arg);
         }
         fdp->setUserNonBlock(user_nonblock);
     }
-    return ioctl(fd, request, arg);
+    return ioctl_f(fd, request, arg);
 }
 
 int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen)
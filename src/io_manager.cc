@@ -1,19 +1,103 @@
 #include "io_manager.h"
+#include "clock.h"
+#include "config.h"
 #include "exception.h"
+#include "hook.h"
 #include "log.h"
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstring>
 #include <fcntl.h>
 #include <memory>
 #include <string>
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
 namespace zjl
 {
 
 static Logger::ptr system_logger = GET_LOGGER("system");
 
+// 析构时排空调度器的等待期限，小于 0 表示不排空，直接停止
+static ConfigVar<int>::ptr g_drain_timeout =
+    Config::Lookup<int>("iomanager.drain_timeout", -1, "IOManager 析构时的排空期限(ms)");
+
+// IO 后端，可选 epoll 与 io_uring，io_uring 不可用时回退到 epoll
+static ConfigVar<std::string>::ptr g_backend =
+    Config::Lookup<std::string>("iomanager.backend", "epoll", "IOManager 的 IO 后端");
+
+// 是否对 fd 使用常驻的边缘触发注册：fd 第一次等待时注册读写事件，直到关闭都不再修改
+static ConfigVar<bool>::ptr g_persistent_registration =
+    Config::Lookup<bool>("iomanager.persistent_registration", false, "IOManager 是否使用常驻的边缘触发注册");
+
+// 是否每个工作线程独占一个事件循环，fd 轮流分配给工作线程
+static ConfigVar<bool>::ptr g_per_worker_reactor =
+    Config::Lookup<bool>("iomanager.per_worker_reactor", false, "IOManager 是否每个工作线程独占一个事件循环");
+
+// 每次轮询取出的事件数量与最长的阻塞时间，可以用 iomanager.<调度器名称>.max_events 等覆盖单个调度器的配置
+static ConfigVar<int>::ptr g_max_events =
+    Config::Lookup<int>("iomanager.max_events", 64, "IOManager 每次轮询取出的事件数量");
+static ConfigVar<int>::ptr g_max_timeout_ms =
+    Config::Lookup<int>("iomanager.max_timeout_ms", 1000, "IOManager 每次轮询最长的阻塞时间(ms)");
+
+// 就绪事件连续填满批次时，批次加倍增长的上限
+static ConfigVar<int>::ptr g_max_events_limit =
+    Config::Lookup<int>("iomanager.max_events_limit", 4096, "IOManager 每次轮询取出的事件数量的上限");
+
+// 空闲线程阻塞之前忙轮询的时间，以 CPU 换取更低的唤醒延迟，同样可以按调度器名称覆盖
+static ConfigVar<int>::ptr g_busy_poll_us =
+    Config::Lookup<int>("iomanager.busy_poll_us", 0, "IOManager 空闲线程阻塞之前忙轮询的时间(us)");
+
+// 是否给 hook 创建的 socket 设置 SO_BUSY_POLL/SO_PREFER_BUSY_POLL，值取 busy_poll_us
+static ConfigVar<bool>::ptr g_socket_busy_poll =
+    Config::Lookup<bool>("iomanager.socket_busy_poll", false, "IOManager 是否给 socket 开启内核的忙轮询");
+
+// 是否使用 timerfd 唤醒定时器，到期时间精确到微秒，不受轮询超时的毫秒取整与上限的影响
+static ConfigVar<bool>::ptr g_timerfd =
+    Config::Lookup<bool>("iomanager.timerfd", true, "IOManager 是否使用 timerfd 唤醒定时器");
+
+// 每个工作线程把自己添加的定时器放在单独的分片中，添加、取消定时器时不再竞争同一把锁
+static ConfigVar<bool>::ptr g_timer_shards =
+    Config::Lookup<bool>("iomanager.timer_shards", true, "IOManager 是否按工作线程拆分定时器");
+
+// 没有 io_uring 时执行文件 IO 的线程数量
+static ConfigVar<int>::ptr g_file_io_threads =
+    Config::Lookup<int>("iomanager.file_io_threads", 4, "IOManager 文件 IO 线程池的线程数量");
+
+// 记录轮询时间、唤醒延迟等分布，每次轮询与每次唤醒协程多几次读取时钟
+static ConfigVar<bool>::ptr g_latency_stats =
+    Config::Lookup<bool>("iomanager.latency_stats", true, "IOManager 是否记录事件循环的延迟分布");
+
+/**
+ * @brief 获取调度器专属的配置项，默认值 -1 表示沿用全局配置项
+ * 调度器名称不能作为配置项名称（为空或包含大写字母等字符）时返回 nullptr，只使用全局配置项
+*/
+static ConfigVar<int>::ptr LookupInstanceConfig(const std::string& name, const char* key,
+                                                const ConfigVar<int>::ptr& global)
+{
+    if (name.empty() ||
+        name.find_first_not_of("qwertyuiopasdfghjklzxcvbnm0123456789_") != std::string::npos)
+    {
+        return nullptr;
+    }
+    return Config::Lookup<int>("iomanager." + name + "." + key, -1, global->getDesccription());
+}
+
+// 读取配置项的当前值，调度器专属的配置项不存在或小于 0 时取全局配置项
+static int GetConfigValue(const ConfigVar<int>::ptr& instance, const ConfigVar<int>::ptr& global)
+{
+    int value = instance ? instance->getValue() : -1;
+    return value >= 0 ? value : global->getValue();
+}
+
 /**
  * ===================================================
  * IOManager 类的实现
@@ -30,413 +114,1275 @@ IOManager* IOManager::GetThis()
 }
 
 IOManager::IOManager(size_t thread_size, bool use_caller, std::string name)
-    : Scheduler(thread_size, use_caller, std::move(name))
+    : Scheduler(thread_size, use_caller, std::move(name)),
+      TimerManager(g_timer_shards->getValue() ? getWorkerCount() : 1)
 {
     LOG_DEBUG(system_logger, "调用 IOManager::IOManager()");
-    // 创建 epoll
-    m_epoll_fd = ::epoll_create(0xffff);
-    if (m_epoll_fd == -1)
+    m_per_worker = g_per_worker_reactor->getValue();
+    m_persistent = g_persistent_registration->getValue();
+    m_max_events = LookupInstanceConfig(m_name, "max_events", g_max_events);
+    m_max_timeout_ms = LookupInstanceConfig(m_name, "max_timeout_ms", g_max_timeout_ms);
+    m_busy_poll_us = LookupInstanceConfig(m_name, "busy_poll_us", g_busy_poll_us);
+    // 变更事件在配置项的值更新之前调用，只能使用传入的新值
+    m_busy_poll_cache = GetConfigValue(m_busy_poll_us, g_busy_poll_us);
+    m_busy_poll_listeners[0] = g_busy_poll_us->addListener([this](const int& /*old_value*/, const int& new_value) {
+        if (!m_busy_poll_us || m_busy_poll_us->getValue() < 0)
+        {
+            m_busy_poll_cache.store(new_value, std::memory_order_relaxed);
+        }
+    });
+    if (m_busy_poll_us)
     {
-        THROW_EXCEPTION_WHIT_ERRNO;
+        m_busy_poll_listeners[1] = m_busy_poll_us->addListener([this](const int& /*old_value*/, const int& new_value) {
+            m_busy_poll_cache.store(new_value >= 0 ? new_value : g_busy_poll_us->getValue(), std::memory_order_relaxed);
+        });
     }
-    // 创建管道，并加入 epoll 监听
-    if (::pipe(m_tickle_fds) == -1)
+    m_latency_stats = g_latency_stats->getValue();
+    sigemptyset(&m_signal_mask);
+    // fd 分配给线程池的线程，只有主线程参与调度时全部由主线程负责
+    m_owner_count = m_per_worker && m_thread_count > 0 ? m_thread_count : 1;
+    size_t reactor_count = m_per_worker ? m_worker_count : 1;
+    for (size_t i = 0; i < reactor_count; i++)
     {
-        THROW_EXCEPTION_WHIT_ERRNO;
+        auto reactor = std::make_unique<Reactor>();
+        reactor->m_index = i;
+        adjustBatchSize(*reactor, 0);
+        // 创建 IO 事件轮询器
+        reactor->m_poller = Poller::Create(g_backend->getValue());
+        // 创建管道，并加入 epoll 监听；管道只在内部使用，不经过 hook 登记
+        if (pipe_f(reactor->m_tickle_fds) == -1)
+        {
+            THROW_EXCEPTION_WHIT_ERRNO;
+        }
+        // 将管道读取端设置为非阻塞模式
+        if (::fcntl(reactor->m_tickle_fds[0], F_SETFL, O_NONBLOCK))
+        {
+            THROW_EXCEPTION_WHIT_ERRNO;
+        }
+        // 监听管道的可读事件，开启边缘触发，以 m_tickle_fds 的地址区分管道与 FDContext
+        if (reactor->m_poller->add(reactor->m_tickle_fds[0], EPOLLIN | EPOLLET,
+                                   reactor->m_tickle_fds) == -1)
+        {
+            THROW_EXCEPTION_WHIT_ERRNO;
+        }
+        m_reactors.push_back(std::move(reactor));
     }
-    // 创建管道可读事件监听
-    epoll_event event{};
-    event.data.fd = m_tickle_fds[0];
-    // 监听可读事件 与 开启边缘触发
-    event.events = EPOLLIN | EPOLLET;
-    // 将管道读取端设置为非阻塞模式
-    if (::fcntl(m_tickle_fds[0], F_SETFL, O_NONBLOCK))
+    // 每个事件循环一个 timerfd，只按本事件循环负责的定时器分片设置到期时间
+    for (auto& reactor : m_reactors)
     {
-        THROW_EXCEPTION_WHIT_ERRNO;
+        if (!g_timerfd->getValue())
+        {
+            break;
+        }
+        // 定时器的时间戳来自 Clock，各个时间源都与 CLOCK_MONOTONIC 的起点相同
+        reactor->m_timer_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (reactor->m_timer_fd == -1)
+        {
+            LOG_FMT_WARN(system_logger, "timerfd_create 失败，errno = %d, %s，定时器退回到轮询超时",
+                         errno, strerror(errno));
+            // 所有事件循环统一退回到轮询超时
+            for (auto& created : m_reactors)
+            {
+                if (created->m_timer_fd != -1)
+                {
+                    close(created->m_timer_fd);
+                    created->m_timer_fd = -1;
+                }
+            }
+            break;
+        }
     }
-    if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_tickle_fds[0], &event) == -1)
+    for (auto& reactor : m_reactors)
     {
-        THROW_EXCEPTION_WHIT_ERRNO;
+        if (reactor->m_timer_fd != -1 &&
+            reactor->m_poller->add(reactor->m_timer_fd, EPOLLIN | EPOLLET, &reactor->m_timer_fd) == -1)
+        {
+            THROW_EXCEPTION_WHIT_ERRNO;
+        }
     }
-    contextListResize(64);
+    LOG_FMT_INFO(system_logger, "调度器 %s 使用 %s 作为 IO 后端，事件循环 %zu 个",
+                 m_name.c_str(), getBackendName(), m_reactors.size());
     // 启动调度器
     start();
+    // 等待线程池的线程登记线程 id，之后才能确定负责 fd 的线程
+    if (m_per_worker)
+    {
+        waitForWorkers();
+    }
 }
 
 IOManager::~IOManager()
 {
+    int drain_timeout = g_drain_timeout->getValue();
+    if (drain_timeout >= 0 && !isDraining())
+    {
+        drain(drain_timeout);
+    }
     // FIXME: 调用了虚函数
     stop();
+    g_busy_poll_us->delListener(m_busy_poll_listeners[0]);
+    if (m_busy_poll_us)
+    {
+        m_busy_poll_us->delListener(m_busy_poll_listeners[1]);
+    }
     // 关闭打开的文件标识符
-    close(m_epoll_fd);
-    close(m_tickle_fds[0]);
-    close(m_tickle_fds[1]);
-    // 释放 m_fd_context_list 的指针
-    //    for (auto item : m_fd_context_list)
-    //    {
-    //        delete item;
-    //    }
+    for (auto& reactor : m_reactors)
+    {
+        reactor->m_poller.reset();
+        close(reactor->m_tickle_fds[0]);
+        close(reactor->m_tickle_fds[1]);
+        if (reactor->m_timer_fd != -1)
+        {
+            close(reactor->m_timer_fd);
+        }
+    }
+    if (m_signal_fd != -1)
+    {
+        close(m_signal_fd);
+    }
+    // 调度器已经停止，不会再有新的文件 IO 请求
+    {
+        ScopedLock lock(&m_file_io_mutex);
+        m_file_io_stopping = true;
+    }
+    for (size_t i = 0; i < m_file_io_threads.size(); i++)
+    {
+        m_file_io_sem.notify();
+    }
+    for (auto& thread : m_file_io_threads)
+    {
+        thread->join();
+    }
 }
 
-void IOManager::contextListResize(size_t size)
+int IOManager::registerEvent(FDContext* fd_ctx, uint32_t events)
 {
-    m_fd_context_list.resize(size);
-    for (size_t i = 0; i < m_fd_context_list.size(); i++)
+    // 总是监听对端关闭，半关闭的连接立即唤醒读者与 RDHUP 的等待者，不必等到读取失败
+    uint32_t flags = EPOLLET | EPOLLRDHUP;
+    if (m_persistent)
+    {
+        if (fd_ctx->m_registered.load(std::memory_order_acquire) == FDEventType::ALL)
+        {
+            return 0;
+        }
+        events = FDEventType::ALL;
+    }
+    Poller* poller = m_reactors[getOwnerIndex(fd_ctx->m_fd)]->m_poller.get();
+    uint32_t prev = fd_ctx->m_registered.fetch_or(events, std::memory_order_acq_rel);
+    uint32_t mask = prev | events;
+    bool add = prev == FDEventType::NONE;
+    while (true)
     {
-        if (!m_fd_context_list[i])
+        int rt = add ? poller->add(fd_ctx->m_fd, flags | mask, fd_ctx)
+                     : poller->modify(fd_ctx->m_fd, flags | mask, fd_ctx);
+        if (rt == -1)
         {
-            m_fd_context_list[i] = std::make_unique<FDContext>();
-            m_fd_context_list[i]->m_fd = i;
+            // 其他线程同时注册或移除了 fd，或者 fd 关闭后被复用，换一种方式重试
+            if ((add && errno == EEXIST) || (!add && errno == ENOENT))
+            {
+                add = !add;
+                continue;
+            }
+            int err = errno;
+            LOG_FMT_ERROR(system_logger, "%s 注册事件失败，fd = %d, events = %u, errno = %d, %s",
+                          poller->getName(), fd_ctx->m_fd, mask, err, strerror(err));
+            // 撤销本次加入的事件，下次等待时重新注册
+            fd_ctx->m_registered.fetch_and(~(events & ~prev), std::memory_order_acq_rel);
+            errno = err;
+            return -1;
+        }
+        // 注册期间其他线程加入了新的事件时，以最新的集合再注册一次
+        uint32_t current = fd_ctx->m_registered.load(std::memory_order_acquire);
+        if (current == mask || current == FDEventType::NONE)
+        {
+            return 0;
         }
+        mask = current;
+        add = false;
     }
 }
 
-int IOManager::addEventListener(int fd, FDEventType event, std::function<void()> callback)
+void IOManager::assignOwner(int fd)
 {
-    /**
-     * NOTE:
-     *  主要工作流程: 首先从 fd 对象池中取出对应的对象指针，如果不存在就扩容对象池，
-     *  第二步检查 fd 对象是否存在相同的事件，
-     *  第三步创建 epoll 事件对象，并注册事件,
-     *  最后更新 fd 对象的事件处理器
-     * */
-    
-    FDContext* fd_ctx = nullptr;
-    ReadScopedLock lock(&m_lock);
-    // 从 m_fd_context_list 中拿对象
-    if (m_fd_context_list.size() > static_cast<size_t>(fd))
+    if (!m_per_worker)
     {
-        fd_ctx = m_fd_context_list[fd].get();
-        lock.unlock();
+        return;
     }
-    else
+    FDContext* fd_ctx = m_fd_contexts.get(fd, true);
+    if (fd_ctx)
+    {
+        fd_ctx->m_owner.store(static_cast<int>(m_next_owner++ % m_owner_count), std::memory_order_release);
+    }
+}
+
+size_t IOManager::getOwnerIndex(int fd)
+{
+    if (!m_per_worker)
+    {
+        return 0;
+    }
+    FDContext* fd_ctx = m_fd_contexts.get(fd, true);
+    if (!fd_ctx)
+    {
+        // 超出 fd 上下文表范围的 fd 无法记录分配，按数字固定分配
+        return static_cast<size_t>(fd) % m_owner_count;
+    }
+    int owner = fd_ctx->m_owner.load(std::memory_order_acquire);
+    if (owner >= 0)
+    {
+        return static_cast<size_t>(owner);
+    }
+    // 没有经过 socket()、accept() 的 fd 在第一次使用时分配，同时分配时以先写入的为准
+    int assigned = static_cast<int>(m_next_owner++ % m_owner_count);
+    if (fd_ctx->m_owner.compare_exchange_strong(owner, assigned, std::memory_order_acq_rel))
+    {
+        return static_cast<size_t>(assigned);
+    }
+    return static_cast<size_t>(owner);
+}
+
+bool IOManager::moveToOwner(int fd)
+{
+    long owner = getOwnerThreadId(fd);
+    if (owner == -1 || owner == GetThreadID())
+    {
+        return true;
+    }
+    // 只有本调度器的任务协程可以迁移
+    if (!canSuspend())
     {
-        lock.unlock();
-        WriteScopedLock lock2(&m_lock);
-        contextListResize(m_fd_context_list.size() * 2);
-        fd_ctx = m_fd_context_list[fd].get();
-    }
-    ScopedLock lock3(&fd_ctx->m_mutex);
-    // 检查要监听的事件是否已经存在
-    if (fd_ctx->m_events & event)
-    {
-        LOG_FMT_ERROR(
-            system_logger,
-            "IOManager::addEventListener 重复添加相同的事件 fd = %d, event = %d, fd_ctx.event = %d",
-            fd, event, fd_ctx->m_events);
-        assert(!(fd_ctx->m_events & event));
-    }
-    /*
-     * 如果这个 fd context 的 m_events 是空的，说明这个 fd 还没在 epoll 上注册，
-     * 使用 EPOLL_CTL_ADD 注册新事件，
-     * 否则，使用 EPOLL_CTL_MOD，更改 fd 监听的事件
-     **/
-    int op = fd_ctx->m_events == FDEventType::NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
-    // 创建事件
-    epoll_event epevent{};
-    epevent.events = EPOLLET | fd_ctx->m_events | event;
+        return false;
+    }
+    Scheduler::YieldToThread(owner);
+    assert(GetThreadID() == owner);
+    return true;
+}
+
+int IOManager::addEventListener(int fd, FDEventType event, Fiber::FiberFunc callback, uint64_t* waiter_id)
+{
     /**
-     * FIXME: 感觉这是个不太好的做法。 fd_ctx 指向的对象由 unique_ptr 管理，
-     *        这相当于交出了所有权，但暂时想不出解决办法。
+     * NOTE:
+     *  主要工作流程: 首先从 fd 上下文表中取出对应的对象指针，
+     *  第二步把事件处理器加入该事件的等待者列表，并把事件标记为等待中，
+     *  最后注册到轮询器，重新激活边缘触发
      * */
-    epevent.data.ptr = fd_ctx;
-    // 给 fd 注册事件监听
-    if (::epoll_ctl(m_epoll_fd, op, fd, &epevent) == -1)
-    {
-        LOG_FMT_ERROR(
-            system_logger,
-            "epoll_ctl 调用失败，epfd = %d",
-            m_epoll_fd);
-        // THROW_EXCEPTION_WHIT_ERRNO;
+
+    // 排空超时后不再接受新的事件监听，被唤醒的 IO 操作直接失败
+    if (m_drain_cancelled)
+    {
+        errno = ECANCELED;
         return -1;
     }
-//    LOG_FMT_DEBUG(system_logger, "epoll_ctl %s 注册事件 %ul : %s",
-//                  op == 1 ? "新增" : "修改",
-//                  epevent.events,
-//                  strerror(errno));
-    ++m_pending_event_count;
-    fd_ctx->m_events = static_cast<FDEventType>(fd_ctx->m_events | event);
-    FDContext::EventHandler& event_handler = fd_ctx->getEventHandler(event);
-    // 确保没有给这个 fd 没有重复添加事件监听
-    assert(event_handler.m_scheduler == nullptr &&
-           !event_handler.m_fiber &&
-           !event_handler.m_callback);
-//    event_handler.m_scheduler = Scheduler::GetThis();
+    long owner = getOwnerThreadId(fd);
+    if (owner != -1 && owner != GetThreadID())
+    {
+        // 协程式的监听需要先通过 moveToOwner 迁移到负责 fd 的线程
+        if (!callback)
+        {
+            LOG_FMT_ERROR(system_logger,
+                          "IOManager::addEventListener 不在负责 fd = %d 的线程上", fd);
+            errno = EPERM;
+            return -1;
+        }
+        // 回调式的监听转交给负责 fd 的线程注册
+        scheduleInlineInternal(
+            [this, fd, event, cb = std::move(callback)]() mutable {
+                addEventListener(fd, event, std::move(cb));
+            },
+            owner);
+        return 0;
+    }
+    FDContext::EventHandler event_handler;
     event_handler.m_scheduler = this;
-//    LOG_FMT_ERROR(system_logger, "调度器地址: %p", Scheduler::GetThis());
     if (callback)
     {
-        event_handler.m_callback.swap(callback);
+        event_handler.m_callback = std::make_unique<Fiber::FiberFunc>(std::move(callback));
     }
     else
     {
         // 当 callback 是 nullptr 时，将当前上下文转换为协程，并作为时间回调使用
         event_handler.m_fiber = Fiber::GetThis();
     }
-    return 0;
+    return addEventWaiter(fd, event, std::move(event_handler), waiter_id);
 }
 
-bool IOManager::removeEventListener(int fd, FDEventType event)
+int IOManager::addEventWaiter(int fd, FDEventType event, FDContext::EventHandler&& handler, uint64_t* waiter_id)
 {
-    FDContext* fd_ctx = nullptr;
-    { // 上读锁
-        ReadScopedLock lock(&m_lock);
-        if (m_fd_context_list.size() <= static_cast<size_t>(fd))
+    FDContext* fd_ctx = m_fd_contexts.get(fd, true);
+    if (!fd_ctx)
+    {
+        LOG_FMT_ERROR(system_logger, "IOManager::addEventListener fd = %d 超出 fd 上下文表的范围", fd);
+        errno = EBADF;
+        return -1;
+    }
+    ++m_pending_event_count;
+    uint64_t id = fd_ctx->addWaiter(event, std::move(handler));
+    // 事件必须在注册之前置位，否则注册后立即到来的边缘会因为没有等待者而被丢弃
+    if (registerEvent(fd_ctx, event) == -1)
+    {
+        int err = errno;
+        // 只移除自己，同一事件的其他等待者不受影响
+        if (fd_ctx->removeWaiter(event, id))
         {
-            return false;
+            --m_pending_event_count;
         }
-        // 从 m_fd_context_list 中拿对象
-        fd_ctx = m_fd_context_list[fd].get();
+        errno = err;
+        return -1;
     }
-    ScopedLock lock2(&(fd_ctx->m_mutex));
-    if (!(fd_ctx->m_events & event))
-    { // 要移除的事件不存在
-        return false;
+    if (waiter_id)
+    {
+        *waiter_id = id;
     }
-    // 从 epoll 上移除该事件的监听
-    auto new_event = static_cast<FDEventType>(fd_ctx->m_events & ~event);
-    // 如果 new_event 为 0, 从 epoll 中移除对该 fd 的监听，否则仅修改监听事件
-    int op = new_event == FDEventType::NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
-    epoll_event epevent{};
-    epevent.events = EPOLLET | new_event;
-    epevent.data.ptr = fd_ctx;
-    if (::epoll_ctl(m_epoll_fd, op, fd, &epevent) == -1)
-    {
-        LOG_FMT_ERROR(
-            system_logger,
-            "epoll_ctl 调用失败，epfd = %d",
-            m_epoll_fd);
-        THROW_EXCEPTION_WHIT_ERRNO;
-    }
-    fd_ctx->m_events = new_event;
-    auto& event_handler = fd_ctx->getEventHandler(event);
-    fd_ctx->resetHandler(event_handler);
-    --m_pending_event_count;
-    return true;
+    // 常驻注册不会重新激活边缘触发，等待之前到来的边缘只记录在 m_ready 中，直接就地触发
+    if (m_persistent && (fd_ctx->m_ready.fetch_and(~event) & event))
+    {
+        m_pending_event_count -= fd_ctx->triggerEvents(event, getOwnerThreadId(fd));
+    }
+    return 0;
 }
 
-bool IOManager::cancelEventListener(int fd, FDEventType event)
+bool IOManager::removeEventWaiter(int fd, FDEventType event, uint64_t waiter_id)
 {
-    FDContext* fd_ctx = nullptr;
-    { // 上读锁
-        ReadScopedLock lock(&m_lock);
-        if (m_fd_context_list.size() <= static_cast<size_t>(fd))
-        {
-            return false;
-        }
-        // 从 m_fd_context_list 中拿对象
-        fd_ctx = m_fd_context_list[fd].get();
-    }
-    ScopedLock lock2(&(fd_ctx->m_mutex));
-    if (!(fd_ctx->m_events & event))
-    { // 要移除的事件不存在
+    FDContext* fd_ctx = m_fd_contexts.get(fd, false);
+    // 等待者已经被唤醒时找不到，唤醒时已经减少了计数
+    if (!fd_ctx || !fd_ctx->removeWaiter(event, waiter_id))
+    {
         return false;
     }
-    // 从 epoll 上移除该事件的监听
-    auto new_event = static_cast<FDEventType>(fd_ctx->m_events & ~event);
-    // 如果 new_event 为 0, 从 epoll 中移除对该 fd 的监听，否则仅修改监听事件
-    int op = new_event == FDEventType::NONE ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
-    epoll_event epevent{};
-    epevent.events = EPOLLET | new_event;
-    epevent.data.ptr = fd_ctx;
-    if (::epoll_ctl(m_epoll_fd, op, fd, &epevent) == -1)
-    {
-        LOG_FMT_ERROR(
-            system_logger,
-            "epoll_ctl 调用失败，epfd = %d",
-            m_epoll_fd);
-        THROW_EXCEPTION_WHIT_ERRNO;
-    }
-    fd_ctx->m_events = new_event;
-    fd_ctx->triggerEvent(event);
     --m_pending_event_count;
     return true;
 }
 
-bool IOManager::cancelAll(int fd)
+namespace
+{
+
+/**
+ * @brief waitEvents 中各个等待者共享的状态
+ * 被认领的等待者的回调可能在协程返回之后才执行，因此由回调共同持有
+*/
+struct EventWaitGroup
+{
+    Fiber::ptr m_fiber;                 // 等待的协程，第一个唤醒者取走
+    long m_thread_id = -1;              // 协程恢复执行的线程
+    std::atomic_bool m_woken{false};
+    std::vector<uint64_t> m_waiter_ids; // 每个等待者的编号，0 表示没有加入；只由负责对应 fd 的线程读写
+};
+
+} // namespace
+
+int IOManager::waitEvents(const std::vector<std::pair<int, uint32_t>>& fds, uint64_t timeout_ms)
 {
-    FDContext* fd_ctx = nullptr;
-    { // 上读锁
-        ReadScopedLock lock(&m_lock);
-        if (m_fd_context_list.size() <= static_cast<size_t>(fd))
+    if (m_drain_cancelled)
+    {
+        errno = ECANCELED;
+        return -1;
+    }
+    // 每个 fd 的每种事件各加入一个等待者
+    std::vector<std::pair<int, FDEventType>> waits;
+    for (auto& item : fds)
+    {
+        for (FDEventType type : {FDEventType::READ, FDEventType::PRI, FDEventType::WRITE, FDEventType::RDHUP})
         {
-            return false;
+            if (item.second & type)
+            {
+                waits.emplace_back(item.first, type);
+            }
         }
-        // 从 m_fd_context_list 中拿对象
-        fd_ctx = m_fd_context_list[fd].get();
     }
-    ScopedLock lock2(&(fd_ctx->m_mutex));
-    if (!(fd_ctx->m_events))
-    { // 不存在监听的事件
-        return false;
+    auto group = std::make_shared<EventWaitGroup>();
+    group->m_fiber = Fiber::GetThis();
+    group->m_thread_id = m_per_worker ? GetThreadID() : -1;
+    group->m_waiter_ids.resize(waits.size(), 0);
+    // 第一个就绪的事件或超时唤醒协程，之后的忽略
+    auto wake = [this, group]() {
+        if (!group->m_woken.exchange(true, std::memory_order_acq_rel))
+        {
+            scheduleInternal(std::move(group->m_fiber), group->m_thread_id);
+        }
+    };
+    long self = GetThreadID();
+    size_t added = 0;
+    for (; added < waits.size(); added++)
+    {
+        int fd = waits[added].first;
+        FDEventType event = waits[added].second;
+        long owner = getOwnerThreadId(fd);
+        if (owner != -1 && owner != self)
+        {
+            // 交给负责 fd 的线程加入，失败时直接唤醒，由调用者重新检查
+            scheduleInlineInternal([this, group, wake, fd, event, index = added]() {
+                FDContext::EventHandler handler;
+                handler.m_scheduler = this;
+                handler.m_callback = std::make_unique<Fiber::FiberFunc>(wake);
+                if (addEventWaiter(fd, event, std::move(handler), &group->m_waiter_ids[index]) == -1)
+                {
+                    wake();
+                }
+            }, owner);
+            continue;
+        }
+        FDContext::EventHandler handler;
+        handler.m_scheduler = this;
+        handler.m_callback = std::make_unique<Fiber::FiberFunc>(wake);
+        if (addEventWaiter(fd, event, std::move(handler), &group->m_waiter_ids[added]) == -1)
+        {
+            break;
+        }
     }
-    // 从 epoll 上移除对该 fd 的监听
-    //    epoll_event epevent{};
-    if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1)
+    int err = errno;
+    bool failed = added != waits.size();
+    TimeoutNode timeout_node;
+    bool has_timeout = timeout_ms != ~0ull;
+    if (!failed)
     {
-        LOG_FMT_ERROR(
-            system_logger,
-            "epoll_ctl 调用失败，epfd = %d",
-            m_epoll_fd);
-        THROW_EXCEPTION_WHIT_ERRNO;
+        if (has_timeout)
+        {
+            armTimeout(timeout_node, std::chrono::milliseconds(timeout_ms), wake);
+        }
+        Fiber::YieldToHold();
     }
-    if (fd_ctx->m_events & FDEventType::READ)
+    else if (group->m_woken.exchange(true, std::memory_order_acq_rel))
     {
-        fd_ctx->triggerEvent(FDEventType::READ);
-        --m_pending_event_count;
+        // 加入失败时不再接受唤醒，已经有其他线程上的等待者唤醒了本协程时，先消耗这次调度
+        Fiber::YieldToHold();
     }
-    if (fd_ctx->m_events & FDEventType::WRITE)
+    bool timed_out = !failed && has_timeout && !timeout_node.cancel();
+    // 移除其余没有被唤醒的等待者，负责其他线程上的 fd 的等待者按加入的顺序在该线程上移除
+    for (size_t i = 0; i < added; i++)
     {
-        fd_ctx->triggerEvent(FDEventType::WRITE);
-        --m_pending_event_count;
+        int fd = waits[i].first;
+        FDEventType event = waits[i].second;
+        long owner = getOwnerThreadId(fd);
+        if (owner != -1 && owner != self)
+        {
+            scheduleInlineInternal([this, group, fd, event, i]() {
+                removeEventWaiter(fd, event, group->m_waiter_ids[i]);
+            }, owner);
+        }
+        else
+        {
+            removeEventWaiter(fd, event, group->m_waiter_ids[i]);
+        }
     }
-    fd_ctx->m_events = FDEventType::NONE;
-    return true;
+    if (failed)
+    {
+        errno = err;
+        return -1;
+    }
+    if (timed_out)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
 }
 
-void IOManager::tickle()
+bool IOManager::removeEventListener(int fd, FDEventType event)
 {
-    if (hasIdleThread())
+    long owner = getOwnerThreadId(fd);
+    if (owner != -1 && owner != GetThreadID())
     {
-        return;
+        // 转交给负责 fd 的线程执行
+        scheduleInlineInternal([this, fd, event]() { removeEventListener(fd, event); }, owner);
+        return true;
     }
-    if (write(m_tickle_fds[1], "T", 1) == -1)
+    FDContext* fd_ctx = m_fd_contexts.get(fd, false);
+    // 要移除的事件不存在，或者已经被触发
+    if (!fd_ctx)
     {
-        throw zjl::SystemError("向子线程发送消息失败");
+        return false;
     }
+    // 轮询器中的注册保持不变，之后到来的边缘没有等待者，会被直接忽略
+    size_t count = fd_ctx->discardEvents(event);
+    m_pending_event_count -= count;
+    return count != 0;
 }
 
-bool IOManager::isStop()
+bool IOManager::cancelEventListener(int fd, FDEventType event)
 {
-    uint64_t timeout;
-    return isStop(timeout);
+    long owner = getOwnerThreadId(fd);
+    if (owner != -1 && owner != GetThreadID())
+    {
+        // 转交给负责 fd 的线程执行，例如在其他线程上到期的超时定时器
+        scheduleInlineInternal([this, fd, event]() { cancelEventListener(fd, event); }, owner);
+        return true;
+    }
+    FDContext* fd_ctx = m_fd_contexts.get(fd, false);
+    // 要取消的事件不存在，或者已经被触发
+    if (!fd_ctx)
+    {
+        return false;
+    }
+    size_t count = fd_ctx->triggerEvents(event, owner);
+    m_pending_event_count -= count;
+    return count != 0;
 }
 
-bool IOManager::isStop(uint64_t& timeout)
+bool IOManager::cancelEventListener(int fd, FDEventType event, uint64_t waiter_id)
 {
-    timeout = getNextTimer();
-    return timeout == ~0ull &&
-        m_pending_event_count == 0 &&
-        Scheduler::isStop();
+    long owner = getOwnerThreadId(fd);
+    if (owner != -1 && owner != GetThreadID())
+    {
+        scheduleInlineInternal([this, fd, event, waiter_id]() { cancelEventListener(fd, event, waiter_id); },
+                               owner);
+        return true;
+    }
+    FDContext* fd_ctx = m_fd_contexts.get(fd, false);
+    FDContext::EventHandler handler;
+    // 等待者已经被唤醒或者移除
+    if (!fd_ctx || !fd_ctx->removeWaiter(event, waiter_id, &handler))
+    {
+        return false;
+    }
+    --m_pending_event_count;
+    FDContext::TriggerHandler(handler, owner, 0);
+    return true;
 }
 
-void IOManager::onIdle()
+bool IOManager::cancelAll(int fd)
 {
-    LOG_DEBUG(system_logger, "调用 IOManager::onIdle()");
-    auto event_list = std::make_unique<epoll_event[]>(64);
+    long owner = getOwnerThreadId(fd);
+    if (owner != -1 && owner != GetThreadID())
+    {
+        // 转交给负责 fd 的线程执行
+        scheduleInlineInternal([this, fd]() { cancelAll(fd); }, owner);
+        return true;
+    }
+    return cancelWaiters(fd) != 0;
+}
 
-    while (true)
+size_t IOManager::cancelWaiters(int fd)
+{
+    FDContext* fd_ctx = m_fd_contexts.get(fd, false);
+    if (!fd_ctx)
     {
-        uint64_t next_timeout = 0;
-        if (isStop(next_timeout))
+        return 0;
+    }
+    // 从轮询器上移除对该 fd 的监听，fd 即将关闭时忽略 fd 已经失效的错误
+    if (fd_ctx->m_registered.exchange(FDEventType::NONE, std::memory_order_acq_rel) != FDEventType::NONE)
+    {
+        fd_ctx->m_ready = FDEventType::NONE;
+        Poller* poller = m_reactors[getOwnerIndex(fd)]->m_poller.get();
+        if (poller->remove(fd) == -1 && errno != ENOENT && errno != EBADF)
         {
-            // 没有等待执行的定时器
-            if (next_timeout == ~0ull)
-            {
-                LOG_FMT_DEBUG(
-                    system_logger, "调度器 %s 已停止执行", m_name.c_str());
-                break;
-            }
+            LOG_FMT_ERROR(
+                system_logger,
+                "%s 移除事件失败，fd = %d, errno = %d, %s",
+                poller->getName(), fd, errno, strerror(errno));
         }
+    }
+    size_t count = fd_ctx->triggerEvents(FDEventType::ALL, getOwnerThreadId(fd));
+    m_pending_event_count -= count;
+    return count;
+}
 
-        int result = 0;
-        while (true)
+size_t IOManager::cancelReactor(Reactor& reactor)
+{
+    // 收集仍在等待事件的 fd
+    std::vector<int> waiting;
+    m_fd_contexts.forEach([this, &reactor, &waiting](FDContext& fd_ctx) {
+        uint32_t events = fd_ctx.m_events.load(std::memory_order_acquire);
+        if (events != FDEventType::NONE && getOwnerIndex(fd_ctx.m_fd) == reactor.m_index)
         {
-            static const int MAX_TIMEOUT = 1000;
-            if (next_timeout != ~0ull)
-            {
-                next_timeout = static_cast<int>(next_timeout) > MAX_TIMEOUT 
-                    ? MAX_TIMEOUT : next_timeout;
-            }
-            else
-            {
-                next_timeout = MAX_TIMEOUT;
-            }
-            // 阻塞等待 epoll 返回结果
-            result = ::epoll_wait(m_epoll_fd, event_list.get(), 64, static_cast<int>(next_timeout));
-            
-            if (result < 0 /*&& errno == EINTR*/)
+            waiting.push_back(fd_ctx.m_fd);
+        }
+    });
+    size_t cancelled = 0;
+    for (int fd : waiting)
+    {
+        cancelled += cancelWaiters(fd);
+    }
+    // 未完成的完成式 IO 请求以 ECANCELED 完成
+    cancelled += reactor.m_poller->cancelAll();
+    return cancelled;
+}
+
+DrainResult IOManager::drain(uint64_t timeout_ms)
+{
+    DrainResult result;
+    uint64_t start = Clock::NowMS();
+    m_draining = true;
+    LOG_FMT_INFO(system_logger, "调度器 %s 开始排空，期限 %ld ms",
+                 m_name.c_str(), static_cast<long>(timeout_ms));
+    // 在本调度器的任务协程中调用时，调用者自身也是一个活跃的任务
+    uint64_t self = (Scheduler::GetThis() == this &&
+                     Fiber::GetFiberID() != 0 &&
+                     Fiber::GetThis().get() != Scheduler::GetMainFiber())
+                        ? 1 : 0;
+    auto drained = [this, self]() {
+        return m_pending_event_count == 0 &&
+               pendingTaskCount() == 0 &&
+               m_active_thread_count <= self;
+    };
+    while (!drained())
+    {
+        if (timeout_ms != ~0ull && Clock::NowMS() - start >= timeout_ms)
+        {
+            result.completed = false;
+            break;
+        }
+        // 在协程中调用时会被 hook 为定时器，不会阻塞工作线程
+        ::usleep(1000);
+    }
+
+    if (!result.completed)
+    {
+        m_drain_cancelled = true;
+        if (!m_per_worker)
+        {
+            result.cancelled_events += cancelReactor(*m_reactors[0]);
+        }
+        else
+        {
+            // 事件循环只能由负责它的线程操作，转交给各个工作线程执行并等待完成。
+            // 主线程只在 stop() 中参与调度，它负责的事件循环直接在当前线程上取消
+            auto remaining = std::make_shared<std::atomic_size_t>(0);
+            auto cancelled = std::make_shared<std::atomic_size_t>(0);
+            for (size_t i = 0; i < m_owner_count; i++)
             {
-                // TODO 处理 epoll_wait 异常
+                Reactor* reactor = m_reactors[i].get();
+                long thread_id = getWorkerThreadId(i);
+                if (thread_id == GetThreadID() || thread_id == m_root_thread_id)
+                {
+                    result.cancelled_events += cancelReactor(*reactor);
+                    continue;
+                }
+                ++*remaining;
+                scheduleInlineInternal(
+                    [this, reactor, remaining, cancelled]() {
+                        *cancelled += cancelReactor(*reactor);
+                        --*remaining;
+                    },
+                    thread_id);
             }
-            if (result >= 0)
+            while (*remaining > 0)
             {
-                break;
+                ::usleep(1000);
             }
+            result.cancelled_events += *cancelled;
         }
-        
-        // 处理定时器
-        std::vector<std::function<void()>> fns;
-        listExpiredCallback(fns);
+        // 单次定时器提前触发，周期定时器直接丢弃
+        std::vector<Timer::TimerFunc> fns;
+        result.cancelled_timers = listAllCallback(fns);
         if (!fns.empty())
         {
-            schedule(fns.begin(), fns.end());
+            scheduleInternal(fns.begin(), fns.end());
         }
+        result.pending_tasks = pendingTaskCount();
+    }
+    result.elapsed_ms = Clock::NowMS() - start;
 
-        // 遍历 event_list 处理被触发事件的 fd
-        for (int i = 0; i < result; i++)
-        {
-            epoll_event& ev = event_list[i];
-            // 接收到来自主线程的消息
-            if (ev.data.fd == m_tickle_fds[0])
-            {
+    if (result.completed)
+    {
+        LOG_FMT_INFO(system_logger, "调度器 %s 排空完成，耗时 %lu ms",
+                     m_name.c_str(), result.elapsed_ms);
+    }
+    else
+    {
+        LOG_FMT_WARN(system_logger,
+                     "调度器 %s 排空超时，耗时 %lu ms，取消 IO 事件 %zu 个，取消定时器 %zu 个，剩余任务 %zu 个",
+                     m_name.c_str(), result.elapsed_ms, result.cancelled_events,
+                     result.cancelled_timers, result.pending_tasks);
+    }
+    return result;
+}
+
+uint64_t IOManager::getPollerCtlCount() const
+{
+    uint64_t count = 0;
+    for (auto& reactor : m_reactors)
+    {
+        count += reactor->m_poller->getCtlCount();
+    }
+    return count;
+}
+
+uint64_t IOManager::getPollerWaitCount() const
+{
+    uint64_t count = 0;
+    for (auto& reactor : m_reactors)
+    {
+        count += reactor->m_poller->getWaitCount();
+    }
+    return count;
+}
+
+ssize_t IOManager::submitAndWait(IORequest& request)
+{
+    if (m_drain_cancelled)
+    {
+        errno = ECANCELED;
+        return -1;
+    }
+    request.m_fiber = Fiber::GetThis();
+    ++m_pending_event_count;
+    // 请求由当前线程的事件循环收割，独占事件循环时协程也在当前线程上恢复执行
+    if (!getCurrentReactor().m_poller->submit(&request))
+    {
+        --m_pending_event_count;
+        request.m_fiber.reset();
+        errno = EAGAIN;
+        return -1;
+    }
+    // 请求在下一轮事件循环中批量提交，完成后由 onIdle 重新调度本协程
+    Fiber::YieldToHold();
+    if (request.m_result >= 0)
+    {
+        return request.m_result;
+    }
+    errno = -request.m_result;
+    // 链接的超时请求到期后，IO 请求以 ECANCELED 完成
+    if (errno == ECANCELED && request.m_timeout_ms != ~0ull && !m_drain_cancelled)
+    {
+        errno = ETIMEDOUT;
+    }
+    return -1;
+}
+
+bool IOManager::canSuspend() const
+{
+    return Scheduler::GetThis() == this && Fiber::GetFiberID() != 0 &&
+           Fiber::GetThis().get() != Scheduler::GetMainFiber() &&
+           !Scheduler::IsRunningInlineTask();
+}
+
+ssize_t IOManager::submitFileIO(IORequest& request)
+{
+    if (!canSuspend())
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (isCompletionBased())
+    {
+        ssize_t rt = submitAndWait(request);
+        // 提交队列已满时交给线程池
+        if (rt != -1 || errno != EAGAIN)
+        {
+            return rt;
+        }
+    }
+    if (m_drain_cancelled)
+    {
+        errno = ECANCELED;
+        return -1;
+    }
+    {
+        ScopedLock lock(&m_file_io_mutex);
+        if (m_file_io_threads.empty())
+        {
+            int count = std::max(g_file_io_threads->getValue(), 1);
+            for (int i = 0; i < count; i++)
+            {
+                m_file_io_threads.push_back(std::make_shared<Thread>(
+                    [this]() { runFileIO(); }, m_name + "_file_io_" + std::to_string(i)));
+            }
+        }
+        request.m_fiber = Fiber::GetThis();
+        ++m_pending_event_count;
+        m_file_io_queue.push_back(&request);
+    }
+    m_file_io_sem.notify();
+    // 线程池执行完毕后重新调度本协程
+    Fiber::YieldToHold();
+    if (request.m_result >= 0)
+    {
+        return request.m_result;
+    }
+    errno = -request.m_result;
+    return -1;
+}
+
+void IOManager::runFileIO()
+{
+    while (true)
+    {
+        m_file_io_sem.wait();
+        IORequest* request = nullptr;
+        {
+            ScopedLock lock(&m_file_io_mutex);
+            if (m_file_io_queue.empty())
+            {
+                if (m_file_io_stopping)
+                {
+                    break;
+                }
+                continue;
+            }
+            request = m_file_io_queue.front();
+            m_file_io_queue.pop_front();
+        }
+        // 线程池的线程没有开启 hook，直接执行阻塞的系统调用
+        ssize_t rt = -1;
+        switch (request->m_opcode)
+        {
+            case IORequest::READ:
+                rt = request->m_offset < 0
+                    ? ::read(request->m_fd, request->m_addr, request->m_len)
+                    : ::pread(request->m_fd, request->m_addr, request->m_len, request->m_offset);
+                break;
+            case IORequest::WRITE:
+                rt = request->m_offset < 0
+                    ? ::write(request->m_fd, request->m_addr, request->m_len)
+                    : ::pwrite(request->m_fd, request->m_addr, request->m_len, request->m_offset);
+                break;
+            case IORequest::READV:
+                rt = request->m_offset < 0
+                    ? ::readv(request->m_fd, static_cast<const iovec*>(request->m_addr),
+                              static_cast<int>(request->m_len))
+                    : ::preadv(request->m_fd, static_cast<const iovec*>(request->m_addr),
+                               static_cast<int>(request->m_len), request->m_offset);
+                break;
+            case IORequest::WRITEV:
+                rt = request->m_offset < 0
+                    ? ::writev(request->m_fd, static_cast<const iovec*>(request->m_addr),
+                               static_cast<int>(request->m_len))
+                    : ::pwritev(request->m_fd, static_cast<const iovec*>(request->m_addr),
+                                static_cast<int>(request->m_len), request->m_offset);
+                break;
+            case IORequest::FSYNC:
+                rt = request->m_flags ? ::fdatasync(request->m_fd) : ::fsync(request->m_fd);
+                break;
+            default:
+                errno = EINVAL;
+                break;
+        }
+        request->m_result = rt < 0 ? -errno : static_cast<int>(rt);
+        // 请求对象位于协程栈上，调度之后不可再访问
+        // 先调度再减少计数，避免 stopping() 在协程入队之前认为已经没有待处理的事件
+        Fiber::ptr fiber = std::move(request->m_fiber);
+        if (m_latency_stats)
+        {
+            fiber->setReadyTime(Clock::NowUS());
+        }
+        scheduleInternal(std::move(fiber));
+        --m_pending_event_count;
+    }
+}
+
+void IOManager::tickle()
+{
+    // 没有阻塞在 epoll_wait 上的空闲线程，忙碌的线程处理完当前任务后会自行取任务
+    if (!hasIdleThread())
+    {
+        return;
+    }
+    // 独占事件循环时不知道任务绑定在哪条线程上，唤醒所有空闲的工作线程
+    for (auto& reactor : m_reactors)
+    {
+        if (m_per_worker && !reactor->m_idle)
+        {
+            continue;
+        }
+        wakeReactor(*reactor);
+    }
+}
+
+void IOManager::tickleWorker(size_t worker_index)
+{
+    if (!m_per_worker)
+    {
+        tickle();
+        return;
+    }
+    Reactor& reactor = *m_reactors[worker_index];
+    if (reactor.m_idle)
+    {
+        wakeReactor(reactor);
+    }
+}
+
+void IOManager::wakeReactor(Reactor& reactor)
+{
+    // 有线程正在忙轮询时只需设置唤醒标志。先写标志再检查忙轮询的线程数量，
+    // 与 busyPoll 退出时的顺序相反，两者至少有一方能看到对方
+    if (reactor.m_spinning.load() > 0)
+    {
+        reactor.m_wakeup.store(true);
+        if (reactor.m_spinning.load() > 0)
+        {
+            reactor.m_tickles_saved.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    // 内部使用的 fd 直接调用系统函数，不经过 hook，不受同一个数字上残留的登记影响
+    if (write_f(reactor.m_tickle_fds[1], "T", 1) == -1)
+    {
+        throw zjl::SystemError("向子线程发送消息失败");
+    }
+}
+
+bool IOManager::isStop()
+{
+    uint64_t timeout;
+    return isStop(timeout);
+}
+
+bool IOManager::isStop(uint64_t& timeout)
+{
+    timeout = getNextTimer();
+    if (!m_per_worker)
+    {
+        return timeout == ~0ull &&
+            m_pending_event_count == 0 &&
+            Scheduler::isStop();
+    }
+    if (timeout != ~0ull || m_pending_event_count != 0)
+    {
+        return false;
+    }
+    // 独占事件循环时，其他工作线程仍在执行任务或分发事件，就可能产生绑定到本线程的任务，
+    // 本线程提前退出会让这些任务永远得不到执行，因此要等所有工作线程都空闲下来
+    for (auto& reactor : m_reactors)
+    {
+        if (!reactor->m_idle)
+        {
+            return false;
+        }
+    }
+    // 再次检查定时器，排除检查期间执行完毕的任务新添加的定时器
+    return Scheduler::isStop() && getNextTimer() == ~0ull;
+}
+
+ReactorStats IOManager::getReactorStats(size_t index) const
+{
+    const Reactor& reactor = *m_reactors[index];
+    ReactorStats stats;
+    stats.loops = reactor.m_loop_count.load(std::memory_order_relaxed);
+    stats.events = reactor.m_event_count.load(std::memory_order_relaxed);
+    stats.full_batches = reactor.m_full_batch_count.load(std::memory_order_relaxed);
+    stats.batch_size = reactor.m_batch_size.load(std::memory_order_relaxed);
+    stats.busy_poll_us = reactor.m_busy_poll_time_us.load(std::memory_order_relaxed);
+    stats.busy_poll_hits = reactor.m_busy_poll_hits.load(std::memory_order_relaxed);
+    stats.busy_poll_misses = reactor.m_busy_poll_misses.load(std::memory_order_relaxed);
+    stats.tickles_saved = reactor.m_tickles_saved.load(std::memory_order_relaxed);
+    return stats;
+}
+
+LatencyStats IOManager::getLatencyStats() const
+{
+    LatencyStats stats;
+    stats.poll_wait_us = m_poll_wait_hist.snapshot();
+    stats.events_per_wakeup = m_events_hist.snapshot();
+    stats.resume_latency_us = m_resume_hist.snapshot();
+    // 定时器的到期延迟由 TimerManager 记录
+    stats.timer_lateness_us = getTimerStats().lateness_us;
+    stats.loop_duration_us = m_loop_hist.snapshot();
+    return stats;
+}
+
+void IOManager::resetLatencyStats()
+{
+    m_poll_wait_hist.reset();
+    m_events_hist.reset();
+    m_resume_hist.reset();
+    resetTimerStats();
+    m_loop_hist.reset();
+}
+
+void IOManager::setupSocket(int fd)
+{
+    int busy_poll_us = m_busy_poll_cache.load(std::memory_order_relaxed);
+    if (!g_socket_busy_poll->getValue() || busy_poll_us <= 0)
+    {
+        return;
+    }
+    // 超过 net.core.busy_read 的值需要 CAP_NET_ADMIN，失败时不影响 socket 的使用
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) == -1)
+    {
+        LOG_FMT_DEBUG(system_logger, "fd = %d 设置 SO_BUSY_POLL 失败，errno = %d, %s",
+                      fd, errno, strerror(errno));
+        return;
+    }
+    int prefer = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == -1)
+    {
+        LOG_FMT_DEBUG(system_logger, "fd = %d 设置 SO_PREFER_BUSY_POLL 失败，errno = %d, %s",
+                      fd, errno, strerror(errno));
+    }
+}
+
+bool IOManager::busyPoll(Reactor& reactor, epoll_event* event_list, int max_events,
+                         uint64_t timeout_ms, int& result)
+{
+    int busy_poll_us = m_busy_poll_cache.load(std::memory_order_relaxed);
+    if (busy_poll_us <= 0 || timeout_ms == 0)
+    {
+        return false;
+    }
+    uint64_t budget_us = std::min<uint64_t>(static_cast<uint64_t>(busy_poll_us), timeout_ms * 1000);
+    uint64_t begin = Clock::NowUS();
+    uint64_t now = begin;
+    bool found = false;
+    reactor.m_spinning.fetch_add(1);
+    while (true)
+    {
+        result = reactor.m_poller->wait(event_list, max_events, 0);
+        if (result > 0 ||
+            (reactor.m_wakeup.load(std::memory_order_relaxed) && reactor.m_wakeup.exchange(false)))
+        {
+            found = true;
+            break;
+        }
+        now = Clock::NowUS();
+        if (now - begin >= budget_us)
+        {
+            break;
+        }
+    }
+    reactor.m_spinning.fetch_sub(1);
+    // 退出忙轮询之后再检查一次，tickle 可能在看到本线程仍在忙轮询之后才放弃写管道
+    if (!found && reactor.m_wakeup.exchange(false))
+    {
+        found = true;
+    }
+    if (found)
+    {
+        now = Clock::NowUS();
+        reactor.m_busy_poll_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        reactor.m_busy_poll_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+    reactor.m_busy_poll_time_us.fetch_add(now - begin, std::memory_order_relaxed);
+    result = std::max(result, 0);
+    return found;
+}
+
+void IOManager::adjustBatchSize(Reactor& reactor, size_t ready_count)
+{
+    size_t batch_size = reactor.m_batch_size.load(std::memory_order_relaxed);
+    size_t limit = static_cast<size_t>(std::max(g_max_events_limit->getValue(), 1));
+    size_t configured = std::min(static_cast<size_t>(std::max(GetConfigValue(m_max_events, g_max_events), 1)), limit);
+    size_t new_size = std::max(batch_size, configured);
+    // 只有持续的高负载才扩大批次，偶然一次填满不值得
+    static const size_t GROW_STREAK = 2;
+    if (batch_size != 0 && ready_count >= batch_size)
+    {
+        reactor.m_full_batch_count.fetch_add(1, std::memory_order_relaxed);
+        if (++reactor.m_full_streak >= GROW_STREAK && batch_size < limit)
+        {
+            new_size = std::min(batch_size * 2, limit);
+            reactor.m_full_streak = 0;
+            LOG_FMT_DEBUG(system_logger, "调度器 %s 的事件循环 %zu 的批次扩大到 %zu",
+                          m_name.c_str(), reactor.m_index, new_size);
+        }
+    }
+    else
+    {
+        reactor.m_full_streak = 0;
+    }
+    if (new_size != batch_size)
+    {
+        reactor.m_batch_size.store(new_size, std::memory_order_relaxed);
+    }
+}
+
+void IOManager::onIdle()
+{
+    LOG_DEBUG(system_logger, "调用 IOManager::onIdle()");
+    std::vector<IORequest*> completions;
+    // 共享事件循环时多个工作线程同时轮询，就绪事件缓冲区属于各自的空闲协程
+    std::vector<epoll_event> event_buffer;
+    Reactor& reactor = getCurrentReactor();
+    Poller* poller = reactor.m_poller.get();
+    // 独占事件循环时，被唤醒的协程绑定在当前线程上执行
+    long thread_id = m_per_worker ? GetThreadID() : -1;
+    // 上一次轮询返回的时间，用于统计事件循环迭代的时间
+    uint64_t wake_us = 0;
+
+    while (true)
+    {
+        reactor.m_idle = true;
+        uint64_t next_timeout = 0;
+        if (isStop(next_timeout))
+        {
+            // 没有等待执行的定时器
+            if (next_timeout == ~0ull)
+            {
+                LOG_FMT_DEBUG(
+                    system_logger, "调度器 %s 已停止执行", m_name.c_str());
+                // 共享事件循环时一次唤醒只让一个线程返回，依次唤醒其他仍在轮询的线程
+                if (!m_per_worker)
+                {
+                    tickle();
+                }
+                break;
+            }
+        }
+        // 只等待本事件循环负责的定时器分片
+        next_timeout = getReactorTimeout(reactor);
+        // 定时器到期时 timerfd 会唤醒事件循环，轮询超时只用于定期检查停止条件
+        if (reactor.m_timer_fd != -1 && next_timeout != 0)
+        {
+            next_timeout = ~0ull;
+        }
+
+        // 独占事件循环时只有本线程空闲才会被唤醒，标记空闲之前加入的任务不会再唤醒本线程，
+        // 与加入任务后检查空闲标志的顺序相反，两者至少有一方能看到对方
+        if (m_per_worker && hasRunnableTask())
+        {
+            next_timeout = 0;
+        }
+
+        if (wake_us != 0)
+        {
+            m_loop_hist.record(Clock::NowUS() - wake_us);
+        }
+
+        int result = 0;
+        event_buffer.resize(reactor.m_batch_size.load(std::memory_order_relaxed));
+        epoll_event* event_list = event_buffer.data();
+        int batch_size = static_cast<int>(event_buffer.size());
+        while (true)
+        {
+            const int MAX_TIMEOUT = GetConfigValue(m_max_timeout_ms, g_max_timeout_ms);
+            if (next_timeout != ~0ull)
+            {
+                next_timeout = static_cast<int>(next_timeout) > MAX_TIMEOUT 
+                    ? MAX_TIMEOUT : next_timeout;
+            }
+            else
+            {
+                next_timeout = MAX_TIMEOUT;
+            }
+            // 忙轮询取得了事件或者收到了唤醒，不再阻塞
+            if (busyPoll(reactor, event_list, batch_size, next_timeout, result))
+            {
+                break;
+            }
+            // 阻塞等待 epoll 返回结果
+            uint64_t wait_begin = m_latency_stats ? Clock::NowUS() : 0;
+            result = poller->wait(event_list, batch_size, static_cast<int>(next_timeout));
+            if (m_latency_stats)
+            {
+                m_poll_wait_hist.record(Clock::NowUS() - wait_begin);
+            }
+            
+            if (result < 0 /*&& errno == EINTR*/)
+            {
+                // TODO 处理 epoll_wait 异常
+            }
+            if (result >= 0)
+            {
+                break;
+            }
+        }
+        
+        // 接下来调度的任务由本线程处理，不需要再被唤醒
+        reactor.m_idle = false;
+        reactor.m_loop_count.fetch_add(1, std::memory_order_relaxed);
+        reactor.m_event_count.fetch_add(result, std::memory_order_relaxed);
+        // 缓存本轮唤醒的时间，处理定时器、设置 timerfd 与统计延迟时不再读取时钟
+        uint64_t now_us = Clock::UpdateCachedUS();
+        if (m_latency_stats)
+        {
+            wake_us = now_us;
+            m_events_hist.record(static_cast<uint64_t>(result));
+        }
+
+        // 唤醒完成式 IO 请求已经完成的协程，请求对象位于协程栈上，调度之后不可再访问
+        completions.clear();
+        poller->reap(completions);
+        for (IORequest* request : completions)
+        {
+            Fiber::ptr fiber = std::move(request->m_fiber);
+            if (wake_us != 0)
+            {
+                fiber->setReadyTime(wake_us);
+            }
+            --m_pending_event_count;
+            scheduleInternal(std::move(fiber), thread_id);
+        }
+
+        // 处理本事件循环负责的定时器分片，没有到期的分片不加锁
+        std::vector<Timer::TimerFunc> fns;
+        for (size_t shard = reactor.m_index; shard < getTimerShardCount(); shard += m_reactors.size())
+        {
+            listExpiredCallback(shard, fns);
+        }
+        bool timer_expired = !fns.empty();
+        if (timer_expired)
+        {
+            scheduleInternal(fns.begin(), fns.end());
+        }
+        bool timer_fired = false;
+
+        // 遍历 event_list 处理被触发事件的 fd
+        for (int i = 0; i < result; i++)
+        {
+            epoll_event& ev = event_list[i];
+            // 接收到来自主线程的消息
+            if (ev.data.ptr == reactor.m_tickle_fds)
+            {
                 char dummy;
                 // 将来自主线程的数据读取干净
                 while (true)
                 {
-                    int status = read(ev.data.fd, &dummy, 1);
+                    int status = read_f(reactor.m_tickle_fds[0], &dummy, 1);
                     if (status == 0 || status == -1)
                         break;
                 }
                 continue;
             }
-            // 处理非主线程的消息
-            auto fd_ctx = static_cast<FDContext*>(ev.data.ptr);
-            ScopedLock lock(&fd_ctx->m_mutex);
-            // 该事件的 fd 出现错误或者已经失效
-            if (ev.events & (EPOLLERR | EPOLLHUP))
-            {
-                ev.events |= EPOLLIN | EPOLLOUT;
-            }
-            uint32_t real_events = FDEventType::NONE;
-            if (ev.events & EPOLLIN)
+            // 定时器到期，下面重新设置 timerfd 之后再处理
+            if (ev.data.ptr == &reactor.m_timer_fd)
             {
-                real_events |= FDEventType::READ;
+                uint64_t ticks;
+                while (read_f(reactor.m_timer_fd, &ticks, sizeof(ticks)) > 0)
+                {
+                }
+                timer_fired = true;
+                continue;
             }
-            if (ev.events & EPOLLOUT)
+            if (ev.data.ptr == &m_signal_fd)
             {
-                real_events |= FDEventType::WRITE;
+                dispatchSignals();
+                continue;
             }
-            // fd_ctx 中指定监听的事件都已经被触发并处理
-            if ((fd_ctx->m_events & real_events) == FDEventType::NONE)
+            // 处理非主线程的消息
+            auto fd_ctx = static_cast<FDContext*>(ev.data.ptr);
+            // FDEventType 的取值与 epoll 事件相同
+            uint32_t real_events = ev.events & FDEventType::ALL;
+            // 该事件的 fd 出现错误或者已经失效，唤醒所有等待者
+            if (ev.events & (EPOLLERR | EPOLLHUP))
             {
-                continue;
+                real_events = FDEventType::ALL;
             }
-            // 从 epoll 中移除这个 fd 的被触发的事件的监听
-            uint32_t left_events = (fd_ctx->m_events & ~real_events);
-            int op = left_events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
-            ev.events = EPOLLET | left_events;
-            int rt = ::epoll_ctl(m_epoll_fd, op, fd_ctx->m_fd, &ev);
-            // epoll 事件修改失败，打印一条 ERROR 日志，不做任何处理
-            if (rt == -1)
+            // 对端关闭写端，读者会立即读到 EOF
+            if (ev.events & EPOLLRDHUP)
             {
-                LOG_FMT_ERROR(
-                    system_logger,
-                    "epoll_ctl(%d, %d, %d, %ul) : return %d, errno = %d, %s",
-                    m_epoll_fd, op, fd_ctx->m_fd, ev.events, rt, errno, strerror(errno));
+                real_events |= FDEventType::READ;
             }
-            // 触发该 fd 对应的事件的处理器
-            if (real_events & FDEventType::READ)
+            // 认领就绪且有等待者的事件，轮询器中的注册保持不变。没有等待者的事件（包括 EPOLLERR/EPOLLHUP
+            // 额外置上的）在普通注册下直接忽略，下次等待时由 addEventListener 重新激活边缘触发；
+            // 常驻注册则记录在 m_ready 中，由之后的等待者消费
+            FDContext::Waiters waiters;
+            if (m_persistent)
             {
-                fd_ctx->triggerEvent(FDEventType::READ);
-                --m_pending_event_count;
+                // 先记录就绪状态再认领等待者，与 addEventListener 的顺序相反。
+                // 认领之后不清除 m_ready：认领取的是某一时刻的快照，之后加入 m_rest 的等待者只能靠 m_ready
+                // 发现这次边缘；多保留的就绪状态最多让下一个等待者白跑一次，重新执行 IO 得到 EAGAIN 后再等待
+                fd_ctx->m_ready.fetch_or(real_events);
+                fd_ctx->claimEvents(real_events, waiters);
             }
-            if (real_events & FDEventType::WRITE)
+            else
             {
-                fd_ctx->triggerEvent(FDEventType::WRITE);
-                --m_pending_event_count;
+                fd_ctx->claimEvents(real_events, waiters);
             }
+            // 唤醒该 fd 上就绪事件的全部等待者
+            m_pending_event_count -= FDContext::TriggerWaiters(waiters, thread_id, wake_us);
+        }
+        // 就绪事件全部处理完之后才能调整缓冲区
+        adjustBatchSize(reactor, static_cast<size_t>(result));
+        // 最早的定时器被取出或者 timerfd 到期时，重新设置下一个到期时间
+        if (reactor.m_timer_fd != -1 && (timer_fired || timer_expired))
+        {
+            armTimer(reactor, timer_fired);
         }
+        // 协程中添加的定时器要读取最新的时间，让出执行权之前清除缓存
+        Clock::ClearCachedUS();
         // 让出当前线程的执行权，给调度器执行排队等待的协程
         // Fiber::YieldToHold();
         Fiber::ptr current_fiber = Fiber::GetThis();
@@ -446,9 +1392,295 @@ void IOManager::onIdle()
     }
 }
 
-void IOManager::onTimerInsertedAtFirst()
+void IOManager::onTimerInsertedAtFirst(size_t shard)
+{
+    Reactor& reactor = *m_reactors[shard % m_reactors.size()];
+    // 使用 timerfd 时只需要提前到期时间，不必唤醒阻塞在轮询上的线程
+    if (reactor.m_timer_fd != -1)
+    {
+        armTimer(reactor);
+        return;
+    }
+    // 先发布新的到期时间再检查是否空闲，与事件循环先标记空闲再计算等待时间的顺序相反
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // 忙碌的线程在下一次轮询之前会重新计算等待时间
+    if (!hasIdleThread() || (m_per_worker && !reactor.m_idle))
+    {
+        return;
+    }
+    wakeReactor(reactor);
+}
+
+size_t IOManager::getCurrentTimerShard() const
+{
+    size_t count = getTimerShardCount();
+    if (count == 1)
+    {
+        return 0;
+    }
+    int index = GetWorkerIndex();
+    if (index >= 0 && Scheduler::GetThis() == this)
+    {
+        return static_cast<size_t>(index) % count;
+    }
+    // 外部线程依次分配到各个分片上
+    static std::atomic_size_t s_next_shard{0};
+    static thread_local size_t t_shard = s_next_shard.fetch_add(1, std::memory_order_relaxed);
+    return t_shard % count;
+}
+
+uint64_t IOManager::getReactorTimeout(const Reactor& reactor)
+{
+    uint64_t timeout = ~0ull;
+    for (size_t shard = reactor.m_index; shard < getTimerShardCount(); shard += m_reactors.size())
+    {
+        timeout = std::min(timeout, getNextTimer(shard));
+    }
+    return timeout;
+}
+
+uint64_t IOManager::getReactorDeadline(const Reactor& reactor)
+{
+    uint64_t deadline = ~0ull;
+    for (size_t shard = reactor.m_index; shard < getTimerShardCount(); shard += m_reactors.size())
+    {
+        deadline = std::min(deadline, getNextDeadline(shard));
+    }
+    return deadline;
+}
+
+void IOManager::onFiberResume(uint64_t latency_us)
+{
+    m_resume_hist.record(latency_us);
+}
+
+void IOManager::armTimer(Reactor& reactor, bool fired)
+{
+    ScopedLock lock(&reactor.m_timer_mutex);
+    if (fired)
+    {
+        reactor.m_timer_armed = ~0ull;
+    }
+    // 在锁内读取最早的到期时间，并发设置时最后一次设置的总是最新的结果。
+    // 没有定时器时不必停止 timerfd，多余的一次到期只会让事件循环空转一轮
+    uint64_t deadline = getReactorDeadline(reactor);
+    if (deadline >= reactor.m_timer_armed)
+    {
+        return;
+    }
+    itimerspec spec{};
+    spec.it_value.tv_sec = static_cast<time_t>(deadline / 1000000);
+    spec.it_value.tv_nsec = static_cast<long>(deadline % 1000000 * 1000);
+    // 到期时间已经过去时立即到期
+    if (::timerfd_settime(reactor.m_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1)
+    {
+        LOG_FMT_ERROR(system_logger, "timerfd_settime 失败，errno = %d, %s", errno, strerror(errno));
+        return;
+    }
+    reactor.m_timer_armed = deadline;
+}
+
+int IOManager::addSignalHandler(int signo, SignalHandler handler)
+{
+    // 时间片信号由协程抢占使用，不能交给 signalfd
+    if (signo <= 0 || signo >= NSIG || !handler || signo == Fiber::GetPreemptSignal())
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    sigset_t signal;
+    sigemptyset(&signal);
+    sigaddset(&signal, signo);
+    // 先屏蔽信号，之后到达的信号保持挂起，由 signalfd 读出。等待工作线程时不能持有 m_signal_mutex，
+    // 否则正在分发信号的工作线程会阻塞在锁上，无法执行屏蔽信号的任务
+    blockSignals(signal);
+    ScopedLock lock(&m_signal_mutex);
+    sigset_t mask = m_signal_mask;
+    sigaddset(&mask, signo);
+    int fd = ::signalfd(m_signal_fd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1)
+    {
+        LOG_FMT_ERROR(system_logger, "signalfd 失败，signo = %d, errno = %d, %s",
+                      signo, errno, strerror(errno));
+        return -1;
+    }
+    if (m_signal_fd == -1)
+    {
+        // 与每个事件循环各有一个的 timerfd 不同，signalfd 只有一个，同一个 fd 加入所有的事件循环；
+        // 有多个事件循环时以 EPOLLEXCLUSIVE 注册，信号到来时只唤醒其中一个，由它读出并分发全部信号
+        uint32_t events = EPOLLIN | EPOLLET | (m_reactors.size() > 1 ? static_cast<uint32_t>(EPOLLEXCLUSIVE) : 0u);
+        for (auto& reactor : m_reactors)
+        {
+            if (reactor->m_poller->add(fd, events, &m_signal_fd) == -1)
+            {
+                int err = errno;
+                LOG_FMT_ERROR(system_logger, "signalfd 加入轮询器失败，errno = %d, %s",
+                              err, strerror(err));
+                for (auto& added : m_reactors)
+                {
+                    if (added == reactor)
+                    {
+                        break;
+                    }
+                    added->m_poller->remove(fd);
+                }
+                close(fd);
+                errno = err;
+                return -1;
+            }
+        }
+        m_signal_fd = fd;
+    }
+    m_signal_mask = mask;
+    m_signal_handlers[signo] = std::make_shared<SignalHandler>(std::move(handler));
+    return 0;
+}
+
+bool IOManager::removeSignalHandler(int signo)
+{
+    ScopedLock lock(&m_signal_mutex);
+    if (!m_signal_handlers.erase(signo))
+    {
+        return false;
+    }
+    sigdelset(&m_signal_mask, signo);
+    ::signalfd(m_signal_fd, &m_signal_mask, 0);
+    return true;
+}
+
+void IOManager::blockSignals(const sigset_t& mask)
+{
+    // 已有的协程在下一次换入时屏蔽，之后创建的协程从创建线程继承
+    Fiber::BlockSignals(mask);
+    // 调度器尚未启动或者已经停止时，工作线程不会再执行任务
+    if (m_stopping)
+    {
+        return;
+    }
+    long self = GetThreadID();
+    bool from_worker = false;
+    std::vector<long> others;
+    // 线程池的线程可能刚刚启动，等待它们登记线程 id
+    waitForWorkers();
+    for (size_t i = 0; i < m_worker_count; i++)
+    {
+        long thread_id = getWorkerThreadId(i);
+        if (thread_id == self)
+        {
+            from_worker = true;
+            continue;
+        }
+        others.push_back(thread_id);
+    }
+    auto pending = std::make_shared<std::atomic_size_t>(others.size());
+    for (long thread_id : others)
+    {
+        // 执行内联任务会切换到调度协程，切换时恢复的屏蔽字已经包含了这些信号
+        scheduleInlineInternal([pending]() { --*pending; }, thread_id);
+    }
+    // 主线程参与调度时只在 stop() 中执行任务，不能等待它；工作线程之间互相等待可能死锁，也不等待
+    if (from_worker)
+    {
+        return;
+    }
+    size_t skipped = std::count(others.begin(), others.end(), m_root_thread_id);
+    while (*pending > skipped)
+    {
+        ::usleep(100);
+    }
+}
+
+void IOManager::dispatchSignals()
+{
+    signalfd_siginfo infos[16];
+    while (true)
+    {
+        ssize_t n = read_f(m_signal_fd, infos, sizeof(infos));
+        if (n <= 0)
+        {
+            break;
+        }
+        size_t count = static_cast<size_t>(n) / sizeof(signalfd_siginfo);
+        for (size_t i = 0; i < count; i++)
+        {
+            std::shared_ptr<SignalHandler> handler;
+            {
+                ScopedLock lock(&m_signal_mutex);
+                auto iter = m_signal_handlers.find(static_cast<int>(infos[i].ssi_signo));
+                if (iter == m_signal_handlers.end())
+                {
+                    continue;
+                }
+                handler = iter->second;
+            }
+            // 处理器可以被多次触发，以共享的方式交给调度器，与周期定时器相同
+            scheduleInternal([handler, info = infos[i]]() { (*handler)(info); });
+        }
+    }
+}
+
+/**
+ * ===================================================
+ * FDContextTable 类的实现
+ * ===================================================
+*/
+
+FDContextTable::FDContextTable()
+    : m_segments(new std::atomic<FDContext*>[MAX_SEGMENTS])
+{
+    for (size_t i = 0; i < MAX_SEGMENTS; i++)
+    {
+        m_segments[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+FDContextTable::~FDContextTable()
+{
+    for (size_t i = 0; i < MAX_SEGMENTS; i++)
+    {
+        delete[] m_segments[i].load(std::memory_order_relaxed);
+    }
+}
+
+FDContext* FDContextTable::get(int fd, bool auto_create)
 {
-    tickle();
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    size_t index = static_cast<size_t>(fd) >> SEGMENT_BITS;
+    if (index >= MAX_SEGMENTS)
+    {
+        return nullptr;
+    }
+    FDContext* segment = m_segments[index].load(std::memory_order_acquire);
+    if (!segment)
+    {
+        if (!auto_create)
+        {
+            return nullptr;
+        }
+        // 多个线程同时分配同一段时，只有一个能发布成功，其余的释放自己分配的段
+        auto fresh = new FDContext[SEGMENT_SIZE];
+        for (size_t i = 0; i < SEGMENT_SIZE; i++)
+        {
+            fresh[i].m_fd = static_cast<int>((index << SEGMENT_BITS) + i);
+        }
+        if (m_segments[index].compare_exchange_strong(segment, fresh, std::memory_order_acq_rel))
+        {
+            segment = fresh;
+            size_t count = m_segment_count.load(std::memory_order_relaxed);
+            while (count < index + 1 &&
+                   !m_segment_count.compare_exchange_weak(count, index + 1, std::memory_order_release))
+            {
+            }
+        }
+        else
+        {
+            delete[] fresh;
+        }
+    }
+    return &segment[static_cast<size_t>(fd) & (SEGMENT_SIZE - 1)];
 }
 
 /**
@@ -457,47 +1689,272 @@ void IOManager::onTimerInsertedAtFirst()
  * ===================================================
 */
 
-FDContext::EventHandler&
-FDContext::getEventHandler(FDEventType type)
+FDContext::~FDContext()
+{
+    delete m_overflow.load(std::memory_order_relaxed);
+}
+
+size_t FDContext::EventIndex(FDEventType type)
 {
     switch (type)
     {
         case FDEventType::READ:
-            return m_read_handler;
+            return 0;
+        case FDEventType::PRI:
+            return 1;
         case FDEventType::WRITE:
-            return m_write_handler;
+            return 2;
+        case FDEventType::RDHUP:
+            return 3;
         default:
             assert(0);
+            return 0;
     }
 }
 
-void FDContext::resetHandler(FDContext::EventHandler& handler)
+void FDContext::ResetHandler(FDContext::EventHandler& handler)
 {
     handler.m_fiber.reset();
-    handler.m_callback = nullptr;
+    handler.m_callback.reset();
     handler.m_scheduler = nullptr;
+    handler.m_id = 0;
 }
 
-void FDContext::triggerEvent(FDEventType type)
+void FDContext::TriggerHandler(FDContext::EventHandler& handler, long thread_id, uint64_t ready_us)
 {
     /**
-     * NOTE: 调用调度器的 schedule 方法时，传参使用了 move 语义，等于说调用了本 triggerEvent 方法后，
-     *      会把处理对应事件的协程或函数对象的引用从本 FDContext 对象中移除。
+     * NOTE: 调用调度器的 schedule 方法时，传参使用了 move 语义，处理器中的协程或函数对象被移动给调度器
      * */
-    assert(m_events & type);
-    m_events = static_cast<FDEventType>(m_events & ~type);
-    auto& handler = getEventHandler(type);
-    assert(handler.m_scheduler);
+    Scheduler* scheduler = handler.m_scheduler;
+    assert(scheduler);
     // 安排！
     if (handler.m_fiber)
     {
-        handler.m_scheduler->schedule(std::move(handler.m_fiber));
+        if (ready_us != 0)
+        {
+            handler.m_fiber->setReadyTime(ready_us);
+        }
+        scheduler->scheduleInternal(std::move(handler.m_fiber), thread_id);
     }
     else if (handler.m_callback)
     {
-        handler.m_scheduler->schedule(std::move(handler.m_callback));
+        scheduler->scheduleInternal(std::move(*handler.m_callback), thread_id);
     }
-    handler.m_scheduler = nullptr;
+    ResetHandler(handler);
+}
+
+size_t FDContext::TriggerWaiters(Waiters& waiters, long thread_id, uint64_t ready_us)
+{
+    size_t count = 0;
+    for (WaiterList& list : waiters)
+    {
+        if (list.empty())
+        {
+            continue;
+        }
+        count += list.size();
+        if (list.m_first.m_scheduler)
+        {
+            TriggerHandler(list.m_first, thread_id, ready_us);
+        }
+        for (EventHandler& handler : list.m_rest)
+        {
+            TriggerHandler(handler, thread_id, ready_us);
+        }
+        list.m_rest.clear();
+    }
+    return count;
+}
+
+uint32_t FDContext::acquireFirst(size_t index)
+{
+    uint32_t busy = BusyBit(index);
+    uint32_t current = m_events.load(std::memory_order_relaxed);
+    while (true)
+    {
+        if (current & busy)
+        {
+            current = m_events.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (m_events.compare_exchange_weak(current, current | busy, std::memory_order_acquire,
+                                           std::memory_order_relaxed))
+        {
+            return current;
+        }
+    }
+}
+
+FDContext::Overflow* FDContext::getOverflow()
+{
+    Overflow* overflow = m_overflow.load(std::memory_order_acquire);
+    if (overflow)
+    {
+        return overflow;
+    }
+    // 多个线程同时分配时，只有一个能发布成功，其余的释放自己分配的
+    auto fresh = new Overflow();
+    if (m_overflow.compare_exchange_strong(overflow, fresh, std::memory_order_acq_rel))
+    {
+        return fresh;
+    }
+    delete fresh;
+    return overflow;
+}
+
+uint64_t FDContext::addWaiter(FDEventType type, EventHandler&& handler)
+{
+    size_t index = EventIndex(type);
+    handler.m_id = m_next_waiter_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t id = handler.m_id;
+    uint32_t busy = BusyBit(index);
+    if (!(acquireFirst(index) & type))
+    {
+        // 就地存放，处理器写好之后同时置上事件位并清除忙碌位，认领到该事件的线程一定能看到完整的处理器
+        m_first[index] = std::move(handler);
+        m_events.fetch_xor(busy | type, std::memory_order_release);
+        return id;
+    }
+    m_events.fetch_and(~busy, std::memory_order_release);
+    // 已经有就地的等待者，其余的等待者才需要加锁
+    Overflow* overflow = getOverflow();
+    ScopedLock lock(&overflow->m_mutex);
+    overflow->m_rest[index].push_back(std::move(handler));
+    m_events.fetch_or(ExtraBit(index), std::memory_order_release);
+    return id;
+}
+
+bool FDContext::removeWaiter(FDEventType type, uint64_t id, EventHandler* removed)
+{
+    size_t index = EventIndex(type);
+    uint32_t busy = BusyBit(index);
+    // 没有要求取出时，被移除的处理器在锁外析构
+    EventHandler dropped;
+    if (!removed)
+    {
+        removed = &dropped;
+    }
+    if ((acquireFirst(index) & type) && m_first[index].m_id == id)
+    {
+        *removed = std::move(m_first[index]);
+        ResetHandler(m_first[index]);
+        m_events.fetch_and(~(busy | type), std::memory_order_release);
+        return true;
+    }
+    m_events.fetch_and(~busy, std::memory_order_release);
+    if (!(m_events.load(std::memory_order_acquire) & ExtraBit(index)))
+    {
+        return false;
+    }
+    // 额外位只在 Overflow 发布之后才会置上
+    Overflow* overflow = m_overflow.load(std::memory_order_acquire);
+    ScopedLock lock(&overflow->m_mutex);
+    std::vector<EventHandler>& rest = overflow->m_rest[index];
+    auto it = std::find_if(rest.begin(), rest.end(),
+                           [id](const EventHandler& handler) { return handler.m_id == id; });
+    if (it == rest.end())
+    {
+        return false;
+    }
+    *removed = std::move(*it);
+    rest.erase(it);
+    if (rest.empty())
+    {
+        m_events.fetch_and(~ExtraBit(index), std::memory_order_release);
+    }
+    return true;
+}
+
+uint32_t FDContext::claimEvents(uint32_t events, Waiters& waiters)
+{
+    static constexpr FDEventType TYPES[EVENT_COUNT] = {
+        FDEventType::READ, FDEventType::PRI, FDEventType::WRITE, FDEventType::RDHUP};
+    // 一次原子操作清除就地等待者的事件位并置上忙碌位，额外位在锁内与 m_rest 一起清除。
+    // 就地的等待者正在被移除者检查时短暂自旋；只有忙碌位而没有事件位时是新的等待者还没写好，不属于本次认领
+    uint32_t first = 0;
+    uint32_t busy = 0;
+    uint32_t extra = 0;
+    uint32_t current = m_events.load(std::memory_order_relaxed);
+    while (true)
+    {
+        first = 0;
+        busy = 0;
+        extra = 0;
+        bool contended = false;
+        for (size_t i = 0; i < EVENT_COUNT; i++)
+        {
+            if (!(events & TYPES[i]))
+            {
+                continue;
+            }
+            if (current & TYPES[i])
+            {
+                if (current & BusyBit(i))
+                {
+                    contended = true;
+                    break;
+                }
+                first |= TYPES[i];
+                busy |= BusyBit(i);
+            }
+            extra |= current & ExtraBit(i);
+        }
+        if (contended)
+        {
+            current = m_events.load(std::memory_order_relaxed);
+            continue;
+        }
+        if ((first | extra) == 0)
+        {
+            return FDEventType::NONE;
+        }
+        if (m_events.compare_exchange_weak(current, (current & ~first) | busy,
+                                           std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    uint32_t claimed = first;
+    for (size_t i = 0; i < EVENT_COUNT; i++)
+    {
+        // 先清空处理器再调度，被唤醒的协程可能立即在其他线程上再次等待同一个事件
+        if (first & TYPES[i])
+        {
+            waiters[i].m_first = std::move(m_first[i]);
+            ResetHandler(m_first[i]);
+        }
+    }
+    if (busy)
+    {
+        m_events.fetch_and(~busy, std::memory_order_release);
+    }
+    if (extra)
+    {
+        Overflow* overflow = m_overflow.load(std::memory_order_acquire);
+        ScopedLock lock(&overflow->m_mutex);
+        m_events.fetch_and(~extra, std::memory_order_relaxed);
+        for (size_t i = 0; i < EVENT_COUNT; i++)
+        {
+            if ((extra & ExtraBit(i)) && !overflow->m_rest[i].empty())
+            {
+                waiters[i].m_rest.swap(overflow->m_rest[i]);
+                claimed |= TYPES[i];
+            }
+        }
+    }
+    return claimed;
+}
+
+size_t FDContext::discardEvents(uint32_t events)
+{
+    Waiters waiters;
+    claimEvents(events, waiters);
+    size_t count = 0;
+    for (WaiterList& list : waiters)
+    {
+        count += list.size();
+    }
+    return count;
 }
 
 } // namespace zjl
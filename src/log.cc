@@ -3,6 +3,7 @@
 //
 
 #include "log.h"
+#include "hook.h"
 #include <algorithm>
 #include <ctime>
 #include <iostream>
@@ -286,12 +287,27 @@ void LogAppender::setFormatter(LogFormatter::ptr formatter)
 StdoutLogAppender::StdoutLogAppender(LogLevel::Level level)
     : LogAppender(level) {}
 
+/**
+ * @brief 作用域内关闭当前线程的 hook
+ * 写日志时持有互斥锁，输出重定向到普通文件时不能因为异步文件 IO 挂起协程
+*/
+class HookDisabler
+{
+public:
+    HookDisabler() : m_enabled(isHookEnabled()) { setHookEnable(false); }
+    ~HookDisabler() { setHookEnable(m_enabled); }
+
+private:
+    bool m_enabled;
+};
+
 void StdoutLogAppender::log(LogLevel::Level level, LogEvent::ptr ev)
 {
     if (level < m_level)
     {
         return;
     }
+    HookDisabler disabler;
     ScopedLock lock(&m_mutex);
     std::cout << m_formatter->format(ev);
     std::cout.flush();
@@ -330,6 +346,7 @@ void FileLogAppender::log(LogLevel::Level level, LogEvent::ptr ev)
     {
         return;
     }
+    HookDisabler disabler;
     ScopedLock lock(&m_mutex);
     m_file_stream << m_formatter->format(ev);
     m_file_stream.flush();
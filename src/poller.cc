@@ -0,0 +1,571 @@
+#include "poller.h"
+#include "config.h"
+#include "exception.h"
+#include "hook.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace zjl
+{
+
+static Logger::ptr system_logger = GET_LOGGER("system");
+
+static ConfigVar<int>::ptr g_uring_entries =
+    Config::Lookup<int>("iomanager.uring_entries", 256, "io_uring 提交队列的长度");
+
+// 缓冲的 SQE 达到该数量时立即提交，不再等到下一轮事件循环
+static constexpr unsigned URING_SUBMIT_BATCH = 32;
+
+static int SysIoUringSetup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int SysIoUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                                      flags, nullptr, 0));
+}
+
+static int SysIoUringRegister(int ring_fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+/**
+ * ===================================================
+ * IORequest 类的实现
+ * ===================================================
+*/
+
+void IORequest::useSocketOpcode()
+{
+    switch (m_opcode)
+    {
+        case READ:
+            m_opcode = RECV;
+            break;
+        case WRITE:
+            m_opcode = SEND;
+            break;
+        case READV:
+        case WRITEV:
+            m_msg = msghdr{};
+            m_msg.msg_iov = static_cast<iovec*>(m_addr);
+            m_msg.msg_iovlen = static_cast<size_t>(m_len);
+            m_addr = &m_msg;
+            m_opcode = m_opcode == READV ? RECVMSG : SENDMSG;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * ===================================================
+ * Poller 类的实现
+ * ===================================================
+*/
+
+Poller::ptr Poller::Create(const std::string& backend)
+{
+    if (backend == "io_uring")
+    {
+        auto poller = std::make_unique<UringPoller>();
+        if (poller->init(static_cast<unsigned>(g_uring_entries->getValue())))
+        {
+            return poller;
+        }
+        LOG_WARN(system_logger, "io_uring 不可用，回退到 epoll");
+    }
+    else if (backend != "epoll")
+    {
+        LOG_FMT_WARN(system_logger, "未知的 IO 后端 %s，使用 epoll", backend.c_str());
+    }
+    return std::make_unique<EpollPoller>();
+}
+
+/**
+ * ===================================================
+ * EpollPoller 类的实现
+ * ===================================================
+*/
+
+EpollPoller::EpollPoller()
+{
+    m_epoll_fd = epoll_create_f(0xffff);
+    if (m_epoll_fd == -1)
+    {
+        THROW_EXCEPTION_WHIT_ERRNO;
+    }
+}
+
+EpollPoller::~EpollPoller()
+{
+    if (m_epoll_fd != -1)
+    {
+        ::close(m_epoll_fd);
+    }
+}
+
+int EpollPoller::add(int fd, uint32_t events, void* data)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.ptr = data;
+    m_ctl_count.fetch_add(1, std::memory_order_relaxed);
+    return ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int EpollPoller::modify(int fd, uint32_t events, void* data)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.ptr = data;
+    m_ctl_count.fetch_add(1, std::memory_order_relaxed);
+    return ::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+int EpollPoller::remove(int fd)
+{
+    m_ctl_count.fetch_add(1, std::memory_order_relaxed);
+    return ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+int EpollPoller::wait(epoll_event* events, int max_events, int timeout_ms)
+{
+    m_wait_count.fetch_add(1, std::memory_order_relaxed);
+    // 事件循环自身的等待不经过 hook
+    return epoll_wait_f(m_epoll_fd, events, max_events, timeout_ms);
+}
+
+/**
+ * ===================================================
+ * UringPoller 类的实现
+ * ===================================================
+*/
+
+UringPoller::~UringPoller()
+{
+    if (m_sqes)
+    {
+        ::munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ring && m_cq_ring != m_sq_ring)
+    {
+        ::munmap(m_cq_ring, m_cq_ring_size);
+    }
+    if (m_sq_ring)
+    {
+        ::munmap(m_sq_ring, m_sq_ring_size);
+    }
+    if (m_ring_fd != -1)
+    {
+        ::close(m_ring_fd);
+    }
+    if (m_event_fd != -1)
+    {
+        ::close(m_event_fd);
+    }
+}
+
+bool UringPoller::init(unsigned entries)
+{
+    io_uring_params params{};
+    m_ring_fd = SysIoUringSetup(entries, &params);
+    if (m_ring_fd < 0)
+    {
+        LOG_FMT_WARN(system_logger, "io_uring_setup 调用失败: %s", strerror(errno));
+        m_ring_fd = -1;
+        return false;
+    }
+    if (!probe())
+    {
+        LOG_WARN(system_logger, "内核的 io_uring 缺少所需的操作码");
+        return false;
+    }
+
+    // 映射提交队列、完成队列与 SQE 数组
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+    void* ptr = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED)
+    {
+        return false;
+    }
+    m_sq_ring = ptr;
+    if (single_mmap)
+    {
+        m_cq_ring = m_sq_ring;
+    }
+    else
+    {
+        ptr = ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (ptr == MAP_FAILED)
+        {
+            return false;
+        }
+        m_cq_ring = ptr;
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ptr = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED)
+    {
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(ptr);
+
+    auto sq = static_cast<char*>(m_sq_ring);
+    m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sq_flags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sqe_tail = *m_sq_tail;
+    // SQE 数组与提交队列一一对应，索引数组只需初始化一次
+    auto sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < m_sq_entries; i++)
+    {
+        sq_array[i] = i;
+    }
+    auto cq = static_cast<char*>(m_cq_ring);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // 完成队列有新结果时 eventfd 变为可读，借此唤醒阻塞在 epoll_wait 上的线程
+    m_event_fd = eventfd_f(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event_fd == -1)
+    {
+        return false;
+    }
+    if (SysIoUringRegister(m_ring_fd, IORING_REGISTER_EVENTFD, &m_event_fd, 1) < 0)
+    {
+        LOG_FMT_WARN(system_logger, "io_uring 注册 eventfd 失败: %s", strerror(errno));
+        return false;
+    }
+    if (add(m_event_fd, EPOLLIN | EPOLLET, &m_event_fd) == -1)
+    {
+        return false;
+    }
+    LOG_FMT_INFO(system_logger, "io_uring 初始化完成，提交队列 %u，完成队列 %u",
+                 params.sq_entries, params.cq_entries);
+    return true;
+}
+
+bool UringPoller::probe()
+{
+    static const int REQUIRED_OPS[] = {
+        IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READV, IORING_OP_WRITEV,
+        IORING_OP_RECV, IORING_OP_SEND, IORING_OP_RECVMSG, IORING_OP_SENDMSG,
+        IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_LINK_TIMEOUT, IORING_OP_ASYNC_CANCEL,
+        IORING_OP_FSYNC, IORING_OP_POLL_ADD};
+    static const unsigned PROBE_OPS = 256;
+    size_t size = sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op);
+    auto buffer = std::make_unique<char[]>(size);
+    auto probe = reinterpret_cast<io_uring_probe*>(buffer.get());
+    if (SysIoUringRegister(m_ring_fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0)
+    {
+        return false;
+    }
+    for (int op : REQUIRED_OPS)
+    {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+io_uring_sqe* UringPoller::getSqe(unsigned reserve)
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head + reserve > m_sq_entries)
+    {
+        flushLocked();
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head + reserve > m_sq_entries)
+        {
+            return nullptr;
+        }
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+    ++m_sqe_tail;
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+void UringPoller::flushLocked()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    unsigned to_submit = m_sqe_tail - head;
+    if (to_submit == 0)
+    {
+        return;
+    }
+    // 发布新的尾部，内核从 head 一直消费到 tail
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    int rt = 0;
+    do
+    {
+        rt = SysIoUringEnter(m_ring_fd, to_submit, 0, 0);
+    } while (rt == -1 && errno == EINTR);
+    if (rt == -1)
+    {
+        // EAGAIN/EBUSY 时内核暂时无法接收更多请求，留到下一次提交
+        LOG_FMT_WARN(system_logger, "io_uring_enter 提交 %u 个请求失败: %s",
+                     to_submit, strerror(errno));
+    }
+}
+
+bool UringPoller::submit(IORequest* request)
+{
+    ScopedLock lock(&m_mutex);
+    if (request->m_timeout_ms != ~0ull)
+    {
+        // 超时期限在第一次提交时确定，返回 EAGAIN 后重新提交时不再延长
+        timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t deadline_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+            static_cast<uint64_t>(now.tv_nsec) + request->m_timeout_ms * 1000000ull;
+        request->m_timeout_ts.tv_sec = static_cast<int64_t>(deadline_ns / 1000000000ull);
+        request->m_timeout_ts.tv_nsec = static_cast<long long>(deadline_ns % 1000000000ull);
+    }
+    request->m_polling = false;
+    if (!prepare(request, false))
+    {
+        return false;
+    }
+    // 加入未完成请求链表
+    request->m_prev = nullptr;
+    request->m_next = m_inflight;
+    if (m_inflight)
+    {
+        m_inflight->m_prev = request;
+    }
+    m_inflight = request;
+
+    if (m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= URING_SUBMIT_BATCH)
+    {
+        flushLocked();
+    }
+    return true;
+}
+
+bool UringPoller::prepare(IORequest* request, bool poll)
+{
+    bool linked = request->m_timeout_ms != ~0ull;
+    io_uring_sqe* sqe = getSqe(linked ? 2 : 1);
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->fd = request->m_fd;
+    sqe->user_data = reinterpret_cast<uintptr_t>(request);
+    auto addr = reinterpret_cast<uintptr_t>(request->m_addr);
+    // 内核单次读写最多 MAX_RW_COUNT 字节，超出的部分以短读写返回，长度不能截断到 32 位
+    static constexpr uint64_t MAX_IO_LEN = 0x7ffff000;
+    uint32_t len = static_cast<uint32_t>(std::min(request->m_len, MAX_IO_LEN));
+    if (poll)
+    {
+        bool output = request->m_opcode == IORequest::WRITE || request->m_opcode == IORequest::WRITEV ||
+                      request->m_opcode == IORequest::SEND || request->m_opcode == IORequest::SENDMSG ||
+                      request->m_opcode == IORequest::CONNECT;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = output ? POLLOUT : POLLIN;
+    }
+    else
+    {
+        switch (request->m_opcode)
+        {
+            case IORequest::READ:
+            case IORequest::WRITE:
+                sqe->opcode = request->m_opcode == IORequest::READ ? IORING_OP_READ : IORING_OP_WRITE;
+                sqe->addr = addr;
+                sqe->len = len;
+                // -1 表示使用文件的当前偏移
+                sqe->off = static_cast<uint64_t>(request->m_offset);
+                break;
+            case IORequest::READV:
+            case IORequest::WRITEV:
+                sqe->opcode = request->m_opcode == IORequest::READV ? IORING_OP_READV : IORING_OP_WRITEV;
+                sqe->addr = addr;
+                sqe->len = static_cast<uint32_t>(request->m_len);
+                sqe->off = static_cast<uint64_t>(request->m_offset);
+                break;
+            case IORequest::RECV:
+            case IORequest::SEND:
+                sqe->opcode = request->m_opcode == IORequest::RECV ? IORING_OP_RECV : IORING_OP_SEND;
+                sqe->addr = addr;
+                sqe->len = len;
+                sqe->msg_flags = static_cast<uint32_t>(request->m_flags);
+                break;
+            case IORequest::RECVMSG:
+            case IORequest::SENDMSG:
+                sqe->opcode = request->m_opcode == IORequest::RECVMSG ? IORING_OP_RECVMSG : IORING_OP_SENDMSG;
+                sqe->addr = addr;
+                sqe->len = 1;
+                sqe->msg_flags = static_cast<uint32_t>(request->m_flags);
+                break;
+            case IORequest::ACCEPT:
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->addr = addr;
+                sqe->addr2 = reinterpret_cast<uintptr_t>(request->m_addr2);
+                sqe->accept_flags = static_cast<uint32_t>(request->m_flags);
+                break;
+            case IORequest::CONNECT:
+                sqe->opcode = IORING_OP_CONNECT;
+                sqe->addr = addr;
+                sqe->off = request->m_len;
+                break;
+            case IORequest::FSYNC:
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fsync_flags = request->m_flags ? IORING_FSYNC_DATASYNC : 0;
+                break;
+        }
+    }
+    if (linked)
+    {
+        // 链接一个超时请求，到达期限后 IO 请求以 -ECANCELED 完成
+        sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe* timeout_sqe = getSqe();
+        timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+        timeout_sqe->fd = -1;
+        timeout_sqe->addr = reinterpret_cast<uintptr_t>(&request->m_timeout_ts);
+        timeout_sqe->len = 1;
+        timeout_sqe->timeout_flags = IORING_TIMEOUT_ABS;
+        timeout_sqe->user_data = 0;
+    }
+    request->m_polling = poll;
+    return true;
+}
+
+void UringPoller::flush()
+{
+    ScopedLock lock(&m_mutex);
+    flushLocked();
+}
+
+int UringPoller::wait(epoll_event* events, int max_events, int timeout_ms)
+{
+    // 阻塞之前把本轮缓冲的请求一次性提交
+    flush();
+    int n = EpollPoller::wait(events, max_events, timeout_ms);
+    // eventfd 只用于唤醒，不交给调用者处理
+    for (int i = 0; i < n;)
+    {
+        if (events[i].data.ptr == &m_event_fd)
+        {
+            eventfd_t value;
+            ::eventfd_read(m_event_fd, &value);
+            events[i] = events[--n];
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return n;
+}
+
+void UringPoller::reap(std::vector<IORequest*>& done)
+{
+    // 完成队列为空时不加锁
+    if (__atomic_load_n(m_cq_head, __ATOMIC_RELAXED) == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) &&
+        !(__atomic_load_n(m_sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+    {
+        return;
+    }
+    ScopedLock lock(&m_mutex);
+    // 完成队列溢出时内核暂存了结果，需要主动让内核把结果搬回完成队列
+    if (__atomic_load_n(m_sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+    {
+        SysIoUringEnter(m_ring_fd, 0, 0, IORING_ENTER_GETEVENTS);
+    }
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        io_uring_cqe* cqe = &m_cqes[head & m_cq_mask];
+        auto request = reinterpret_cast<IORequest*>(cqe->user_data);
+        // 超时与取消请求的 user_data 为 0，忽略它们的结果
+        if (!request)
+        {
+            continue;
+        }
+        // 非阻塞的 fd 未就绪时请求返回 EAGAIN，改为在 io_uring 中等待 fd 就绪，就绪后重新提交请求，
+        // 不退回到 epoll 再等待一次。SQE 不足时照常完成，由调用者退回到就绪式等待
+        bool retry = false;
+        if (cqe->res == -EAGAIN && !request->m_polling && request->m_opcode != IORequest::FSYNC)
+        {
+            retry = prepare(request, true);
+        }
+        else if (request->m_polling && cqe->res > 0)
+        {
+            retry = prepare(request, false);
+        }
+        if (retry)
+        {
+            continue;
+        }
+        // 等到了就绪却无法重新提交时，以 EAGAIN 完成；等待被链接的超时取消或者出错时保留原来的错误，
+        // 由 submitAndWait 报告 ETIMEDOUT 或对应的错误码，不让调用者再完整地等待一次
+        request->m_result = request->m_polling && cqe->res > 0 ? -EAGAIN : cqe->res;
+        request->m_polling = false;
+        if (request->m_prev)
+        {
+            request->m_prev->m_next = request->m_next;
+        }
+        else
+        {
+            m_inflight = request->m_next;
+        }
+        if (request->m_next)
+        {
+            request->m_next->m_prev = request->m_prev;
+        }
+        done.push_back(request);
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+}
+
+size_t UringPoller::cancelAll()
+{
+    ScopedLock lock(&m_mutex);
+    size_t count = 0;
+    for (IORequest* request = m_inflight; request; request = request->m_next)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe)
+        {
+            break;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uintptr_t>(request);
+        sqe->user_data = 0;
+        ++count;
+    }
+    flushLocked();
+    return count;
+}
+
+} // namespace zjl
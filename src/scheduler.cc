@@ -1,6 +1,15 @@
 #include "scheduler.h"
+#include "clock.h"
+#include "exception.h"
 #include "log.h"
 #include "hook.h"
+#include <algorithm>
+#include <csignal>
+#include <ctime>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
 
 namespace zjl
 {
@@ -10,6 +19,23 @@ static Logger::ptr system_logger = GET_LOGGER("system");
 static thread_local Scheduler* t_scheduler = nullptr;
 // 协程调度器的调度工作协程
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+// 当前线程在所属调度器中的工作线程序号
+static thread_local int t_worker_index = -1;
+// 当前线程上挂起的协程要求迁移到的线程 id，由 YieldToThread 设置，调度协程读取后重置
+static thread_local long t_yield_thread_id = -1;
+// 当前线程的时间片定时器
+static thread_local timer_t t_slice_timer{};
+static thread_local bool t_slice_timer_created = false;
+// 当前线程的时间片定时器已经生效的设置
+static thread_local uint64_t t_armed_slice_us = 0;
+static thread_local bool t_armed_forced = false;
+// 协程留给上次运行它的空闲工作线程的时间(us)，覆盖唤醒一个阻塞在轮询上的线程的延迟，
+// 期间让出的线程睡眠等待，超时后由它自己执行，协程不会被长时间搁置
+static constexpr uint64_t AFFINITY_WAIT_US = 200;
+#ifndef NDEBUG
+// 当前线程是否正在执行内联任务，用于检测内联任务中的协程挂起
+static thread_local bool t_running_inline_task = false;
+#endif
 
 Scheduler* Scheduler::GetThis()
 {
@@ -21,10 +47,43 @@ Fiber* Scheduler::GetMainFiber()
     return t_scheduler_fiber;
 }
 
+bool Scheduler::IsRunningInlineTask()
+{
+#ifndef NDEBUG
+    return t_running_inline_task;
+#else
+    return false;
+#endif
+}
+
+int Scheduler::GetWorkerIndex()
+{
+    return t_worker_index;
+}
+
+void Scheduler::YieldToThread(long thread_id)
+{
+    assert(!IsRunningInlineTask() && "内联任务中不允许挂起协程");
+    Fiber* current = Fiber::GetThis().get();
+    assert(GetThis() && current != GetMainFiber());
+    t_yield_thread_id = thread_id;
+    // 以 READY 状态换出，由调度协程按 t_yield_thread_id 重新调度
+    current->m_state = Fiber::READY;
+    current->swapOut();
+}
+
 Scheduler::Scheduler(size_t thread_size, bool use_caller, std::string name)
     : m_name(std::move(name))
 {
     assert(thread_size > 0);
+    m_worker_count = thread_size;
+    m_worker_idle.reset(new std::atomic_bool[m_worker_count]);
+    m_worker_thread_ids.reset(new std::atomic_long[m_worker_count]);
+    for (size_t i = 0; i < m_worker_count; i++)
+    {
+        m_worker_idle[i] = false;
+        m_worker_thread_ids[i] = -1;
+    }
     if (use_caller)
     {
         // 实例化此类的线程作为 master fiber
@@ -41,6 +100,7 @@ Scheduler::Scheduler(size_t thread_size, bool use_caller, std::string name)
         t_scheduler_fiber = m_root_fiber.get();
         m_root_thread_id = GetThreadID();
         m_thread_id_list.push_back(m_root_thread_id);
+        m_worker_thread_ids[m_worker_count - 1] = m_root_thread_id;
     }
     else
     {
@@ -87,6 +147,20 @@ void Scheduler::start()
     // }
 }
 
+void Scheduler::waitForWorkers()
+{
+    ScopedLock lock(&m_register_mutex);
+    if (m_workers_registered)
+    {
+        return;
+    }
+    for (size_t i = 0; i < m_thread_count; i++)
+    {
+        m_worker_registered.wait();
+    }
+    m_workers_registered = true;
+}
+
 void Scheduler::stop()
 {
     LOG_DEBUG(system_logger, "调用 Scheduler::stop()");
@@ -137,6 +211,38 @@ bool Scheduler::isStop()
     return m_auto_stop && m_task_list.empty() && m_active_thread_count == 0;
 }
 
+size_t Scheduler::pendingTaskCount() const
+{
+    ScopedLock lock(&m_mutex);
+    return m_task_list.size();
+}
+
+bool Scheduler::hasRunnableTask() const
+{
+    long thread_id = GetThreadID();
+    uint64_t now_us = 0;
+    ScopedLock lock(&m_mutex);
+    for (auto& task : m_task_list)
+    {
+        if (task->thread_id != -1 && task->thread_id != thread_id)
+        {
+            continue;
+        }
+        // 还在期限内留给上次运行它的工作线程
+        if (task->affinity_deadline_us != 0 && task->fiber &&
+            task->fiber->m_last_worker != t_worker_index)
+        {
+            now_us = now_us ? now_us : Clock::NowUS();
+            if (now_us < task->affinity_deadline_us)
+            {
+                continue;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
 void Scheduler::tickle()
 {
     //    LOG_DEBUG(system_logger, "调用 Scheduler::tickle()");
@@ -146,6 +252,16 @@ void Scheduler::run()
 {
     LOG_DEBUG(system_logger, "调用 Scheduler::run()");
     t_scheduler = this;
+    // 线程池的线程依次使用 [0, m_thread_count) 的序号，use_caller 的主线程固定使用最后一个序号
+    t_worker_index = GetThreadID() == m_root_thread_id
+                         ? static_cast<int>(m_worker_count - 1)
+                         : m_worker_seq++;
+    assert(static_cast<size_t>(t_worker_index) < m_worker_count);
+    m_worker_thread_ids[t_worker_index] = GetThreadID();
+    if (GetThreadID() != m_root_thread_id)
+    {
+        m_worker_registered.notify();
+    }
     setHookEnable(true);
     // 判断执行 run() 函数的线程，是否是线程池中的线程
     if (GetThreadID() != m_root_thread_id)
@@ -160,7 +276,12 @@ void Scheduler::run()
     while (true)
     {
         task.reset();
+        updateTimeSlice();
         bool tickle_me = false;
+        // 本轮因为亲和性留给其他工作线程的任务，以及需要直接唤醒的工作线程
+        uint64_t affinity_deadline_us = ~0ull;
+        int wake_worker = -1;
+        uint64_t now_us = 0;
         // 查找等待调度的 task
         { // !!! 作用域锁
             ScopedLock lock(&m_mutex);
@@ -176,24 +297,79 @@ void Scheduler::run()
                     continue;
                 }
                 assert((*iter)->fiber || (*iter)->callback);
-                // 任务是 fiber，但是是正在执行的，不进行处理
-                if ((*iter)->fiber && (*iter)->fiber->getState() == Fiber::EXEC)
+                // 任务是 fiber，但是是正在执行的，不进行处理。
+                // 协程挂起时先修改状态再保存上下文，被提前唤醒时状态已经不是 EXEC，但上下文还没有换出
+                if ((*iter)->fiber && ((*iter)->fiber->getState() == Fiber::EXEC ||
+                                       (*iter)->fiber->m_running.load(std::memory_order_acquire)))
                 {
                     ++iter;
                     continue;
                 }
-                // 找到可以执行的任务，拷贝一份
-                task = **iter;
+                // 软亲和：协程上次运行的工作线程空闲时，直接唤醒它并留给它执行，避免协程栈和工作集在缓存中失效。
+                // 只让出一次，期限内其他线程都跳过该任务，超过期限后由遇到它的线程执行，防止任务被长时间搁置
+                if ((*iter)->fiber && (*iter)->thread_id == -1)
+                {
+                    int last_worker = (*iter)->fiber->m_last_worker;
+                    if (last_worker != -1 && last_worker != t_worker_index &&
+                        static_cast<size_t>(last_worker) < m_worker_count)
+                    {
+                        if ((*iter)->affinity_deadline_us == 0 && m_worker_idle[last_worker])
+                        {
+                            now_us = now_us ? now_us : Clock::NowUS();
+                            (*iter)->affinity_deadline_us = now_us + AFFINITY_WAIT_US;
+                            affinity_deadline_us = std::min(affinity_deadline_us, (*iter)->affinity_deadline_us);
+                            wake_worker = last_worker;
+                            ++iter;
+                            continue;
+                        }
+                        if ((*iter)->affinity_deadline_us != 0)
+                        {
+                            now_us = now_us ? now_us : Clock::NowUS();
+                            if (now_us < (*iter)->affinity_deadline_us)
+                            {
+                                affinity_deadline_us = std::min(affinity_deadline_us, (*iter)->affinity_deadline_us);
+                                ++iter;
+                                continue;
+                            }
+                        }
+                    }
+                }
+                // 找到可以执行的任务，将其移动出来
+                task = std::move(**iter);
                 ++m_active_thread_count;
                 // 从任务列表里移除该任务
                 m_task_list.erase(iter);
                 break;
             }
         }
+        if (wake_worker != -1)
+        {
+            tickleWorker(static_cast<size_t>(wake_worker));
+        }
         if (tickle_me)
         {
             tickle();
         }
+        // 留给其他线程的任务还没有被取走、本线程又没有其他任务时，睡眠到期限再重新查找，期限到了自己执行。
+        // 不进入空闲：共享事件循环时，空闲的线程会从轮询中抢走发给目标线程的唤醒；也不自旋，
+        // 自旋会反复争抢任务队列的锁，单核上还会占住目标线程需要的 CPU
+        if (affinity_deadline_us != ~0ull && !task.fiber && !task.callback)
+        {
+            uint64_t now = Clock::NowUS();
+            if (now < affinity_deadline_us)
+            {
+                timespec ts{0, static_cast<long>((affinity_deadline_us - now) * 1000)};
+                nanosleep_f(&ts, nullptr);
+            }
+            continue;
+        }
+        if (task.callback && task.run_inline)
+        { // 内联任务，直接在调度协程上执行
+            runInline(task.callback);
+            --m_active_thread_count;
+            task.reset();
+            continue;
+        }
         if (task.callback)
         { // 如果是 callback 任务，为其创建 fiber
             task.fiber = std::make_shared<Fiber>(std::move(task.callback));
@@ -201,6 +377,25 @@ void Scheduler::run()
         }
         if (task.fiber && !task.fiber->finish())
         { // 是 fiber 任务
+            int last_worker = task.fiber->m_last_worker;
+            if (last_worker == t_worker_index)
+            {
+                ++m_local_resume_count;
+            }
+            else if (last_worker != -1)
+            {
+                ++m_migrated_resume_count;
+            }
+            task.fiber->m_last_worker = t_worker_index;
+            task.fiber->m_forced_preempted = false;
+            if (task.fiber->m_ready_us != 0)
+            {
+                uint64_t now_us = Clock::NowUS();
+                uint64_t ready_us = task.fiber->m_ready_us;
+                task.fiber->m_ready_us = 0;
+                onFiberResume(now_us > ready_us ? now_us - ready_us : 0);
+            }
+            task.fiber->m_running.store(true, std::memory_order_relaxed);
             if (GetThreadID() == m_root_thread_id)
             {
                 // m_root_thread_id 等于当前线程 id，说明构造调度器时 use_caller 为 true
@@ -214,10 +409,19 @@ void Scheduler::run()
             }
             --m_active_thread_count;
             // 协程换出后，继续将其添加到任务队列
-            Fiber::State fiber_status = task.fiber->getState();
+            Fiber::ptr fiber = task.fiber;
+            Fiber::State fiber_status = fiber->getState();
             if (fiber_status == Fiber::READY)
             {
-                schedule(std::move(task.fiber), task.thread_id);
+                // 在信号处理函数中被强制抢占的协程，栈上保存着信号帧，只能回到本线程继续执行
+                long thread_id = task.fiber->m_forced_preempted ? GetThreadID() : task.thread_id;
+                // 协程通过 YieldToThread 要求迁移到指定线程
+                if (t_yield_thread_id != -1)
+                {
+                    thread_id = t_yield_thread_id;
+                    t_yield_thread_id = -1;
+                }
+                scheduleInternal(std::move(task.fiber), thread_id);
             }
             else if (fiber_status != Fiber::EXCEPTION && fiber_status != Fiber::TERM)
             {
@@ -227,6 +431,8 @@ void Scheduler::run()
             // {
             //     // schedule(std::move(task.fiber));
             // }
+            // 上下文已经完全换出，状态也已经写回，此后其他工作线程才可以恢复该协程
+            fiber->m_running.store(false, std::memory_order_release);
             task.reset();
         }
         else
@@ -236,6 +442,7 @@ void Scheduler::run()
                 break;
             }
             ++m_idle_thread_count;
+            m_worker_idle[t_worker_index] = true;
             // if (GetThreadID() == m_root_thread_id)
             // {
             //     // m_root_thread_id 等于当前线程 id，说明构造调度器时 use_caller 为 true
@@ -247,6 +454,7 @@ void Scheduler::run()
             //     idle_fiber->swapIn();
             // }
             idle_fiber->swapIn();
+            m_worker_idle[t_worker_index] = false;
             --m_idle_thread_count;
             if (idle_fiber->getState() != Fiber::TERM && 
                 idle_fiber->getState() != Fiber::EXCEPTION)
@@ -255,7 +463,84 @@ void Scheduler::run()
             }
         }
     }
+    if (t_slice_timer_created)
+    {
+        timer_delete(t_slice_timer);
+        t_slice_timer_created = false;
+        t_armed_slice_us = 0;
+    }
     LOG_DEBUG(system_logger, "Scheduler::run() 结束");
 }
 
+void Scheduler::updateTimeSlice()
+{
+    uint64_t slice_us = m_time_slice_us;
+    bool forced = m_forced_preempt;
+    if (slice_us == t_armed_slice_us && forced == t_armed_forced)
+    {
+        return;
+    }
+    t_armed_slice_us = slice_us;
+    t_armed_forced = forced;
+    if (!t_slice_timer_created)
+    {
+        if (slice_us == 0)
+        {
+            return;
+        }
+        Fiber::EnablePreempt(forced);
+        // 使用线程 CPU 时间计时，线程阻塞在 epoll_wait 等函数上时不会收到信号
+        sigevent event{};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = Fiber::GetPreemptSignal();
+        event.sigev_notify_thread_id = GetThreadID();
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &t_slice_timer) == -1)
+        {
+            LOG_FMT_ERROR(system_logger, "时间片定时器创建失败: %s", strerror(errno));
+            return;
+        }
+        t_slice_timer_created = true;
+    }
+    Fiber::EnablePreempt(forced);
+    itimerspec spec{};
+    spec.it_value.tv_sec = static_cast<time_t>(slice_us / 1000000);
+    spec.it_value.tv_nsec = static_cast<long>(slice_us % 1000000 * 1000);
+    spec.it_interval = spec.it_value;
+    if (timer_settime(t_slice_timer, 0, &spec, nullptr) == -1)
+    {
+        LOG_FMT_ERROR(system_logger, "时间片定时器设置失败: %s", strerror(errno));
+    }
+}
+
+void Scheduler::runInline(Task::TaskFunc& callback)
+{
+#ifndef NDEBUG
+    t_running_inline_task = true;
+#endif
+    try
+    {
+        callback();
+    }
+    catch (zjl::Exception& e)
+    {
+        LOG_FMT_ERROR(
+            system_logger,
+            "Inline task exception: %s, call stack:\n%s",
+            e.what(),
+            e.stackTrace());
+    }
+    catch (std::exception& e)
+    {
+        LOG_FMT_ERROR(system_logger, "Inline task exception: %s", e.what());
+    }
+    catch (...)
+    {
+        LOG_ERROR(system_logger, "Inline task exception");
+    }
+#ifndef NDEBUG
+    t_running_inline_task = false;
+#endif
+    callback = nullptr;
+}
+
 } // namespace zjl
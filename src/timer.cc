@@ -1,8 +1,25 @@
 #include "timer.h"
+#include "clock.h"
+#include "config.h"
+#include "timer_queue.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
 
 namespace zjl 
 {
 
+// 大量带超时的 IO 操作反复添加、取消定时器时，时间轮的 O(1) 操作优于有序集合
+static ConfigVar<std::string>::ptr g_timer_backend =
+    Config::Lookup<std::string>("timer.backend", "set", "定时器的存储结构，set 或 wheel");
+
+// 不要求准时的定时器合并到同一时刻到期，减少事件循环的唤醒次数
+static ConfigVar<uint64_t>::ptr g_timer_slack_us =
+    Config::Lookup<uint64_t>("timer.slack_us", 0, "定时器默认的松弛时间(us)，0 表示准时到期");
+
+static ConfigVar<bool>::ptr g_profile_callbacks =
+    Config::Lookup<bool>("timer.profile_callbacks", false, "是否记录定时器回调的执行耗时，用于找出最慢的回调");
+
 bool Timer::Comparator::operator()(
     const Timer::ptr& lhs, const Timer::ptr& rhs) const
 {
@@ -26,27 +43,59 @@ bool Timer::Comparator::operator()(
     return lhs.get() < rhs.get();
 }
 
+// 到期时间按绝对时间向上取整到松弛时间的整数倍，不同时刻创建的定时器也能落在同一时刻
+static uint64_t ApplySlack(uint64_t next, uint64_t slack_us)
+{
+    return slack_us > 1 ? (next + slack_us - 1) / slack_us * slack_us : next;
+}
+
+// 负的时长按 0 处理
+static uint64_t ToMicroseconds(std::chrono::microseconds delay)
+{
+    return delay.count() > 0 ? static_cast<uint64_t>(delay.count()) : 0;
+}
+
 Timer::Timer(
-    uint64_t ms, std::function<void()> fn, bool cyclic, TimerManager* manager)
+    uint64_t us, TimerFunc fn, bool cyclic, TimerManager* manager)
     : m_cyclic(cyclic), 
-      m_ms(ms), 
-      m_fn(fn),
+      m_us(us), 
+      m_slack_us(manager->getTimerSlack()),
       m_manager(manager)
 {
-    m_next = GetCurrentMS() + m_ms;
+    if (m_cyclic && fn)
+    {
+        m_cyclic_fn = std::make_shared<TimerFunc>(std::move(fn));
+    }
+    else
+    {
+        m_fn = std::move(fn);
+    }
+    restart(Clock::CachedUS());
 }
 
 Timer::Timer(uint64_t next) : m_next(next)
 {}
 
+void Timer::clearCallback()
+{
+    m_fn = nullptr;
+    m_cyclic_fn.reset();
+}
+
+void Timer::restart(uint64_t start)
+{
+    m_start = start;
+    m_next = ApplySlack(start + m_us, m_slack_us);
+}
+
 bool Timer::cancel()
 {
-    WriteScopedLock lock(&m_manager->m_lock);
-    if (m_fn)
+    auto& shard = *m_manager->m_shards[m_shard];
+    ScopedLock lock(&shard.m_mutex);
+    if (isValid())
     {
-        m_fn = nullptr;
-        auto it = m_manager->m_timers.find(shared_from_this());
-        m_manager->m_timers.erase(it);
+        clearCallback();
+        shard.erase(this);
         return true;
     }
     return false;
@@ -54,59 +103,227 @@ bool Timer::cancel()
 
 bool Timer::reset(uint64_t ms, bool from_now)
 {
-    if (ms == m_ms && !from_now)
+    return reset(std::chrono::milliseconds(ms), from_now);
+}
+
+bool Timer::reset(std::chrono::microseconds delay, bool from_now)
+{
+    uint64_t us = ToMicroseconds(delay);
+    if (us == m_us && !from_now)
     {
         return true;
     }
-    if (!m_fn)
+    if (!isValid())
     {
         return false;
     }
-    WriteScopedLock lock(&m_manager->m_lock);
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if (it == m_manager->m_timers.end())
+    auto& shard = *m_manager->m_shards[m_shard];
+    ScopedLock lock(&shard.m_mutex);
+    if (!shard.erase(this))
     {
         return false;
     }
-    m_manager->m_timers.erase(it);
-    uint64_t start = 0;
     // 重新计时
-    if (from_now)
+    uint64_t start = from_now ? Clock::CachedUS() : m_start;
+    m_us = us;
+    restart(start);
+    m_manager->addTimer(shared_from_this(), lock);
+    return true;
+}
+ 
+bool Timer::refresh()
+{
+    auto& shard = *m_manager->m_shards[m_shard];
+    ScopedLock lock(&shard.m_mutex);
+    if (!isValid())
     {
-        start = GetCurrentMS();
+        return false;
     }
-    else 
+    if (!shard.erase(this))
+    {
+        return false;
+    }
+    // 到期时间只会推后，之前的下界仍然有效
+    restart(Clock::CachedUS());
+    shard.insert(shared_from_this());
+    return true;
+}
+
+bool Timer::setSlack(uint64_t slack_us)
+{
+    auto& shard = *m_manager->m_shards[m_shard];
+    ScopedLock lock(&shard.m_mutex);
+    if (!isValid() || !shard.erase(this))
     {
-        start = m_next - m_ms;
+        return false;
     }
-    m_ms = ms;
-    m_next = start + m_ms;
-    // it = m_manager->m_timers.insert(shared_from_this()).first;
+    // 松弛时间变小时到期时间可能提前，按新增定时器的方式处理
+    m_slack_us = slack_us;
+    restart(m_start);
     m_manager->addTimer(shared_from_this(), lock);
     return true;
 }
- 
-bool Timer::refresh()
+
+TimeoutNode::~TimeoutNode()
+{
+    cancel();
+}
+
+bool TimeoutNode::cancel()
+{
+    return m_manager ? m_manager->disarmTimeout(*this) : false;
+}
+
+bool TimerManager::TimerShard::insert(const Timer::ptr& timer)
+{
+    m_queue->insert(timer);
+    ++m_counts[timer->getType()];
+    if (timer->m_next < m_deadline_hint.load(std::memory_order_acquire))
+    {
+        m_deadline_hint.store(timer->m_next, std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+bool TimerManager::TimerShard::erase(Timer* timer)
 {
-    WriteScopedLock lock(&m_manager->m_lock);
-    if (!m_fn)
+    if (!m_queue->erase(timer))
     {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if (it == m_manager->m_timers.end())
+    --m_counts[timer->getType()];
+    // 被取消的定时器可能是最早到期的，保留原来的下界只会让事件循环提前醒来一次，
+    // 但分片变空时必须清除，否则调度器会一直等待这个已经不存在的定时器
+    if (empty())
+    {
+        m_deadline_hint.store(~0ull, std::memory_order_release);
+    }
+    return true;
+}
+
+bool TimerManager::TimerShard::pushTimeout(TimeoutNode* node)
+{
+    node->m_heap_index = m_timeouts.size();
+    m_timeouts.push_back(node);
+    siftUp(node->m_heap_index);
+    if (node->m_next < m_deadline_hint.load(std::memory_order_acquire))
+    {
+        m_deadline_hint.store(node->m_next, std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+bool TimerManager::TimerShard::eraseTimeout(TimeoutNode* node)
+{
+    size_t index = node->m_heap_index;
+    if (index == TimeoutNode::NPOS)
     {
         return false;
     }
-    m_manager->m_timers.erase(it);
-    m_next = GetCurrentMS() + m_ms;
-    m_manager->m_timers.insert(shared_from_this());
+    // 用最后一个节点填补空位，再向上或向下调整
+    TimeoutNode* last = m_timeouts.back();
+    m_timeouts.pop_back();
+    node->m_heap_index = TimeoutNode::NPOS;
+    if (last != node)
+    {
+        m_timeouts[index] = last;
+        last->m_heap_index = index;
+        siftUp(index);
+        siftDown(last->m_heap_index);
+    }
+    // 与 erase 相同，只在分片变空时清除下界
+    if (empty())
+    {
+        m_deadline_hint.store(~0ull, std::memory_order_release);
+    }
     return true;
 }
 
-TimerManager::TimerManager()
+TimeoutNode* TimerManager::TimerShard::popTimeout()
+{
+    TimeoutNode* node = m_timeouts.front();
+    TimeoutNode* last = m_timeouts.back();
+    m_timeouts.pop_back();
+    if (last != node)
+    {
+        m_timeouts[0] = last;
+        last->m_heap_index = 0;
+        siftDown(0);
+    }
+    node->m_heap_index = TimeoutNode::NPOS;
+    return node;
+}
+
+bool TimerManager::TimerShard::empty() const
+{
+    return m_queue->empty() && m_timeouts.empty();
+}
+
+uint64_t TimerManager::TimerShard::nextDeadline()
+{
+    uint64_t deadline = m_queue->nextDeadline();
+    return m_timeouts.empty() ? deadline : std::min(deadline, m_timeouts.front()->m_next);
+}
+
+void TimerManager::TimerShard::siftUp(size_t index)
+{
+    TimeoutNode* node = m_timeouts[index];
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (m_timeouts[parent]->m_next <= node->m_next)
+        {
+            break;
+        }
+        m_timeouts[index] = m_timeouts[parent];
+        m_timeouts[index]->m_heap_index = index;
+        index = parent;
+    }
+    m_timeouts[index] = node;
+    node->m_heap_index = index;
+}
+
+void TimerManager::TimerShard::siftDown(size_t index)
+{
+    TimeoutNode* node = m_timeouts[index];
+    size_t size = m_timeouts.size();
+    while (true)
+    {
+        size_t child = index * 2 + 1;
+        if (child >= size)
+        {
+            break;
+        }
+        if (child + 1 < size && m_timeouts[child + 1]->m_next < m_timeouts[child]->m_next)
+        {
+            ++child;
+        }
+        if (node->m_next <= m_timeouts[child]->m_next)
+        {
+            break;
+        }
+        m_timeouts[index] = m_timeouts[child];
+        m_timeouts[index]->m_heap_index = index;
+        index = child;
+    }
+    m_timeouts[index] = node;
+    node->m_heap_index = index;
+}
+
+TimerManager::TimerManager(size_t shard_count)
+    : m_slack_us(g_timer_slack_us->getValue()),
+      m_profile_callbacks(g_profile_callbacks->getValue())
 {
-    m_previous_time = GetCurrentMS();
+    shard_count = shard_count == 0 ? 1 : shard_count;
+    m_shards.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        auto shard = std::make_unique<TimerShard>();
+        shard->m_queue = TimerQueue::Create(g_timer_backend->getValue());
+        m_shards.push_back(std::move(shard));
+    }
 }
 
 TimerManager::~TimerManager()
@@ -114,129 +331,321 @@ TimerManager::~TimerManager()
 }
 
 Timer::ptr TimerManager::addTimer(
-    uint64_t ms, std::function<void()> fn, bool cyclic)
+    uint64_t ms, Timer::TimerFunc fn, bool cyclic)
 {
-    Timer::ptr timer(new Timer(ms, fn, cyclic, this)); 
-    WriteScopedLock lock(&m_lock);
-    addTimer(timer, lock);
-    return timer;
+    return addNewTimer(new Timer(ms * 1000, std::move(fn), cyclic, this));
 }
 
-void TimerManager::addTimer(Timer::ptr timer, WriteScopedLock& lock)
+Timer::ptr TimerManager::addTimer(
+    std::chrono::microseconds delay, Timer::TimerFunc fn, bool cyclic)
 {
-    auto it = m_timers.insert(timer).first;
-    bool at_front = (it == m_timers.begin());
+    return addNewTimer(new Timer(ToMicroseconds(delay), std::move(fn), cyclic, this));
+}
+
+Timer::ptr TimerManager::addNewTimer(Timer* timer)
+{
+    Timer::ptr result(timer);
+    result->m_shard = getCurrentTimerShard() % m_shards.size();
+    ScopedLock lock(&m_shards[result->m_shard]->m_mutex);
+    addTimer(result, lock);
+    return result;
+}
+
+void TimerManager::addTimer(Timer::ptr timer, ScopedLock& lock)
+{
+    size_t shard = timer->m_shard;
+    bool at_front = m_shards[shard]->insert(timer);
     lock.unlock();
     if (at_front)
     {
-        onTimerInsertedAtFirst();
+        onTimerInsertedAtFirst(shard);
     }
 }
 
-static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> fn)
+Timer::ptr TimerManager::addConditionTimer(
+    uint64_t ms, Timer::TimerFunc fn, 
+    std::weak_ptr<void> weak_cond, bool cyclic)
 {
-    auto tmp = weak_cond.lock();
-    if (tmp)
-    {
-        fn();
-    }
+    Timer* timer = new Timer(ms * 1000, std::move(fn), cyclic, this);
+    timer->m_conditional = true;
+    timer->m_weak_cond = std::move(weak_cond);
+    return addNewTimer(timer);
 }
 
 Timer::ptr TimerManager::addConditionTimer(
-    uint64_t ms, std::function<void()> fn, 
+    std::chrono::microseconds delay, Timer::TimerFunc fn, 
     std::weak_ptr<void> weak_cond, bool cyclic)
 {
-    return addTimer(ms, std::bind(&OnTimer, weak_cond, fn), cyclic);
+    Timer* timer = new Timer(ToMicroseconds(delay), std::move(fn), cyclic, this);
+    timer->m_conditional = true;
+    timer->m_weak_cond = std::move(weak_cond);
+    return addNewTimer(timer);
 }
 
-uint64_t TimerManager::getNextTimer()
+void TimerManager::armTimeout(TimeoutNode& node, std::chrono::microseconds delay, Timer::TimerFunc fn)
+{
+    node.cancel();
+    node.m_manager = this;
+    node.m_shard = getCurrentTimerShard() % m_shards.size();
+    node.m_next = ApplySlack(Clock::CachedUS() + ToMicroseconds(delay), getTimerSlack());
+    node.m_fn = std::move(fn);
+    TimerShard& shard = *m_shards[node.m_shard];
+    ScopedLock lock(&shard.m_mutex);
+    bool at_front = shard.pushTimeout(&node);
+    lock.unlock();
+    if (at_front)
+    {
+        onTimerInsertedAtFirst(node.m_shard);
+    }
+}
+
+bool TimerManager::disarmTimeout(TimeoutNode& node)
 {
-    ReadScopedLock lock(&m_lock);
-    if (m_timers.empty())
+    TimerShard& shard = *m_shards[node.m_shard];
+    ScopedLock lock(&shard.m_mutex);
+    if (!shard.eraseTimeout(&node))
+    {
+        return false;
+    }
+    node.m_fn = nullptr;
+    return true;
+}
+
+// 把到期时间转换为剩余的等待时间(ms)
+static uint64_t ToTimeout(uint64_t deadline)
+{
+    if (deadline == ~0ull)
     {
         // 没有定时器
         return ~0ull;
     }
-    const Timer::ptr& next = *m_timers.begin();
-    uint64_t now_ms = GetCurrentMS();
-    if (now_ms >= next->m_next)
+    uint64_t now_us = Clock::CachedUS();
+    if (now_us >= deadline)
     {
         // 等待超时
         return 0;
     }
     else 
     {
-        // 返回剩余的等待时间
-        return next->m_next - now_ms;
+        // 返回剩余的等待时间，向上取整，避免提前醒来
+        return (deadline - now_us + 999) / 1000;
     }
 }
 
-void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& fns)
+uint64_t TimerManager::getNextTimer()
 {
-    uint64_t now_ms = GetCurrentMS();
-    std::vector<Timer::ptr> expired;
+    return ToTimeout(getNextDeadline());
+}
+
+uint64_t TimerManager::getNextTimer(size_t shard)
+{
+    return ToTimeout(getNextDeadline(shard));
+}
+
+uint64_t TimerManager::getNextDeadline()
+{
+    uint64_t deadline = ~0ull;
+    for (auto& shard : m_shards)
     {
-        ReadScopedLock lock(&m_lock);
-        if (m_timers.empty())
-        {
-            return;
-        }
+        deadline = std::min(deadline, shard->m_deadline_hint.load(std::memory_order_acquire));
     }
-    WriteScopedLock lock(&m_lock);
-    // 检查系统时间是否被修改
-    bool rollover = detectClockRollover(now_ms);
-    // 系统时间未被回拨，并且无定时器等待超时
-    if (!rollover && (*m_timers.begin())->m_next > now_ms)
+    return deadline;
+}
+
+uint64_t TimerManager::getNextDeadline(size_t shard)
+{
+    return m_shards[shard]->m_deadline_hint.load(std::memory_order_acquire);
+}
+
+void TimerManager::listExpiredCallback(std::vector<Timer::TimerFunc>& fns)
+{
+    for (size_t i = 0; i < m_shards.size(); i++)
     {
-        return;
+        listExpiredCallback(i, fns);
     }
-    Timer::ptr now_timer(new Timer(now_ms));
-    // 获取第一个 m_next 大于或等于 now_timer->m_next 的定时器的迭代器
-    // 就是已经等待到达或超时的定时器。
-    // ** 如果系统时间被修改过，直接认定所有定时器均超时 **
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-    // 包括上到达指定时间的定时器
-    while (it != m_timers.end() && (*it)->m_next == now_timer->m_next)
+}
+
+void TimerManager::listExpiredCallback(size_t index, std::vector<Timer::TimerFunc>& fns)
+{
+    TimerShard& shard = *m_shards[index];
+    uint64_t now_us = Clock::CachedUS();
+    // 下界还没有到达，不可能有定时器到期
+    if (shard.m_deadline_hint.load(std::memory_order_acquire) > now_us)
     {
-        ++it;
+        return;
     }
-    // 取出超时的定时器
-    expired.insert(expired.begin(), m_timers.begin(), it);
-    m_timers.erase(m_timers.begin(), it);
-    fns.reserve(expired.size());
+    std::vector<Timer::ptr> expired;
+    ScopedLock lock(&shard.m_mutex);
+    // 单调时钟不会回拨，不必再检查系统时间是否被修改
+    shard.m_queue->popExpired(now_us, expired);
+    size_t begin = fns.size();
+    fns.reserve(fns.size() + expired.size());
     for (auto& timer : expired)
     {
-        fns.push_back(timer->m_fn);
+        m_lateness_hist.record(now_us > timer->m_next ? now_us - timer->m_next : 0);
+        // 条件定时器的执行条件已经失效，跳过本次执行
+        bool skip = timer->m_conditional && timer->m_weak_cond.expired();
         // 处理周期定时器
         if (timer->m_cyclic)
         {
-            timer->m_next = now_ms + timer->m_ms;
-            m_timers.insert(timer);
+            if (!skip)
+            {
+                // 周期定时器的回调需要反复执行，以共享的方式交给调度器
+                const std::type_info& type = timer->m_cyclic_fn->target_type();
+                fns.push_back(profile([fn = timer->m_cyclic_fn]() { (*fn)(); }, type));
+            }
+            timer->restart(now_us);
+            shard.m_queue->insert(timer);
         }
         else
         {
-            timer->m_fn = nullptr;
+            if (!skip)
+            {
+                const std::type_info& type = timer->m_fn.target_type();
+                fns.push_back(profile(std::move(timer->m_fn), type));
+            }
+            timer->clearCallback();
+            --shard.m_counts[timer->getType()];
         }
-    }    
+    }
+    // 到期的超时节点的回调移出节点，之后不再访问节点
+    while (!shard.m_timeouts.empty() && shard.m_timeouts.front()->m_next <= now_us)
+    {
+        TimeoutNode* node = shard.popTimeout();
+        m_lateness_hist.record(now_us - node->m_next);
+        const std::type_info& type = node->m_fn.target_type();
+        fns.push_back(profile(std::move(node->m_fn), type));
+    }
+    if (fns.size() != begin)
+    {
+        m_batch_hist.record(fns.size() - begin);
+    }
+    // 下界已经过去，更新为准确的值，周期定时器也已经重新加入
+    shard.m_deadline_hint.store(shard.nextDeadline(), std::memory_order_release);
+}
+
+size_t TimerManager::listAllCallback(std::vector<Timer::TimerFunc>& fns)
+{
+    size_t count = 0;
+    for (auto& shard : m_shards)
+    {
+        ScopedLock lock(&shard->m_mutex);
+        std::vector<Timer::ptr> timers;
+        shard->m_queue->popAll(timers);
+        // 超时节点与单次定时器一样提前执行
+        count += shard->m_timeouts.size();
+        while (!shard->m_timeouts.empty())
+        {
+            fns.push_back(std::move(shard->popTimeout()->m_fn));
+        }
+        shard->m_deadline_hint.store(~0ull, std::memory_order_release);
+        std::fill(std::begin(shard->m_counts), std::end(shard->m_counts), 0);
+        count += timers.size();
+        fns.reserve(fns.size() + timers.size());
+        for (auto& timer : timers)
+        {
+            bool skip = timer->m_conditional && timer->m_weak_cond.expired();
+            if (!timer->m_cyclic && !skip)
+            {
+                fns.push_back(std::move(timer->m_fn));
+            }
+            timer->clearCallback();
+        }
+    }
+    return count;
 }
 
 bool TimerManager::hasTimer() 
 {
-    ReadScopedLock lock(&m_lock);
-    return !m_timers.empty();
+    // 分片为空时下界一定是 ~0ull
+    return getNextDeadline() != ~0ull;
 }
 
-bool TimerManager::detectClockRollover(uint64_t now_ms)
+size_t TimerManager::getTimerCount(size_t shard)
 {
-    bool rollover = false;
-    // 系统时间被回拨超过一个小时
-    if (now_ms < m_previous_time && 
-        now_ms < (m_previous_time - 60 * 60 * 1000))
+    ScopedLock lock(&m_shards[shard]->m_mutex);
+    return m_shards[shard]->m_queue->size() + m_shards[shard]->m_timeouts.size();
+}
+
+TimerStats TimerManager::getTimerStats() const
+{
+    TimerStats stats;
+    for (auto& shard : m_shards)
     {
-        rollover = true;
+        ScopedLock lock(&shard->m_mutex);
+        stats.oneshot += shard->m_counts[Timer::ONESHOT];
+        stats.cyclic += shard->m_counts[Timer::CYCLIC];
+        stats.conditional += shard->m_counts[Timer::CONDITIONAL];
+        stats.timeouts += shard->m_timeouts.size();
     }
-    m_previous_time = now_ms;
-    return rollover;
+    stats.lateness_us = m_lateness_hist.snapshot();
+    stats.fired_per_batch = m_batch_hist.snapshot();
+    ScopedLock lock(&m_slow_mutex);
+    stats.slowest = m_slowest;
+    return stats;
+}
+
+void TimerManager::resetTimerStats()
+{
+    m_lateness_hist.reset();
+    m_batch_hist.reset();
+    ScopedLock lock(&m_slow_mutex);
+    m_slowest.clear();
+    m_slow_threshold.store(0, std::memory_order_relaxed);
+}
+
+Timer::TimerFunc TimerManager::profile(Timer::TimerFunc fn, const std::type_info& type)
+{
+    if (!m_profile_callbacks.load(std::memory_order_relaxed))
+    {
+        return fn;
+    }
+    // type_info 是静态存储的，可以只保存指针
+    return [this, type = &type, fn = std::move(fn)]() mutable {
+        uint64_t begin = Clock::NowUS();
+        fn();
+        recordCallbackDuration(*type, Clock::NowUS() - begin);
+    };
+}
+
+void TimerManager::recordCallbackDuration(const std::type_info& type, uint64_t duration_us)
+{
+    if (duration_us <= m_slow_threshold.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    SlowTimerCallback entry{status == 0 ? demangled : type.name(), duration_us};
+    free(demangled);
+    ScopedLock lock(&m_slow_mutex);
+    // 每种回调只保留一项最大耗时，同一个周期定时器反复变慢时不会挤掉其他回调
+    auto same = std::find_if(m_slowest.begin(), m_slowest.end(),
+        [&entry](const SlowTimerCallback& slow) { return slow.name == entry.name; });
+    if (same != m_slowest.end())
+    {
+        if (duration_us <= same->duration_us)
+        {
+            return;
+        }
+        m_slowest.erase(same);
+    }
+    auto it = std::upper_bound(m_slowest.begin(), m_slowest.end(), duration_us,
+        [](uint64_t duration, const SlowTimerCallback& slow) { return duration > slow.duration_us; });
+    m_slowest.insert(it, std::move(entry));
+    if (m_slowest.size() > SLOW_CALLBACK_COUNT)
+    {
+        m_slowest.pop_back();
+    }
+    if (m_slowest.size() == SLOW_CALLBACK_COUNT)
+    {
+        m_slow_threshold.store(m_slowest.back().duration_us, std::memory_order_relaxed);
+    }
+}
+
+const char* TimerManager::getTimerBackendName() const
+{
+    return m_shards[0]->m_queue->getName();
 }
 
 }
@@ -0,0 +1,337 @@
+#include "timer_queue.h"
+#include "clock.h"
+#include "log.h"
+#include <algorithm>
+
+namespace zjl
+{
+
+static Logger::ptr system_logger = GET_LOGGER("system");
+
+TimerQueue::ptr TimerQueue::Create(const std::string& backend)
+{
+    if (backend == "wheel")
+    {
+        return std::make_unique<TimingWheel>();
+    }
+    if (backend != "set")
+    {
+        LOG_FMT_WARN(system_logger, "未知的定时器后端 %s，使用 set", backend.c_str());
+    }
+    return std::make_unique<SetTimerQueue>();
+}
+
+/**
+ * ===================================================
+ * SetTimerQueue 类的实现
+ * ===================================================
+*/
+
+bool SetTimerQueue::insert(const Timer::ptr& timer)
+{
+    auto it = m_timers.insert(timer).first;
+    return it == m_timers.begin();
+}
+
+bool SetTimerQueue::erase(Timer* timer)
+{
+    auto it = m_timers.find(timer->shared_from_this());
+    if (it == m_timers.end())
+    {
+        return false;
+    }
+    m_timers.erase(it);
+    return true;
+}
+
+uint64_t SetTimerQueue::nextDeadline()
+{
+    return m_timers.empty() ? ~0ull : (*m_timers.begin())->m_next;
+}
+
+void SetTimerQueue::popExpired(uint64_t now_us, std::vector<Timer::ptr>& expired)
+{
+    // 无定时器等待超时
+    if (m_timers.empty() || (*m_timers.begin())->m_next > now_us)
+    {
+        return;
+    }
+    Timer::ptr now_timer(new Timer(now_us));
+    // 获取第一个 m_next 大于或等于 now_timer->m_next 的定时器的迭代器
+    // 就是已经等待到达或超时的定时器。
+    auto it = m_timers.lower_bound(now_timer);
+    // 包括上到达指定时间的定时器
+    while (it != m_timers.end() && (*it)->m_next == now_timer->m_next)
+    {
+        ++it;
+    }
+    // 取出超时的定时器
+    expired.insert(expired.end(), m_timers.begin(), it);
+    m_timers.erase(m_timers.begin(), it);
+}
+
+void SetTimerQueue::popAll(std::vector<Timer::ptr>& timers)
+{
+    timers.insert(timers.end(), m_timers.begin(), m_timers.end());
+    m_timers.clear();
+}
+
+/**
+ * ===================================================
+ * TimingWheel 类的实现
+ * ===================================================
+*/
+
+TimingWheel::TimingWheel()
+    : m_current(Clock::CachedUS() / TICK_US)
+{
+}
+
+TimingWheel::~TimingWheel()
+{
+    // 释放定时器持有的自身引用
+    std::vector<Timer::ptr> timers;
+    popAll(timers);
+}
+
+bool TimingWheel::insert(const Timer::ptr& timer)
+{
+    // 空的时间轮直接跳到当前时间，不必逐个刻度地推进
+    if (m_count == 0)
+    {
+        m_current = Clock::CachedUS() / TICK_US;
+    }
+    timer->m_wheel_ref = timer;
+    link(timer.get());
+    ++m_count;
+    bool earliest = !m_cache_valid || timer->m_next < m_cached_deadline;
+    if (m_cache_valid && earliest)
+    {
+        m_cached_deadline = timer->m_next;
+    }
+    return earliest;
+}
+
+bool TimingWheel::erase(Timer* timer)
+{
+    if (timer->m_wheel_slot < 0)
+    {
+        return false;
+    }
+    unlink(timer);
+    --m_count;
+    // 移除的可能是最早到期的定时器
+    if (m_cache_valid && timer->m_next <= m_cached_deadline)
+    {
+        m_cache_valid = false;
+    }
+    // 调用者持有定时器的引用，这里释放自身引用不会析构定时器
+    timer->m_wheel_ref.reset();
+    return true;
+}
+
+uint64_t TimingWheel::nextDeadline()
+{
+    if (m_count == 0)
+    {
+        return ~0ull;
+    }
+    if (!m_cache_valid)
+    {
+        m_cached_deadline = computeNextDeadline();
+        m_cache_valid = true;
+    }
+    return m_cached_deadline;
+}
+
+void TimingWheel::popExpired(uint64_t now_us, std::vector<Timer::ptr>& expired)
+{
+    uint64_t now_tick = now_us / TICK_US;
+    if (m_count == 0)
+    {
+        m_current = std::max(m_current, now_tick);
+        return;
+    }
+    size_t begin = expired.size();
+    // 长时间没有推进，重建整个时间轮
+    if (now_tick > m_current && now_tick - m_current > MAX_ADVANCE_TICKS)
+    {
+        std::vector<Timer::ptr> timers;
+        popAll(timers);
+        m_current = now_tick;
+        for (auto& timer : timers)
+        {
+            timer->m_wheel_ref = timer;
+            link(timer.get());
+            ++m_count;
+        }
+    }
+    // 之前的刻度的槽位整体到期
+    static constexpr uint64_t MASK = SLOT_COUNT - 1;
+    bool cascaded = false;
+    while (m_current < now_tick)
+    {
+        takeSlot(m_current & MASK, expired);
+        ++m_current;
+        cascaded |= cascade();
+    }
+    // 当前刻度的槽位中只取出已经到期的定时器
+    Timer* timer = m_slots[m_current & MASK];
+    while (timer)
+    {
+        Timer* next = timer->m_wheel_next;
+        if (timer->m_next <= now_us)
+        {
+            unlink(timer);
+            --m_count;
+            expired.push_back(std::move(timer->m_wheel_ref));
+        }
+        timer = next;
+    }
+    // 缓存的可能是高层槽位起点这样的下界，重新分配之后或者下界已经过去时不再有效，
+    // 否则调用者会一直拿到过去的到期时间而空转
+    if (expired.size() != begin || cascaded || (m_cache_valid && m_cached_deadline <= now_us))
+    {
+        m_cache_valid = false;
+    }
+}
+
+void TimingWheel::popAll(std::vector<Timer::ptr>& timers)
+{
+    for (size_t slot = 0; slot < LEVEL_COUNT * SLOT_COUNT; slot++)
+    {
+        takeSlot(slot, timers);
+    }
+    m_cache_valid = false;
+}
+
+void TimingWheel::link(Timer* timer)
+{
+    uint64_t tick = std::max(timer->m_next / TICK_US, m_current);
+    uint64_t delta = tick - m_current;
+    size_t level = 0;
+    while (level + 1 < LEVEL_COUNT && delta >= (1ull << (SLOT_BITS * (level + 1))))
+    {
+        ++level;
+    }
+    // 超出最高层的范围时先放在最远的槽位上，到时再重新分配
+    static constexpr uint64_t MAX_DELTA = (1ull << (SLOT_BITS * LEVEL_COUNT)) - 1;
+    if (delta > MAX_DELTA)
+    {
+        tick = m_current + MAX_DELTA;
+    }
+    size_t slot = level * SLOT_COUNT + ((tick >> (SLOT_BITS * level)) & (SLOT_COUNT - 1));
+    timer->m_wheel_slot = static_cast<int>(slot);
+    timer->m_wheel_prev = nullptr;
+    timer->m_wheel_next = m_slots[slot];
+    if (m_slots[slot])
+    {
+        m_slots[slot]->m_wheel_prev = timer;
+    }
+    m_slots[slot] = timer;
+}
+
+void TimingWheel::unlink(Timer* timer)
+{
+    if (timer->m_wheel_prev)
+    {
+        timer->m_wheel_prev->m_wheel_next = timer->m_wheel_next;
+    }
+    else
+    {
+        m_slots[timer->m_wheel_slot] = timer->m_wheel_next;
+    }
+    if (timer->m_wheel_next)
+    {
+        timer->m_wheel_next->m_wheel_prev = timer->m_wheel_prev;
+    }
+    timer->m_wheel_prev = nullptr;
+    timer->m_wheel_next = nullptr;
+    timer->m_wheel_slot = -1;
+}
+
+void TimingWheel::takeSlot(size_t slot, std::vector<Timer::ptr>& timers)
+{
+    size_t begin = timers.size();
+    Timer* timer = m_slots[slot];
+    m_slots[slot] = nullptr;
+    while (timer)
+    {
+        Timer* next = timer->m_wheel_next;
+        timer->m_wheel_prev = nullptr;
+        timer->m_wheel_next = nullptr;
+        timer->m_wheel_slot = -1;
+        timers.push_back(std::move(timer->m_wheel_ref));
+        --m_count;
+        timer = next;
+    }
+    // 新的定时器挂在链表头部，反转后按加入的顺序执行
+    std::reverse(timers.begin() + static_cast<std::ptrdiff_t>(begin), timers.end());
+}
+
+bool TimingWheel::cascade()
+{
+    bool moved = false;
+    for (size_t level = 1; level < LEVEL_COUNT; level++)
+    {
+        size_t shift = SLOT_BITS * level;
+        // 只有到达本层槽位的起点时才需要重新分配，更高层同理
+        if (m_current & ((1ull << shift) - 1))
+        {
+            break;
+        }
+        size_t slot = level * SLOT_COUNT + ((m_current >> shift) & (SLOT_COUNT - 1));
+        Timer* timer = m_slots[slot];
+        m_slots[slot] = nullptr;
+        moved |= timer != nullptr;
+        while (timer)
+        {
+            Timer* next = timer->m_wheel_next;
+            link(timer);
+            timer = next;
+        }
+    }
+    return moved;
+}
+
+uint64_t TimingWheel::computeNextDeadline() const
+{
+    static constexpr uint64_t MASK = SLOT_COUNT - 1;
+    uint64_t best = ~0ull;
+    // 第 0 层按刻度顺序找到第一个非空的槽位，槽位中的定时器都在同一个刻度内，取精确的最小值
+    for (size_t i = 0; i < SLOT_COUNT; i++)
+    {
+        const Timer* timer = m_slots[(m_current + i) & MASK];
+        if (!timer)
+        {
+            continue;
+        }
+        for (; timer; timer = timer->m_wheel_next)
+        {
+            best = std::min(best, timer->m_next);
+        }
+        break;
+    }
+    // 高层的槽位以起点作为下界，到达起点时会重新分配到低层，再得到精确的到期时间
+    for (size_t level = 1; level < LEVEL_COUNT; level++)
+    {
+        size_t shift = SLOT_BITS * level;
+        uint64_t block = m_current >> shift;
+        for (uint64_t i = 1; i <= SLOT_COUNT; i++)
+        {
+            uint64_t start_us = ((block + i) << shift) * TICK_US;
+            if (start_us >= best)
+            {
+                break;
+            }
+            if (m_slots[level * SLOT_COUNT + ((block + i) & MASK)])
+            {
+                best = start_us;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+} // namespace zjl
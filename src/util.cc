@@ -3,7 +3,7 @@
 #include <execinfo.h>
 #include <iostream>
 #include <cxxabi.h>
-#include <sys/time.h>
+#include <time.h>
 
 namespace zjl
 {
@@ -88,16 +88,15 @@ std::string BacktraceToString(int size, int skip)
 
 uint64_t GetCurrentMS()
 {
-    timeval tv;
-    gettimeofday(&tv, nullptr);
-    return tv.tv_sec * 1000ul + tv.tv_usec / 1000;
+    return GetCurrentUS() / 1000;
 }
 
 uint64_t GetCurrentUS()
 {
-    timeval tv;
-    gettimeofday(&tv, nullptr);
-    return tv.tv_sec * 1000ul * 1000ul + tv.tv_usec;
+    // gettimeofday 会随系统时间的调整而跳变，计算时间间隔使用单调时钟
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ul * 1000ul + ts.tv_nsec / 1000;
 }
 
 } // namespace zjl
@@ -0,0 +1,221 @@
+#include "config.h"
+#include "fd_manager.h"
+#include "io_manager.h"
+#include "log.h"
+#include "util.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+zjl::Logger::ptr g_logger = GET_ROOT_LOGGER();
+
+struct PingPongResult
+{
+    double round_trips_per_second = 0;
+    double ctl_per_round_trip = 0;  // 每次往返的 epoll_ctl 调用次数
+    double wait_per_round_trip = 0; // 每次往返的 epoll_wait 调用次数
+    double cpu_us_per_round_trip = 0; // 每次往返消耗的进程 CPU 时间
+    zjl::ReactorStats stats;          // 第一个事件循环的运行统计
+};
+
+// 进程累计消耗的 CPU 时间（用户态加内核态）
+static uint64_t GetCpuUS()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ul +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/**
+ * @brief 在回环 TCP 连接上做 count 次请求/响应往返，统计吞吐量与轮询器的系统调用次数
+ * 每次往返两端各有一次读挂起，是 epoll_ctl 开销最集中的场景
+ * @param persistent 是否使用常驻的边缘触发注册
+ * @param busy_poll_us 空闲线程阻塞之前忙轮询的时间
+*/
+PingPongResult BENCH_pingPong(size_t thread_count, size_t count, bool persistent, int busy_poll_us = 0)
+{
+    zjl::Config::Lookup<bool>("iomanager.persistent_registration")->setValue(persistent);
+    zjl::Config::Lookup<int>("iomanager.busy_poll_us")->setValue(busy_poll_us);
+    PingPongResult result;
+    std::atomic_int port{0};
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    uint64_t ctl_count = 0;
+    uint64_t wait_count = 0;
+    uint64_t cpu_us = 0;
+    {
+        zjl::IOManager iom(thread_count, false, persistent ? "persistent" : "rearm");
+        iom.schedule([&port, count]() {
+            int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listen_fd, (struct sockaddr*)(&addr), sizeof(addr));
+            listen(listen_fd, 16);
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, (struct sockaddr*)(&addr), &len);
+            port = ntohs(addr.sin_port);
+            int fd = accept(listen_fd, nullptr, nullptr);
+            char buffer[64];
+            for (size_t i = 0; i < count; i++)
+            {
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                assert(n > 0);
+                write(fd, buffer, n);
+            }
+            close(fd);
+            close(listen_fd);
+        });
+        while (port == 0)
+        {
+            usleep(1000);
+        }
+        iom.schedule([&]() {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int rt = connect(fd, (struct sockaddr*)(&addr), sizeof(addr));
+            assert(rt == 0);
+            char buffer[64] = "ping";
+            // 只统计往返阶段的系统调用
+            ctl_count = iom.getPollerCtlCount();
+            wait_count = iom.getPollerWaitCount();
+            cpu_us = GetCpuUS();
+            begin = zjl::GetCurrentUS();
+            for (size_t i = 0; i < count; i++)
+            {
+                write(fd, buffer, sizeof(buffer));
+                ssize_t n = read(fd, buffer, sizeof(buffer));
+                assert(n > 0);
+            }
+            end = zjl::GetCurrentUS();
+            cpu_us = GetCpuUS() - cpu_us;
+            ctl_count = iom.getPollerCtlCount() - ctl_count;
+            wait_count = iom.getPollerWaitCount() - wait_count;
+            close(fd);
+        });
+        iom.stop();
+        result.stats = iom.getReactorStats(0);
+    }
+    zjl::Config::Lookup<bool>("iomanager.persistent_registration")->setValue(false);
+    zjl::Config::Lookup<int>("iomanager.busy_poll_us")->setValue(0);
+    double seconds = (end - begin) / 1000000.0;
+    result.round_trips_per_second = count / seconds;
+    result.ctl_per_round_trip = static_cast<double>(ctl_count) / count;
+    result.wait_per_round_trip = static_cast<double>(wait_count) / count;
+    result.cpu_us_per_round_trip = static_cast<double>(cpu_us) / count;
+    return result;
+}
+
+/**
+ * @brief 每个工作线程上有 pairs_per_thread 对协程在 socketpair 上往返 count 次，每次读取都设置了接收超时，
+ * 读取挂起时添加超时定时器、被唤醒后取消，是定时器锁竞争最集中的场景
+ * @param shards 是否按工作线程拆分定时器
+ * @return 每秒完成的带超时的读取次数
+*/
+double BENCH_timeoutReads(size_t thread_count, size_t pairs_per_thread, size_t count, bool shards)
+{
+    zjl::Config::Lookup<bool>("iomanager.timer_shards")->setValue(shards);
+    size_t pair_count = thread_count * pairs_per_thread;
+    std::vector<int> fds(pair_count * 2);
+    for (size_t i = 0; i < pair_count; i++)
+    {
+        int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i * 2]);
+        assert(rt == 0);
+    }
+    std::atomic_size_t done{0};
+    uint64_t begin = zjl::GetCurrentUS();
+    {
+        zjl::IOManager iom(thread_count, false, shards ? "sharded" : "unsharded");
+        assert(iom.getTimerShardCount() == (shards ? thread_count : 1));
+        for (size_t i = 0; i < pair_count * 2; i++)
+        {
+            iom.schedule([&fds, &done, i, count]() {
+                // socketpair 没有经过 hook 创建，先登记为 socket，再设置接收超时
+                int fd = fds[i];
+                zjl::FileDescriptorManager::GetInstance()->get(fd, true);
+                timeval tv{5, 0};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                char c = 'x';
+                // 每对中的偶数端先写，两端交替读写
+                bool writer = i % 2 == 0;
+                for (size_t j = 0; j < count; j++)
+                {
+                    if (writer)
+                    {
+                        write(fd, &c, 1);
+                    }
+                    ssize_t n = read(fd, &c, 1);
+                    assert(n == 1);
+                    if (!writer)
+                    {
+                        write(fd, &c, 1);
+                    }
+                }
+                ++done;
+            });
+        }
+        iom.stop();
+    }
+    uint64_t end = zjl::GetCurrentUS();
+    assert(done == pair_count * 2);
+    for (int fd : fds)
+    {
+        close(fd);
+    }
+    zjl::Config::Lookup<bool>("iomanager.timer_shards")->setValue(true);
+    return pair_count * 2 * count / ((end - begin) / 1000000.0);
+}
+
+int main(int argc, char** argv)
+{
+    g_logger->setLevel(zjl::LogLevel::INFO);
+    GET_LOGGER("system")->setLevel(zjl::LogLevel::INFO);
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    for (size_t threads : {1, 2})
+    {
+        for (bool persistent : {false, true})
+        {
+            PingPongResult r = BENCH_pingPong(threads, count, persistent);
+            LOG_FMT_INFO(g_logger,
+                         "threads = %zu, %s: %.0f round trips/s, epoll_ctl %.2f/rt, epoll_wait %.2f/rt",
+                         threads, persistent ? "persistent" : "re-arm", r.round_trips_per_second,
+                         r.ctl_per_round_trip, r.wait_per_round_trip);
+        }
+    }
+    // 忙轮询：以 CPU 时间换取唤醒延迟
+    for (size_t threads : {1, 2})
+    {
+        for (int busy_poll_us : {0, 50})
+        {
+            PingPongResult r = BENCH_pingPong(threads, count, false, busy_poll_us);
+            LOG_FMT_INFO(g_logger,
+                         "threads = %zu, busy poll %d us: %.1f us/rt, cpu %.1f us/rt, "
+                         "spin hits = %lu, misses = %lu, spin time = %lu us, tickles saved = %lu",
+                         threads, busy_poll_us, 1000000.0 / r.round_trips_per_second,
+                         r.cpu_us_per_round_trip, r.stats.busy_poll_hits, r.stats.busy_poll_misses,
+                         r.stats.busy_poll_us, r.stats.tickles_saved);
+        }
+    }
+    // 定时器分片：多个线程同时添加、取消读取超时的定时器
+    for (size_t threads : {2, 4})
+    {
+        for (bool shards : {false, true})
+        {
+            double reads = BENCH_timeoutReads(threads, 16, count / 10, shards);
+            LOG_FMT_INFO(g_logger, "threads = %zu, timer shards %s: %.0f timeout-guarded reads/s",
+                         threads, shards ? "on" : "off", reads);
+        }
+    }
+    return 0;
+}
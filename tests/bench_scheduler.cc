@@ -0,0 +1,55 @@
+#include "log.h"
+#include "scheduler.h"
+#include "util.h"
+#include <atomic>
+#include <cstdlib>
+
+zjl::Logger::ptr g_logger = GET_ROOT_LOGGER();
+
+static std::atomic_uint64_t s_counter{0};
+
+/**
+ * @brief 统计调度器执行 count 个极小回调任务的吞吐量
+ * @param run_inline 是否以内联任务的方式提交
+ * @return 每秒执行的任务数量
+*/
+double BENCH_tinyTasks(size_t thread_count, size_t count, bool run_inline)
+{
+    s_counter = 0;
+    zjl::Scheduler sc(thread_count, false, run_inline ? "inline" : "fiber");
+    // 先提交全部任务，再启动调度器，只统计执行阶段的耗时
+    for (size_t i = 0; i < count; i++)
+    {
+        if (run_inline)
+        {
+            sc.scheduleInline([]() { ++s_counter; });
+        }
+        else
+        {
+            sc.schedule([]() { ++s_counter; });
+        }
+    }
+    uint64_t begin = zjl::GetCurrentUS();
+    sc.start();
+    sc.stop();
+    uint64_t end = zjl::GetCurrentUS();
+    assert(s_counter == count);
+    double seconds = (end - begin) / 1000000.0;
+    return count / seconds;
+}
+
+int main(int argc, char** argv)
+{
+    g_logger->setLevel(zjl::LogLevel::INFO);
+    GET_LOGGER("system")->setLevel(zjl::LogLevel::INFO);
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    for (size_t threads : {1, 4})
+    {
+        double fiber_rate = BENCH_tinyTasks(threads, count, false);
+        double inline_rate = BENCH_tinyTasks(threads, count, true);
+        LOG_FMT_INFO(g_logger,
+                     "threads = %zu, tasks = %zu: fiber %.0f tasks/s, inline %.0f tasks/s (x%.1f)",
+                     threads, count, fiber_rate, inline_rate, inline_rate / fiber_rate);
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "callable.h"
+#include "log.h"
+#include "scheduler.h"
+#include <array>
+#include <cassert>
+#include <memory>
+#include <typeinfo>
+
+zjl::Logger::ptr g_logger = GET_ROOT_LOGGER();
+
+static int ReturnFour()
+{
+    return 4;
+}
+
+// 测试小对象存放在内联缓冲区，大对象退化为堆分配
+void TEST_inlineStorage()
+{
+    LOG_DEBUG(g_logger, "Call TEST_inlineStorage() 测试内联缓冲区");
+    int a = 1;
+    int b = 2;
+    zjl::Callable<int()> small = [a, b]() { return a + b; };
+    assert(small.isInline());
+    assert(small() == 3);
+
+    std::array<char, 128> big{};
+    big[0] = 7;
+    zjl::Callable<int()> large = [big]() { return big[0]; };
+    assert(!large.isInline());
+    assert(large() == 7);
+
+    // 移动后原对象为空
+    zjl::Callable<int()> moved = std::move(small);
+    assert(!small);
+    assert(moved() == 3);
+
+    zjl::Callable<int()> empty;
+    assert(!empty);
+    // 记录被包装的函数对象的类型，内联与堆上的对象相同
+    assert(empty.target_type() == typeid(void));
+    auto one = []() { return 1; };
+    assert(zjl::Callable<int()>(one).target_type() == typeid(one));
+    assert(large.target_type() != moved.target_type());
+    void (*null_fn)() = nullptr;
+    zjl::Callable<void()> from_null = null_fn;
+    assert(!from_null);
+    // 函数的引用退化为函数指针
+    zjl::Callable<int()> from_function(ReturnFour);
+    assert(from_function && from_function() == 4);
+}
+
+// 测试捕获只可移动的对象
+void TEST_moveOnlyCapture()
+{
+    LOG_DEBUG(g_logger, "Call TEST_moveOnlyCapture() 测试捕获 std::unique_ptr");
+    auto value = std::make_unique<int>(42);
+    zjl::Callable<int(int)> fn = [p = std::move(value)](int x) { return *p + x; };
+    assert(fn.isInline());
+    assert(fn(1) == 43);
+}
+
+// 测试调度器接受捕获了只可移动对象的任务
+void TEST_scheduleMoveOnlyTask()
+{
+    LOG_DEBUG(g_logger, "Call TEST_scheduleMoveOnlyTask() 测试调度只可移动的任务");
+    std::atomic_int sum{0};
+    zjl::Scheduler sc(2, false, "callable");
+    sc.start();
+    for (int i = 0; i < 10; i++)
+    {
+        auto value = std::make_unique<int>(i);
+        sc.schedule([&sum, p = std::move(value)]() { sum += *p; });
+    }
+    sc.stop();
+    LOG_FMT_DEBUG(g_logger, "sum = %d", sum.load());
+    assert(sum == 45);
+}
+
+int main()
+{
+    TEST_inlineStorage();
+    TEST_moveOnlyCapture();
+    TEST_scheduleMoveOnlyTask();
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "clock.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include <cassert>
+#include <thread>
+#include <unistd.h>
+
+zjl::Logger::ptr g_logger = GET_ROOT_LOGGER();
+
+// 测试两个时间源的起点相同且单调递增
+void TEST_source()
+{
+    for (const char* name : {"monotonic", "coarse"})
+    {
+        zjl::Config::Lookup<std::string>("clock.source")->setValue(name);
+        assert(std::string(zjl::Clock::GetSourceName()) == name);
+        uint64_t resolution = zjl::Clock::GetResolutionUS();
+        uint64_t last = 0;
+        for (int i = 0; i < 100000; i++)
+        {
+            uint64_t now = zjl::Clock::NowUS();
+            assert(now >= last);
+            last = now;
+        }
+        // 粗粒度的时钟只在时钟中断时更新，虚拟机上中断可能推迟，允许落后几个精度
+        uint64_t precise = zjl::GetCurrentUS();
+        uint64_t now = zjl::Clock::NowUS();
+        assert(now <= zjl::GetCurrentUS());
+        assert(now + 4 * resolution + 1000 >= precise);
+        LOG_FMT_INFO(g_logger, "source: %s, resolution = %lu us", name, resolution);
+    }
+    zjl::Config::Lookup<std::string>("clock.source")->setValue("monotonic");
+    assert(zjl::Clock::GetSource() == zjl::Clock::MONOTONIC);
+}
+
+// 测试缓存的时间只在本线程内有效，清除后重新读取时钟
+void TEST_cache()
+{
+    uint64_t cached = zjl::Clock::UpdateCachedUS();
+    usleep(2000);
+    assert(zjl::Clock::CachedUS() == cached);
+    std::thread([cached]() {
+        assert(zjl::Clock::CachedUS() >= cached + 2000);
+    }).join();
+    zjl::Clock::ClearCachedUS();
+    assert(zjl::Clock::CachedUS() >= cached + 2000);
+}
+
+int main()
+{
+    TEST_source();
+    TEST_cache();
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "config.h"
 #include "log.h"
 #include "yaml-cpp/yaml.h"
+#include <cassert>
 #include <cstdint>
 #include <iostream>
 #include <list>
@@ -160,6 +161,23 @@ void TEST_nonexistentConfig()
     }
 }
 
+// 测试同一个配置项上的多个变更事件处理器互不覆盖，删除一个不影响另一个
+void TEST_multipleListeners()
+{
+    auto var = zjl::Config::Lookup<int>("test.listeners", 0, "test listeners");
+    int first = 0;
+    int second = 0;
+    uint64_t first_id = var->addListener([&first](const int&, const int& new_value) { first = new_value; });
+    uint64_t second_id = var->addListener([&second](const int&, const int& new_value) { second = new_value; });
+    assert(first_id != second_id);
+    var->setValue(1);
+    assert(first == 1 && second == 1);
+    var->delListener(first_id);
+    var->setValue(2);
+    assert(first == 1 && second == 2);
+    var->delListener(second_id);
+}
+
 int main()
 {
     config_system_port->addListener(
@@ -175,6 +193,7 @@ int main()
     TEST_ConfigVarToString();
     TEST_GetConfigVarValue();
     TEST_nonexistentConfig();
+    TEST_multipleListeners();
 
     YAML::Node node;
     auto str = node["node"] ? node["node"].as<std::string>() : "";
@@ -0,0 +1,81 @@
+#include "histogram.h"
+#include "log.h"
+#include "thread.h"
+#include <cassert>
+#include <vector>
+
+zjl::Logger::ptr g_logger = GET_ROOT_LOGGER();
+
+// 测试桶的划分：小于 8 的样本精确记录，之后每个桶的相对宽度不超过 1/8
+void TEST_buckets()
+{
+    for (uint64_t value = 0; value < 100000; value++)
+    {
+        size_t index = zjl::Histogram::BucketIndex(value);
+        uint64_t upper = zjl::Histogram::BucketUpperBound(index);
+        assert(upper >= value);
+        assert(upper - value <= value / 8);
+        assert(index == 0 || zjl::Histogram::BucketUpperBound(index - 1) < value);
+    }
+    size_t last = zjl::Histogram::BucketIndex(~0ull);
+    assert(last == zjl::Histogram::BUCKET_COUNT - 1);
+    assert(zjl::Histogram::BucketUpperBound(last) == ~0ull);
+}
+
+// 测试分位数
+void TEST_percentile()
+{
+    zjl::Histogram histogram;
+    for (uint64_t value = 1; value <= 1000; value++)
+    {
+        histogram.record(value);
+    }
+    zjl::HistogramSnapshot snapshot = histogram.snapshot();
+    LOG_FMT_INFO(g_logger, "percentile: %s", snapshot.toString().c_str());
+    assert(snapshot.count == 1000);
+    assert(snapshot.max == 1000);
+    assert(snapshot.mean() == 500.5);
+    uint64_t p50 = snapshot.percentile(50);
+    uint64_t p99 = snapshot.percentile(99);
+    assert(p50 >= 500 && p50 <= 500 + 500 / 8);
+    assert(p99 >= 990 && p99 <= 1000);
+    assert(snapshot.percentile(100) == 1000);
+    histogram.reset();
+    assert(histogram.snapshot().count == 0);
+    assert(histogram.snapshot().percentile(99) == 0);
+}
+
+// 测试多个线程并发记录
+void TEST_concurrentRecord()
+{
+    static const int THREAD_COUNT = 4;
+    static const uint64_t RECORD_COUNT = 100000;
+    zjl::Histogram histogram;
+    std::vector<zjl::Thread::ptr> threads;
+    for (int i = 0; i < THREAD_COUNT; i++)
+    {
+        threads.push_back(std::make_shared<zjl::Thread>([&histogram]() {
+            for (uint64_t value = 0; value < RECORD_COUNT; value++)
+            {
+                histogram.record(value);
+            }
+        }, "record_" + std::to_string(i)));
+    }
+    for (auto& thread : threads)
+    {
+        thread->join();
+    }
+    zjl::HistogramSnapshot snapshot = histogram.snapshot();
+    LOG_FMT_INFO(g_logger, "concurrent: %s", snapshot.toString().c_str());
+    assert(snapshot.count == THREAD_COUNT * RECORD_COUNT);
+    assert(snapshot.sum == THREAD_COUNT * RECORD_COUNT * (RECORD_COUNT - 1) / 2);
+    assert(snapshot.max == RECORD_COUNT - 1);
+}
+
+int main()
+{
+    TEST_buckets();
+    TEST_percentile();
+    TEST_concurrentRecord();
+    return 0;
+}
@@ -1,15 +1,52 @@
+#include "config.h"
+#include "fd_manager.h"
 #include "io_manager.h"
 #include "log.h"
+#include <algorithm>
 #include <arpa/inet.h>
+#include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <new>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 zjl::Logger::ptr g_logger = GET_ROOT_LOGGER();
 
+// 统计整个进程的堆分配次数，用于检查热点路径不分配内存
+static std::atomic_size_t g_allocation_count{0};
+
+void* operator new(size_t size)
+{
+    ++g_allocation_count;
+    if (void* p = malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
 void test_fiber()
 {
     for (int i = 0; i < 3; i++)
@@ -71,9 +108,1037 @@ void TEST_timer()
     }, true);
 }
 
+// 测试排空超时后强制取消挂起的 accept
+void TEST_drain()
+{
+    zjl::IOManager iom(2, false, "drain");
+    std::atomic_int accept_errno{0};
+    iom.schedule([&accept_errno]() {
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = 0;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listen_fd, (struct sockaddr*)(&addr), sizeof(addr));
+        listen(listen_fd, 16);
+        // 没有客户端连接，协程会一直挂起在 accept 上
+        int fd = accept(listen_fd, nullptr, nullptr);
+        accept_errno = fd == -1 ? errno : 0;
+        close(listen_fd);
+    });
+    iom.addTimer(60 * 1000, []() {
+        LOG_INFO(g_logger, "不应该执行到这里");
+    }, true);
+    sleep(1);
+    zjl::DrainResult result = iom.drain(200);
+    LOG_FMT_INFO(g_logger, "drain: completed = %d, cancelled_events = %zu, cancelled_timers = %zu",
+                 result.completed, result.cancelled_events, result.cancelled_timers);
+    assert(!result.completed);
+    assert(result.cancelled_events == 1);
+    assert(result.cancelled_timers == 1);
+    // 排空状态下拒绝外部提交的任务
+    assert(!iom.schedule([]() {}));
+    iom.stop();
+    assert(accept_errno == ECANCELED);
+}
+
+// 测试协程恢复执行时的工作线程亲和性统计
+void TEST_affinity()
+{
+    const int fiber_count = 8;
+    const int yield_count = 10;
+    std::atomic_int done{0};
+    zjl::IOManager iom(2, false, "affinity");
+    for (int i = 0; i < fiber_count; i++)
+    {
+        iom.schedule([&done, yield_count]() {
+            for (int j = 0; j < yield_count; j++)
+            {
+                usleep(1000);
+            }
+            ++done;
+        });
+    }
+    while (done != fiber_count)
+    {
+        usleep(10 * 1000);
+    }
+    uint64_t local = iom.getLocalResumeCount();
+    uint64_t migrated = iom.getMigratedResumeCount();
+    LOG_FMT_INFO(g_logger, "affinity: local = %lu, migrated = %lu", local, migrated);
+    assert(local + migrated == static_cast<uint64_t>(fiber_count * yield_count));
+    // 线程池的其他线程都空闲，多数协程应当回到上次运行它的线程
+    assert(local > migrated);
+}
+
+// 测试 io_uring 后端：accept、connect、收发数据以及接收超时都通过完成式 IO 完成
+void TEST_uringBackend()
+{
+    zjl::Config::Lookup("iomanager.backend")->fromString("io_uring");
+    {
+        zjl::IOManager iom(2, false, "uring");
+        LOG_FMT_INFO(g_logger, "uring: backend = %s", iom.getBackendName());
+        // 内核不支持 io_uring 时回退到 epoll，下面的测试不再覆盖完成式 IO，明确跳过
+        if (strcmp(iom.getBackendName(), "io_uring") != 0)
+        {
+            LOG_WARN(g_logger, "uring: io_uring 不可用，跳过测试");
+            iom.stop();
+            zjl::Config::Lookup("iomanager.backend")->fromString("epoll");
+            return;
+        }
+        assert(iom.isCompletionBased());
+        std::atomic_int port{0};
+        std::atomic_int received{0};
+        std::atomic_int timeout_errno{0};
+        iom.schedule([&port, &received, &timeout_errno]() {
+            int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listen_fd, (struct sockaddr*)(&addr), sizeof(addr));
+            listen(listen_fd, 16);
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, (struct sockaddr*)(&addr), &len);
+            port = ntohs(addr.sin_port);
+            int fd = accept(listen_fd, nullptr, nullptr);
+            assert(fd >= 0);
+            char buffer[64]{};
+            received = recv(fd, buffer, sizeof(buffer), 0);
+            assert(strcmp(buffer, "uring") == 0);
+            // 对端不再发送数据，接收在 100ms 后超时
+            timeval tv{0, 100 * 1000};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            uint64_t begin = zjl::GetCurrentMS();
+            ssize_t rt = read(fd, buffer, sizeof(buffer));
+            timeout_errno = rt == -1 ? errno : 0;
+            assert(zjl::GetCurrentMS() - begin >= 90);
+            close(fd);
+            close(listen_fd);
+        });
+        while (port == 0)
+        {
+            usleep(1000);
+        }
+        iom.schedule([&port]() {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int rt = connect(fd, (struct sockaddr*)(&addr), sizeof(addr));
+            assert(rt == 0);
+            send(fd, "uring", 6, 0);
+            sleep(1);
+            close(fd);
+        });
+        // 非阻塞的管道上没有数据时读请求返回 EAGAIN，在 io_uring 中等到可读后重新提交
+        std::atomic_int pipe_read{0};
+        iom.schedule([&pipe_read]() {
+            int fds[2];
+            assert(pipe(fds) == 0);
+            zjl::IOManager::GetThis()->schedule([fd = fds[1]]() {
+                usleep(20 * 1000);
+                assert(write(fd, "pipe", 4) == 4);
+            });
+            char buffer[8]{};
+            pipe_read = static_cast<int>(read(fds[0], buffer, sizeof(buffer)));
+            assert(memcmp(buffer, "pipe", 4) == 0);
+            close(fds[0]);
+            close(fds[1]);
+        });
+        iom.stop();
+        LOG_FMT_INFO(g_logger, "uring: received = %d, timeout errno = %d, pipe read = %d",
+                     received.load(), timeout_errno.load(), pipe_read.load());
+        assert(received == 6);
+        assert(timeout_errno == ETIMEDOUT);
+        assert(pipe_read == 4);
+    }
+    zjl::Config::Lookup("iomanager.backend")->fromString("epoll");
+}
+
+// 测试独占事件循环：每个 fd 的 IO 都在负责它的工作线程上完成，超时取消也能正确转交
+void TEST_perWorkerReactor()
+{
+    zjl::Config::Lookup<bool>("iomanager.per_worker_reactor")->setValue(true);
+    {
+        static const int client_count = 8;
+        zjl::IOManager iom(3, false, "reactor");
+        assert(iom.isPerWorkerReactor());
+        std::atomic_int port{0};
+        std::atomic_int echoed{0};
+        std::atomic_int wrong_thread{0};
+        std::atomic_int timeout_errno{0};
+        auto check_owner = [&iom, &wrong_thread](int fd) {
+            if (zjl::GetThreadID() != iom.getOwnerThreadId(fd))
+            {
+                ++wrong_thread;
+            }
+        };
+        iom.schedule([&]() {
+            int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listen_fd, (struct sockaddr*)(&addr), sizeof(addr));
+            listen(listen_fd, 16);
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, (struct sockaddr*)(&addr), &len);
+            port = ntohs(addr.sin_port);
+            for (int i = 0; i < client_count; i++)
+            {
+                int fd = accept(listen_fd, nullptr, nullptr);
+                assert(fd >= 0);
+                check_owner(listen_fd);
+                iom.schedule([&, fd]() {
+                    char buffer[64]{};
+                    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                    check_owner(fd);
+                    send(fd, buffer, n, 0);
+                    // 对端不再发送数据，超时定时器可能在其他线程上到期
+                    timeval tv{0, 50 * 1000};
+                    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                    if (read(fd, buffer, sizeof(buffer)) == -1)
+                    {
+                        timeout_errno = errno;
+                    }
+                    check_owner(fd);
+                    close(fd);
+                });
+            }
+            close(listen_fd);
+        });
+        while (port == 0)
+        {
+            usleep(1000);
+        }
+        for (int i = 0; i < client_count; i++)
+        {
+            iom.schedule([&]() {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(port);
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                int rt = connect(fd, (struct sockaddr*)(&addr), sizeof(addr));
+                assert(rt == 0);
+                check_owner(fd);
+                send(fd, "reactor", 8, 0);
+                char buffer[64]{};
+                if (recv(fd, buffer, sizeof(buffer), 0) == 8 && strcmp(buffer, "reactor") == 0)
+                {
+                    ++echoed;
+                }
+                check_owner(fd);
+                // 等待服务端超时后再关闭
+                usleep(100 * 1000);
+                close(fd);
+            });
+        }
+        iom.stop();
+        LOG_FMT_INFO(g_logger, "reactor: echoed = %d, wrong thread = %d, timeout errno = %d",
+                     echoed.load(), wrong_thread.load(), timeout_errno.load());
+        assert(echoed == client_count);
+        assert(wrong_thread == 0);
+        assert(timeout_errno == ETIMEDOUT);
+        // 连续建立的 fd 轮流分配给不同的工作线程，与 fd 的数字无关
+        int fds[3];
+        long owners[3];
+        for (int i = 0; i < 3; i++)
+        {
+            fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+            iom.assignOwner(fds[i]);
+            owners[i] = iom.getOwnerThreadId(fds[i]);
+        }
+        assert(owners[0] != owners[1] && owners[1] != owners[2] && owners[0] != owners[2]);
+        for (int fd : fds)
+        {
+            close(fd);
+        }
+    }
+    zjl::Config::Lookup<bool>("iomanager.per_worker_reactor")->setValue(false);
+}
+
+// 测试 fd 上下文表：fd 远大于已分配的范围时也能正常注册与触发事件
+void TEST_largeFd()
+{
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    int high_fd = static_cast<int>(std::min<rlim_t>(limit.rlim_cur - 1, 1 << 20));
+    int fds[2];
+    pipe(fds);
+    assert(dup2(fds[0], high_fd) == high_fd);
+    fcntl(high_fd, F_SETFL, O_NONBLOCK);
+    std::atomic_int triggered{0};
+    {
+        zjl::IOManager iom(2, false, "large_fd");
+        int rt = iom.addEventListener(high_fd, zjl::FDEventType::READ, [&triggered, high_fd]() {
+            char c;
+            read(high_fd, &c, 1);
+            ++triggered;
+        });
+        assert(rt == 0);
+        write(fds[1], "x", 1);
+        iom.stop();
+    }
+    LOG_FMT_INFO(g_logger, "large fd: fd = %d, triggered = %d, sizeof(FDContext) = %zu", high_fd,
+                 triggered.load(), sizeof(zjl::FDContext));
+    assert(triggered == 1);
+    // 上下文按段整体分配，每个 fd 的开销决定了百万级 fd 的内存占用
+    assert(sizeof(zjl::FDContext) <= 256);
+    close(high_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void TEST_adaptiveBatch()
+{
+    // 调度器专属的配置项，先于调度器创建，调度器构造时直接使用
+    zjl::Config::Lookup<int>("iomanager.batch.max_events", 4, "");
+    static const int PIPE_COUNT = 64;
+    int fds[PIPE_COUNT][2];
+    std::atomic_int triggered{0};
+    zjl::ReactorStats stats;
+    {
+        zjl::IOManager iom(1, false, "batch");
+        assert(iom.getReactorStats(0).batch_size == 4);
+        iom.schedule([&]() {
+            for (auto& pipe_fds : fds)
+            {
+                pipe(pipe_fds);
+                fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+                int read_fd = pipe_fds[0];
+                iom.addEventListener(read_fd, zjl::FDEventType::READ, [&triggered, read_fd]() {
+                    char c;
+                    read(read_fd, &c, 1);
+                    ++triggered;
+                });
+            }
+            // 所有管道同时就绪，每次轮询都会填满批次
+            for (auto& pipe_fds : fds)
+            {
+                write(pipe_fds[1], "x", 1);
+            }
+        });
+        iom.stop();
+        stats = iom.getReactorStats(0);
+    }
+    LOG_FMT_INFO(g_logger, "batch: triggered = %d, loops = %lu, events = %lu, full = %lu, batch size = %zu",
+                 triggered.load(), stats.loops, stats.events, stats.full_batches, stats.batch_size);
+    assert(triggered == PIPE_COUNT);
+    assert(stats.events >= PIPE_COUNT);
+    assert(stats.full_batches >= 2);
+    assert(stats.batch_size > 4);
+    // 管道在协程中经过 hook 创建，主线程的 close 不经过 hook，先移除登记
+    for (auto& pipe_fds : fds)
+    {
+        zjl::FileDescriptorManager::GetInstance()->remove(pipe_fds[0]);
+        zjl::FileDescriptorManager::GetInstance()->remove(pipe_fds[1]);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+}
+
+// 测量定时器到期后回调开始执行的平均延迟(us)
+uint64_t MeasureTimerLateness(bool timerfd)
+{
+    zjl::Config::Lookup<bool>("iomanager.timerfd")->setValue(timerfd);
+    static const int COUNT = 50;
+    std::atomic_uint64_t lateness{0};
+    {
+        zjl::IOManager iom(1, false, "timer_lateness");
+        assert(iom.isTimerfdEnabled() == timerfd);
+        // 在外部线程依次添加定时器，每个定时器都是唯一的、最早到期的定时器
+        for (int i = 0; i < COUNT; i++)
+        {
+            std::atomic_bool done{false};
+            uint64_t deadline = zjl::GetCurrentUS() + 2000;
+            iom.addTimer(2, [&lateness, &done, deadline]() {
+                lateness += zjl::GetCurrentUS() - deadline;
+                done = true;
+            });
+            while (!done)
+            {
+                usleep(100);
+            }
+        }
+        iom.stop();
+    }
+    zjl::Config::Lookup<bool>("iomanager.timerfd")->setValue(true);
+    return lateness / COUNT;
+}
+
+void TEST_timerfd()
+{
+    uint64_t with_timerfd = MeasureTimerLateness(true);
+    uint64_t without_timerfd = MeasureTimerLateness(false);
+    LOG_FMT_INFO(g_logger, "timerfd: lateness = %lu us, without timerfd = %lu us",
+                 with_timerfd, without_timerfd);
+    assert(with_timerfd < 2000);
+}
+
+// 一个协程在设置了接收超时（或没有设置）的 socket 上往返 round 次，返回这期间的堆分配次数，
+// suspends 返回其中协程真正挂起、被就绪事件唤醒的次数
+size_t CountPingPongAllocations(int round, bool timeout, size_t& suspends)
+{
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    size_t allocations = 0;
+    {
+        zjl::IOManager iom(1, false, "allocation");
+        std::atomic_bool ready{false};
+        iom.schedule([&fds, &ready, round, timeout]() {
+            // socketpair 没有经过 hook 创建，先登记为 socket
+            zjl::FileDescriptorManager::GetInstance()->get(fds[0], true);
+            if (timeout)
+            {
+                timeval tv{5, 0};
+                assert(setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+            }
+            ready = true;
+            char c;
+            // 多出的一轮用于预热
+            for (int i = 0; i < round + 1; i++)
+            {
+                assert(read(fds[0], &c, 1) == 1);
+                assert(write(fds[0], &c, 1) == 1);
+            }
+        });
+        while (!ready)
+        {
+            usleep(100);
+        }
+        // 主线程没有开启 hook，读取时阻塞等待协程的回复；稍等再写入，让协程每一轮都挂起等待
+        char c = 'x';
+        for (int i = 0; i < round + 1; i++)
+        {
+            if (i == 1)
+            {
+                iom.resetLatencyStats();
+                allocations = g_allocation_count;
+            }
+            usleep(50);
+            assert(write(fds[1], &c, 1) == 1);
+            assert(read(fds[1], &c, 1) == 1);
+        }
+        allocations = g_allocation_count - allocations;
+        // 每次被就绪事件唤醒的协程恢复执行时记录一次唤醒延迟
+        suspends = iom.getLatencyStats().resume_latency_us.count;
+        iom.stop();
+    }
+    // 主线程的 close 不经过 hook，移除登记，避免复用这个数字的 fd 继承非阻塞与超时的设置
+    zjl::FileDescriptorManager::GetInstance()->remove(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    return allocations;
+}
+
+// 测试带超时的读取在挂起时不为超时分配内存
+void TEST_timeoutAllocations()
+{
+    static const int ROUND = 2000;
+    auto system_logger = GET_LOGGER("system");
+    auto level = system_logger->getLevel();
+    system_logger->setLevel(zjl::LogLevel::INFO);
+    size_t without_suspends = 0;
+    size_t with_suspends = 0;
+    size_t without_timeout = CountPingPongAllocations(ROUND, false, without_suspends);
+    size_t with_timeout = CountPingPongAllocations(ROUND, true, with_suspends);
+    system_logger->setLevel(level);
+    LOG_FMT_INFO(g_logger, "allocations: %d round trips, without timeout = %zu in %zu suspends, "
+                 "with timeout = %zu in %zu suspends",
+                 ROUND, without_timeout, without_suspends, with_timeout, with_suspends);
+    // 数据先于读取到达的轮次不挂起，也不分配内存，按真正挂起的次数比较。
+    // 设置超时最多带来偶然的额外分配（如最小堆扩容），每次挂起多分配一次时差值为 1
+    assert(without_suspends > ROUND / 10 && with_suspends > ROUND / 10);
+    double without_per_suspend = static_cast<double>(without_timeout) / without_suspends;
+    double with_per_suspend = static_cast<double>(with_timeout) / with_suspends;
+    assert(with_per_suspend < without_per_suspend + 0.5);
+}
+
+// 测试不足 1ms 的 usleep、nanosleep 会真正挂起协程，不会提前返回，也不会让事件循环空转
+void TEST_shortSleep()
+{
+    static const int COUNT = 50;
+    static const uint64_t SLEEP_US = 200;
+    std::atomic_uint64_t total_us{0};
+    std::atomic_int early{0};
+    zjl::ReactorStats stats;
+    {
+        zjl::IOManager iom(1, false, "short_sleep");
+        iom.schedule([&total_us, &early]() {
+            for (int i = 0; i < COUNT; i++)
+            {
+                uint64_t begin = zjl::GetCurrentUS();
+                if (i % 2 == 0)
+                {
+                    usleep(SLEEP_US);
+                }
+                else
+                {
+                    timespec req{0, static_cast<long>(SLEEP_US * 1000 - 1)};
+                    timespec rem{1, 1};
+                    assert(nanosleep(&req, &rem) == 0);
+                    assert(rem.tv_sec == 0 && rem.tv_nsec == 0);
+                }
+                uint64_t elapsed = zjl::GetCurrentUS() - begin;
+                early += elapsed < SLEEP_US;
+                total_us += elapsed;
+            }
+        });
+        iom.stop();
+        stats = iom.getReactorStats(0);
+    }
+    LOG_FMT_INFO(g_logger, "short sleep: %lu us requested, mean = %lu us, loops = %lu",
+                 SLEEP_US, total_us / COUNT, stats.loops);
+    assert(early == 0);
+    // 每次睡眠只需几轮事件循环，空转时会有成千上万轮
+    assert(stats.loops < COUNT * 10);
+}
+
+// 测试信号作为普通任务在工作线程上处理
+void TEST_signalHandler()
+{
+    std::atomic_int handled{0};
+    std::atomic_int sender{0};
+    std::atomic_bool in_worker{false};
+    {
+        zjl::IOManager iom(2, false, "signal");
+        // 工作线程已经启动，addSignalHandler 返回前它们都已经屏蔽了 SIGUSR1
+        int rt = iom.addSignalHandler(SIGUSR1, [&](const signalfd_siginfo& info) {
+            in_worker = zjl::IOManager::GetThis() != nullptr;
+            sender = static_cast<int>(info.ssi_pid);
+            ++handled;
+        });
+        assert(rt == 0);
+        for (int i = 0; i < 3; i++)
+        {
+            kill(getpid(), SIGUSR1);
+            while (handled <= i)
+            {
+                usleep(1000);
+            }
+        }
+        assert(iom.removeSignalHandler(SIGUSR1));
+        assert(!iom.removeSignalHandler(SIGUSR1));
+        iom.stop();
+    }
+    LOG_FMT_INFO(g_logger, "signal: handled = %d, sender = %d, in worker = %d",
+                 handled.load(), sender.load(), in_worker.load());
+    assert(handled == 3);
+    assert(sender == getpid());
+    assert(in_worker);
+}
+
+// 多个协程并发追加写同一个普通文件，再用 pread/pwrite/fsync 检查结果
+void RunFileIO(const std::string& backend)
+{
+    zjl::Config::Lookup("iomanager.backend")->fromString(backend);
+    static const int FIBER_COUNT = 4;
+    static const int LINE_COUNT = 50;
+    char path[] = "/tmp/test_file_io_XXXXXX";
+    int tmp_fd = mkstemp(path);
+    assert(tmp_fd >= 0);
+    close(tmp_fd);
+    std::atomic_int finished{0};
+    std::atomic_int sync_result{-1};
+    std::string tail;
+    std::string name;
+    {
+        zjl::IOManager iom(2, false, "file_io");
+        name = iom.getBackendName();
+        int fd = open(path, O_WRONLY | O_APPEND);
+        assert(fd >= 0);
+        for (int i = 0; i < FIBER_COUNT; i++)
+        {
+            iom.schedule([fd, i, &finished]() {
+                for (int j = 0; j < LINE_COUNT; j++)
+                {
+                    char line[32];
+                    int len = snprintf(line, sizeof(line), "%d %03d\n", i, j);
+                    assert(write(fd, line, len) == len);
+                }
+                ++finished;
+            });
+        }
+        while (finished < FIBER_COUNT)
+        {
+            usleep(1000);
+        }
+        close(fd);
+        iom.schedule([&path, &tail, &sync_result]() {
+            // 在所有行之后写入结束标记，再读回来
+            int fd = open(path, O_RDWR);
+            off_t offset = FIBER_COUNT * LINE_COUNT * 6;
+            assert(pwrite(fd, "end", 3, offset) == 3);
+            char buffer[8]{};
+            assert(pread(fd, buffer, sizeof(buffer), offset) == 3);
+            tail = buffer;
+            sync_result = fsync(fd) == 0 && fdatasync(fd) == 0 ? 0 : errno;
+            close(fd);
+        });
+        iom.stop();
+    }
+    // 每个协程写入的行保持调用顺序，且没有交错
+    FILE* file = fopen(path, "r");
+    int next_line[FIBER_COUNT]{};
+    int total = 0;
+    int fiber = 0;
+    int line = 0;
+    while (fscanf(file, "%d %d\n", &fiber, &line) == 2)
+    {
+        assert(fiber >= 0 && fiber < FIBER_COUNT);
+        assert(line == next_line[fiber]);
+        next_line[fiber] = line + 1;
+        ++total;
+    }
+    fclose(file);
+    unlink(path);
+    LOG_FMT_INFO(g_logger, "file io: backend = %s, lines = %d, tail = %s, sync = %d",
+                 name.c_str(), total, tail.c_str(), sync_result.load());
+    assert(total == FIBER_COUNT * LINE_COUNT);
+    assert(tail == "end");
+    assert(sync_result == 0);
+    zjl::Config::Lookup("iomanager.backend")->fromString("epoll");
+}
+
+void TEST_fileIO()
+{
+    RunFileIO("io_uring");
+    RunFileIO("epoll");
+}
+
+// 测试事件循环的延迟分布：协程等待 socket 可读、定时器到期，各项分布都有记录
+void TEST_latencyStats()
+{
+    static const int ROUND = 20;
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    std::atomic_int received{0};
+    std::atomic_int fired{0};
+    zjl::LatencyStats stats;
+    {
+        zjl::IOManager iom(2, false, "latency");
+        assert(iom.isLatencyStatsEnabled());
+        iom.schedule([&fds, &received]() {
+            // socketpair 没有经过 hook 创建，先登记为 socket
+            zjl::FileDescriptorManager::GetInstance()->get(fds[0], true);
+            char c;
+            for (int i = 0; i < ROUND; i++)
+            {
+                assert(read(fds[0], &c, 1) == 1);
+                ++received;
+            }
+        });
+        for (int i = 0; i < ROUND; i++)
+        {
+            iom.addTimer(1, [&fired]() { ++fired; });
+            usleep(2000);
+            assert(write(fds[1], "x", 1) == 1);
+        }
+        while (received < ROUND || fired < ROUND)
+        {
+            usleep(1000);
+        }
+        stats = iom.getLatencyStats();
+        iom.resetLatencyStats();
+        assert(iom.getLatencyStats().loop_duration_us.count == 0);
+        iom.stop();
+    }
+    LOG_FMT_INFO(g_logger, "latency: poll wait %s", stats.poll_wait_us.toString().c_str());
+    LOG_FMT_INFO(g_logger, "latency: events %s", stats.events_per_wakeup.toString().c_str());
+    LOG_FMT_INFO(g_logger, "latency: resume %s", stats.resume_latency_us.toString().c_str());
+    LOG_FMT_INFO(g_logger, "latency: timer %s", stats.timer_lateness_us.toString().c_str());
+    LOG_FMT_INFO(g_logger, "latency: loop %s", stats.loop_duration_us.toString().c_str());
+    assert(stats.poll_wait_us.count > 0);
+    assert(stats.events_per_wakeup.count > 0);
+    // 数据先于读取到达时协程不会挂起，慢速构建下不是每一轮都有唤醒
+    assert(stats.resume_latency_us.count > 0 && stats.resume_latency_us.count <= ROUND);
+    assert(stats.timer_lateness_us.count == ROUND);
+    assert(stats.loop_duration_us.count > 0);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 测试同一个 fd 上的多个等待者，以及带外数据与对端关闭的事件
+void TEST_multipleWaiters()
+{
+    // 在主线程中以阻塞方式建立 TCP 连接
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (struct sockaddr*)(&addr), sizeof(addr));
+    listen(listen_fd, 1);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (struct sockaddr*)(&addr), &len);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(client, (struct sockaddr*)(&addr), sizeof(addr)) == 0);
+    int server = accept(listen_fd, nullptr, nullptr);
+    assert(server >= 0);
+    zjl::FileDescriptorManager::GetInstance()->get(server, true);
+
+    std::atomic_int readers{0};
+    std::atomic_int bytes{0};
+    std::atomic_int eof{0};
+    std::atomic_int urgent{0};
+    std::atomic_int hangup{0};
+    std::atomic_int readable{0};
+    std::atomic_int timed_out{0};
+    {
+        zjl::IOManager iom(2, false, "waiters");
+        // 两个协程同时读同一个 socket，各读到一个字节后等待 EOF
+        for (int i = 0; i < 2; i++)
+        {
+            iom.schedule([server, &readers, &bytes, &eof]() {
+                ++readers;
+                char c;
+                while (true)
+                {
+                    ssize_t rt = read(server, &c, 1);
+                    if (rt == 1)
+                    {
+                        ++bytes;
+                        continue;
+                    }
+                    assert(rt == 0);
+                    ++eof;
+                    break;
+                }
+            });
+        }
+        iom.addEventListener(server, zjl::FDEventType::PRI, [&urgent]() { ++urgent; });
+        iom.addEventListener(server, zjl::FDEventType::RDHUP, [&hangup]() { ++hangup; });
+        while (readers < 2)
+        {
+            usleep(1000);
+        }
+        usleep(10 * 1000);
+        // 一个等待者超时只唤醒它自己，同一事件的其他等待者不受影响
+        iom.addEventListener(server, zjl::FDEventType::READ, [&readable]() { ++readable; });
+        iom.schedule([server, &timed_out]() {
+            pollfd pfd{server, POLLIN, 0};
+            assert(poll(&pfd, 1, 20) == 0);
+            ++timed_out;
+        });
+        while (timed_out == 0)
+        {
+            usleep(1000);
+        }
+        usleep(10 * 1000);
+        assert(readable == 0);
+        assert(write(client, "a", 1) == 1);
+        usleep(10 * 1000);
+        assert(write(client, "b", 1) == 1);
+        usleep(10 * 1000);
+        assert(send(client, "!", 1, MSG_OOB) == 1);
+        while (urgent == 0)
+        {
+            usleep(1000);
+        }
+        // 对端关闭写端，两个读者与 RDHUP 的等待者立即被唤醒
+        shutdown(client, SHUT_WR);
+        while (eof < 2 || hangup == 0)
+        {
+            usleep(1000);
+        }
+        iom.stop();
+    }
+    LOG_FMT_INFO(g_logger, "waiters: bytes = %d, eof = %d, urgent = %d, hangup = %d",
+                 bytes.load(), eof.load(), urgent.load(), hangup.load());
+    // 带外数据不在普通数据流中
+    assert(bytes == 2);
+    assert(eof == 2);
+    assert(urgent == 1);
+    assert(hangup == 1);
+    assert(readable == 1);
+    zjl::FileDescriptorManager::GetInstance()->remove(server);
+    close(server);
+    close(client);
+    close(listen_fd);
+}
+
+// 测试经过 hook 创建的管道、eventfd、socketpair 以及 dup 得到的 fd 在数据未就绪时挂起协程，
+// 只有一个工作线程，任何一个协程阻塞在系统调用上，其他协程都无法执行
+void TEST_hookedFds()
+{
+    const size_t FILE_SIZE = 1 << 20;
+    char path[] = "/tmp/test_hooked_fds_XXXXXX";
+    int file_fd = mkstemp(path);
+    assert(file_fd >= 0);
+    std::string content(FILE_SIZE, 'x');
+    assert(write(file_fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+    std::atomic_int done{0};
+    std::atomic_size_t received{0};
+    {
+        zjl::IOManager iom(1, false, "fds");
+        iom.schedule([file_fd, FILE_SIZE, &done, &received]() {
+            auto fdm = zjl::FileDescriptorManager::GetInstance();
+            int fds[2];
+            assert(pipe(fds) == 0);
+            // 系统层面是非阻塞的，用户看到的仍然是阻塞的
+            assert(fdm->get(fds[0]) && fdm->get(fds[0])->isPollable());
+            assert(!(fcntl(fds[0], F_GETFL) & O_NONBLOCK));
+            int efd = eventfd(0, 0);
+            assert(efd >= 0 && fdm->get(efd)->isPollable());
+            int sv[2];
+            assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+            int dup_fd = dup(sv[0]);
+            assert(dup_fd >= 0 && fdm->get(dup_fd) && fdm->get(dup_fd)->isPollable());
+            zjl::IOManager::GetThis()->schedule([fds, efd, sv]() {
+                usleep(10 * 1000);
+                assert(write(fds[1], "pipe", 4) == 4);
+                usleep(10 * 1000);
+                eventfd_t one = 1;
+                assert(write(efd, &one, sizeof(one)) == sizeof(one));
+                usleep(10 * 1000);
+                assert(write(sv[1], "sock", 4) == 4);
+                usleep(10 * 1000);
+                assert(write(fds[1], "splice", 6) == 6);
+            });
+            char buf[16];
+            assert(read(fds[0], buf, sizeof(buf)) == 4 && memcmp(buf, "pipe", 4) == 0);
+            eventfd_t value = 0;
+            assert(read(efd, &value, sizeof(value)) == sizeof(value) && value == 1);
+            assert(read(dup_fd, buf, sizeof(buf)) == 4 && memcmp(buf, "sock", 4) == 0);
+            // splice 等待管道可读，再把数据转到 socket
+            assert(splice(fds[0], nullptr, sv[0], nullptr, sizeof(buf), 0) == 6);
+            assert(read(sv[1], buf, sizeof(buf)) == 6 && memcmp(buf, "splice", 6) == 0);
+
+            // sendfile 写满 socket 的发送缓冲区后挂起，等待另一个协程读取
+            zjl::IOManager::GetThis()->schedule([sv, FILE_SIZE, &received]() {
+                std::vector<char> data(64 * 1024);
+                while (received < FILE_SIZE)
+                {
+                    ssize_t n = read(sv[1], data.data(), data.size());
+                    assert(n > 0);
+                    received += n;
+                }
+            });
+            off_t offset = 0;
+            while (static_cast<size_t>(offset) < FILE_SIZE)
+            {
+                assert(sendfile(dup_fd, file_fd, &offset, FILE_SIZE - offset) > 0);
+            }
+
+            // 按偏移读写普通文件
+            char a[2] = {'a', 'b'}, b[2] = {'c', 'd'};
+            iovec iov[2] = {{a, 2}, {b, 2}};
+            assert(pwritev(file_fd, iov, 2, 8) == 4);
+            memset(a, 0, 2);
+            memset(b, 0, 2);
+            assert(preadv(file_fd, iov, 2, 7) == 4);
+            assert(a[0] == 'x' && a[1] == 'a' && b[0] == 'b' && b[1] == 'c');
+
+            // dup2 覆盖已经登记的 fd，新的 fd 沿用管道的登记
+            assert(dup2(fds[0], efd) == efd);
+            assert(fdm->get(efd) && fdm->get(efd)->isPollable());
+            for (int fd : {fds[0], fds[1], efd, sv[0], dup_fd})
+            {
+                close(fd);
+                assert(!fdm->get(fd));
+            }
+            ++done;
+        });
+        // accept4 等待连接，得到的 socket 按 SOCK_NONBLOCK 对用户保持非阻塞
+        iom.schedule([&done]() {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            strcpy(addr.sun_path + 1, "test_hooked_fds");
+            socklen_t len = offsetof(sockaddr_un, sun_path) + 1 + strlen("test_hooked_fds");
+            int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            assert(bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), len) == 0);
+            assert(listen(listen_fd, 1) == 0);
+            zjl::IOManager::GetThis()->schedule([addr, len]() {
+                usleep(10 * 1000);
+                int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                assert(connect(fd, reinterpret_cast<const sockaddr*>(&addr), len) == 0);
+                close(fd);
+            });
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            assert(fd >= 0);
+            auto fdp = zjl::FileDescriptorManager::GetInstance()->get(fd);
+            assert(fdp && fdp->isSocket() && fdp->getUserNonBlock());
+            assert(fcntl(fd, F_GETFL) & O_NONBLOCK);
+            assert(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+            close(fd);
+            close(listen_fd);
+            ++done;
+        });
+        while (done < 2 || received < FILE_SIZE)
+        {
+            usleep(1000);
+        }
+        iom.stop();
+    }
+    LOG_FMT_INFO(g_logger, "hooked fds: sendfile received %zu bytes", received.load());
+    assert(received == FILE_SIZE);
+    zjl::FileDescriptorManager::GetInstance()->remove(file_fd);
+    close(file_fd);
+    unlink(path);
+}
+
+// 在协程中调用 poll、select、epoll_wait 等待管道，返回与系统函数相同格式的结果
+void RunHookedPoll(bool per_worker)
+{
+    zjl::Config::Lookup<bool>("iomanager.per_worker_reactor")->setValue(per_worker);
+    std::atomic_bool done{false};
+    {
+        // 共享事件循环时只有一个工作线程，阻塞在系统调用上会让写入的协程无法执行
+        zjl::IOManager iom(per_worker ? 2 : 1, false, "poll");
+        iom.schedule([&done]() {
+            auto iom = zjl::IOManager::GetThis();
+            int a[2], b[2];
+            assert(pipe(a) == 0 && pipe(b) == 0);
+            auto write_later = [iom](int fd) {
+                iom->schedule([fd]() {
+                    usleep(10 * 1000);
+                    assert(write(fd, "x", 1) == 1);
+                });
+            };
+            char c;
+            // 单个 fd、单个事件
+            write_later(a[1]);
+            pollfd pfd{a[0], POLLIN, 0};
+            assert(poll(&pfd, 1, 1000) == 1 && (pfd.revents & POLLIN));
+            assert(read(a[0], &c, 1) == 1);
+            uint64_t begin = zjl::GetCurrentMS();
+            assert(poll(&pfd, 1, 20) == 0 && pfd.revents == 0);
+            assert(zjl::GetCurrentMS() - begin >= 20);
+            // 多个 fd 时只有就绪的 fd 有结果
+            write_later(b[1]);
+            pollfd pfds[2] = {{a[0], POLLIN, 0}, {b[0], POLLIN, 0}};
+            assert(poll(pfds, 2, 1000) == 1);
+            assert(pfds[0].revents == 0 && (pfds[1].revents & POLLIN));
+            assert(read(b[0], &c, 1) == 1);
+            timespec ts{0, 20 * 1000 * 1000};
+            assert(ppoll(pfds, 2, &ts, nullptr) == 0);
+
+            // 只关心挂断与错误时，未读的数据不会反复唤醒，对端关闭后报告挂断
+            int s[2];
+            assert(socketpair(AF_UNIX, SOCK_STREAM, 0, s) == 0);
+            assert(write(s[1], "x", 1) == 1);
+            pollfd hup{s[0], 0, 0};
+            uint64_t ctl_count = iom->getPollerCtlCount();
+            assert(poll(&hup, 1, 20) == 0 && hup.revents == 0);
+            assert(iom->getPollerCtlCount() - ctl_count <= 2);
+            // 对端只关闭写端时 poll 同样不报告
+            assert(shutdown(s[1], SHUT_WR) == 0);
+            ctl_count = iom->getPollerCtlCount();
+            assert(poll(&hup, 1, 20) == 0 && hup.revents == 0);
+            assert(iom->getPollerCtlCount() - ctl_count <= 2);
+            iom->schedule([s]() {
+                usleep(10 * 1000);
+                close(s[1]);
+            });
+            assert(poll(&hup, 1, 1000) == 1 && (hup.revents & POLLHUP));
+            close(s[0]);
+
+            // select 只保留就绪的 fd，超时后剩余时间为 0
+            write_later(a[1]);
+            int nfds = std::max(a[0], b[0]) + 1;
+            fd_set read_set;
+            FD_ZERO(&read_set);
+            FD_SET(a[0], &read_set);
+            FD_SET(b[0], &read_set);
+            timeval tv{1, 0};
+            assert(select(nfds, &read_set, nullptr, nullptr, &tv) == 1);
+            assert(FD_ISSET(a[0], &read_set) && !FD_ISSET(b[0], &read_set));
+            assert(read(a[0], &c, 1) == 1);
+            FD_ZERO(&read_set);
+            FD_SET(b[0], &read_set);
+            tv = {0, 20 * 1000};
+            assert(select(nfds, &read_set, nullptr, nullptr, &tv) == 0);
+            assert(!FD_ISSET(b[0], &read_set) && tv.tv_sec == 0 && tv.tv_usec == 0);
+
+            // epoll_wait 等待 epoll fd 可读
+            int epfd = epoll_create1(EPOLL_CLOEXEC);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = b[0];
+            assert(epoll_ctl(epfd, EPOLL_CTL_ADD, b[0], &ev) == 0);
+            write_later(b[1]);
+            epoll_event ready[4];
+            assert(epoll_wait(epfd, ready, 4, 1000) == 1 && ready[0].data.fd == b[0]);
+            assert(read(b[0], &c, 1) == 1);
+            assert(epoll_wait(epfd, ready, 4, 20) == 0);
+
+            for (int fd : {a[0], a[1], b[0], b[1], epfd})
+            {
+                close(fd);
+            }
+            done = true;
+        });
+        while (!done)
+        {
+            usleep(1000);
+        }
+        // 唤醒后其余的等待者都已移除，调度器可以正常停止
+        iom.stop();
+    }
+    zjl::Config::Lookup<bool>("iomanager.per_worker_reactor")->setValue(false);
+    LOG_FMT_INFO(g_logger, "poll: per worker = %d passed", per_worker);
+}
+
+// 测试 hook 之外创建的管道：第一次读写登记为直通，之后直接调用系统函数，不修改 fd 的阻塞模式
+void TEST_passthroughFd()
+{
+    int fds[2];
+    assert(pipe(fds) == 0);
+    std::atomic_int done{0};
+    {
+        zjl::IOManager iom(1, false, "passthrough");
+        iom.schedule([&fds, &done]() {
+            auto fdm = zjl::FileDescriptorManager::GetInstance();
+            char c = 0;
+            assert(write(fds[1], "ab", 2) == 2);
+            assert(read(fds[0], &c, 1) == 1 && c == 'a');
+            assert(fdm->get(fds[0]) && fdm->get(fds[0])->isPassthrough());
+            assert(!fdm->get(fds[0])->isPollable() && !fdm->get(fds[0])->isRegularFile());
+            assert(read(fds[0], &c, 1) == 1 && c == 'b');
+            assert(!(fcntl(fds[0], F_GETFL) & O_NONBLOCK));
+            // 直通的 fd 被 dup 时不登记新的 fd
+            int copy = dup(fds[0]);
+            assert(copy >= 0 && !fdm->get(copy));
+            close(copy);
+            close(fds[0]);
+            close(fds[1]);
+            assert(!fdm->get(fds[0]));
+            done = true;
+        });
+        while (!done)
+        {
+            usleep(1000);
+        }
+        iom.stop();
+    }
+    LOG_INFO(g_logger, "passthrough: passed");
+}
+
+void TEST_hookedPoll()
+{
+    RunHookedPoll(false);
+    RunHookedPoll(true);
+}
+
 int main()
 {
     // TEST_CreateIOManager();
+    TEST_drain();
+    TEST_affinity();
+    TEST_uringBackend();
+    TEST_perWorkerReactor();
+    TEST_largeFd();
+    TEST_adaptiveBatch();
+    TEST_timerfd();
+    TEST_shortSleep();
+    TEST_timeoutAllocations();
+    TEST_signalHandler();
+    TEST_fileIO();
+    TEST_latencyStats();
+    TEST_multipleWaiters();
+    TEST_hookedFds();
+    TEST_passthroughFd();
+    TEST_hookedPoll();
     TEST_timer();
     return 0;
 }
@@ -1,5 +1,6 @@
 #include "log.h"
 #include "scheduler.h"
+#include <cassert>
 #include <iostream>
 
 void fn()
@@ -20,8 +21,49 @@ void fn2()
     }
 }
 
+// 测试时间片抢占：计算密集的协程不会一直占用唯一的工作线程
+void TEST_preempt(bool forced)
+{
+    std::atomic_bool other_done{false};
+    std::atomic_bool other_before_busy{false};
+    zjl::Scheduler sc(1, false, forced ? "forced" : "preempt");
+    sc.setTimeSlice(10 * 1000, forced);
+    sc.start();
+    sc.schedule([&other_done, &other_before_busy, forced]() {
+        uint64_t begin = zjl::GetCurrentMS();
+        volatile uint64_t sum = 0;
+        while (zjl::GetCurrentMS() - begin < 300)
+        {
+            if (forced)
+            {
+                zjl::Fiber::PreemptibleScope scope;
+                for (int i = 0; i < 1000; i++)
+                {
+                    sum = sum + i;
+                }
+            }
+            else
+            {
+                sum = sum + 1;
+                zjl::Fiber::CheckPreempt();
+            }
+        }
+        other_before_busy = other_done.load();
+    });
+    sc.schedule([&other_done]() {
+        other_done = true;
+    });
+    sc.stop();
+    std::cout << (forced ? "强制抢占" : "协作抢占") << " 次数: " << sc.getPreemptCount() << std::endl;
+    assert(other_before_busy);
+    assert(sc.getPreemptCount() > 0);
+}
+
 int main(int, char**)
 {
+    TEST_preempt(false);
+    TEST_preempt(true);
+
     zjl::Scheduler sc(2, true);
     sc.start();
 
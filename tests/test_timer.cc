@@ -0,0 +1,423 @@
+#include "config.h"
+#include "log.h"
+#include "timer.h"
+#include "util.h"
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+zjl::Logger::ptr g_logger = GET_ROOT_LOGGER();
+
+// 当前线程添加的定时器所属的分片
+static thread_local size_t t_shard = 0;
+
+class TestTimerManager : public zjl::TimerManager
+{
+public:
+    explicit TestTimerManager(size_t shard_count = 1) : zjl::TimerManager(shard_count) {}
+
+    // 像事件循环一样等待最早的到期时间并执行到期的回调，直到没有定时器或者超过期限，返回取出回调的批数，
+    // 没有取出任何回调的唤醒计入 m_empty_wakeups
+    size_t runUntil(uint64_t deadline_us)
+    {
+        size_t batches = 0;
+        while (hasTimer() && zjl::GetCurrentUS() < deadline_us)
+        {
+            uint64_t next = getNextDeadline();
+            uint64_t now = zjl::GetCurrentUS();
+            if (next > now)
+            {
+                usleep(static_cast<useconds_t>(std::min(next, deadline_us) - now));
+            }
+            std::vector<zjl::Timer::TimerFunc> fns;
+            listExpiredCallback(fns);
+            batches += !fns.empty();
+            m_empty_wakeups += fns.empty();
+            for (auto& fn : fns)
+            {
+                fn();
+            }
+        }
+        return batches;
+    }
+
+    std::atomic_int m_inserted_at_first[4]{};
+    size_t m_empty_wakeups = 0;
+
+protected:
+    void onTimerInsertedAtFirst(size_t shard) override { ++m_inserted_at_first[shard]; }
+    size_t getCurrentTimerShard() const override { return t_shard; }
+};
+
+// 测试定时器不会提前执行，取消、重设与条件失效的定时器不会执行
+void TEST_semantics(const std::string& backend)
+{
+    zjl::Config::Lookup<std::string>("timer.backend")->setValue(backend);
+    TestTimerManager manager;
+    assert(manager.getTimerBackendName() == backend);
+    static const int COUNT = 200;
+    std::vector<uint64_t> deadlines(COUNT);
+    std::vector<int> fired(COUNT, 0);
+    std::vector<zjl::Timer::ptr> timers(COUNT);
+    std::atomic_int early{0};
+    uint64_t max_lateness = 0;
+    srand(42);
+    for (int i = 0; i < COUNT; i++)
+    {
+        uint64_t ms = static_cast<uint64_t>(rand() % 300);
+        deadlines[i] = zjl::GetCurrentUS() + ms * 1000;
+        timers[i] = manager.addTimer(ms, [i, &deadlines, &fired, &early, &max_lateness]() {
+            uint64_t now = zjl::GetCurrentUS();
+            early += now < deadlines[i];
+            max_lateness = std::max(max_lateness, now - deadlines[i]);
+            ++fired[i];
+        });
+    }
+    // 取消每隔三个的定时器，把每隔五个的定时器延后 100ms
+    for (int i = 0; i < COUNT; i += 3)
+    {
+        assert(timers[i]->cancel());
+        assert(!timers[i]->cancel());
+    }
+    for (int i = 1; i < COUNT; i += 5)
+    {
+        if (i % 3 != 0)
+        {
+            uint64_t ms = static_cast<uint64_t>(rand() % 300) + 100;
+            deadlines[i] = zjl::GetCurrentUS() + ms * 1000;
+            assert(timers[i]->reset(ms, true));
+        }
+    }
+    // 条件失效的定时器不执行
+    int conditional = 0;
+    {
+        auto cond = std::make_shared<int>(0);
+        manager.addConditionTimer(10, [&conditional]() { ++conditional; }, cond);
+    }
+    // 超出前几层范围的定时器只影响下界，取消后不再有定时器
+    auto far = manager.addTimer(3600 * 1000, []() {});
+    manager.runUntil(zjl::GetCurrentUS() + 1000 * 1000);
+    for (int i = 0; i < COUNT; i++)
+    {
+        assert(fired[i] == (i % 3 == 0 ? 0 : 1));
+    }
+    assert(early == 0);
+    assert(conditional == 0);
+    assert(manager.hasTimer());
+    assert(manager.getNextDeadline() <= zjl::GetCurrentUS() + 3600 * 1000 * 1000ull);
+    assert(far->cancel());
+    assert(!manager.hasTimer());
+    LOG_FMT_INFO(g_logger, "semantics: backend = %s, max lateness = %lu us",
+                 backend.c_str(), max_lateness);
+}
+
+// 测试周期定时器与 refresh
+void TEST_cyclic(const std::string& backend)
+{
+    zjl::Config::Lookup<std::string>("timer.backend")->setValue(backend);
+    TestTimerManager manager;
+    int ticks = 0;
+    auto cyclic = manager.addTimer(10, [&ticks]() { ++ticks; }, true);
+    int refreshed = 0;
+    auto once = manager.addTimer(50, [&refreshed]() { ++refreshed; });
+    // 在到期之前不断刷新，单次定时器一直不执行
+    uint64_t end = zjl::GetCurrentUS() + 200 * 1000;
+    while (zjl::GetCurrentUS() < end)
+    {
+        assert(once->refresh());
+        manager.runUntil(zjl::GetCurrentUS() + 20 * 1000);
+    }
+    assert(refreshed == 0);
+    assert(once->cancel());
+    assert(cyclic->cancel());
+    LOG_FMT_INFO(g_logger, "cyclic: backend = %s, ticks = %d", backend.c_str(), ticks);
+    assert(ticks >= 10 && ticks <= 21);
+    std::vector<zjl::Timer::TimerFunc> fns;
+    manager.addTimer(1000, []() {});
+    manager.addTimer(2000, []() {}, true);
+    assert(manager.listAllCallback(fns) == 2);
+    assert(fns.size() == 1);
+    assert(!manager.hasTimer());
+}
+
+// 比较两种后端反复添加、取消定时器的开销，对应 doIO 中每次挂起的超时定时器
+void TEST_addCancelCost(const std::string& backend)
+{
+    zjl::Config::Lookup<std::string>("timer.backend")->setValue(backend);
+    TestTimerManager manager;
+    static const int IDLE = 100000;
+    static const int ROUND = 200000;
+    std::vector<zjl::Timer::ptr> idle;
+    idle.reserve(IDLE);
+    for (int i = 0; i < IDLE; i++)
+    {
+        idle.push_back(manager.addTimer(60 * 1000 + i % 1000, []() {}));
+    }
+    uint64_t begin = zjl::GetCurrentUS();
+    for (int i = 0; i < ROUND; i++)
+    {
+        manager.addTimer(5000, []() {})->cancel();
+    }
+    uint64_t cost = zjl::GetCurrentUS() - begin;
+    LOG_FMT_INFO(g_logger, "cost: backend = %s, %d idle timers, add + cancel = %.1f ns",
+                 backend.c_str(), IDLE, cost * 1000.0 / ROUND);
+    for (auto& timer : idle)
+    {
+        timer->cancel();
+    }
+    assert(!manager.hasTimer());
+}
+
+// 测试定时器属于创建它的线程的分片，可以从其他线程取消，各个分片单独取出到期的定时器
+void TEST_shards()
+{
+    static const size_t SHARDS = 4;
+    static const int COUNT = 1000;
+    TestTimerManager manager(SHARDS);
+    assert(manager.getTimerShardCount() == SHARDS);
+    std::vector<std::vector<zjl::Timer::ptr>> timers(SHARDS);
+    std::atomic_int fired[SHARDS]{};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < SHARDS; i++)
+    {
+        threads.emplace_back([i, &manager, &timers, &fired]() {
+            t_shard = i;
+            for (int j = 0; j < COUNT; j++)
+            {
+                timers[i].push_back(manager.addTimer(10 + i * 10, [i, &fired]() { ++fired[i]; }));
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    for (size_t i = 0; i < SHARDS; i++)
+    {
+        assert(manager.getTimerCount(i) == COUNT);
+        assert(manager.m_inserted_at_first[i] >= 1);
+    }
+    // 在其他线程取消第 0 个分片的一半定时器，取消后分片的下界不会变晚
+    uint64_t hint = manager.getNextDeadline(0);
+    std::thread([&timers]() {
+        for (int j = 0; j < COUNT; j += 2)
+        {
+            assert(timers[0][j]->cancel());
+        }
+    }).join();
+    assert(manager.getTimerCount(0) == COUNT / 2);
+    assert(manager.getNextDeadline(0) == hint);
+    // 第 3 个分片全部取消后没有定时器
+    for (auto& timer : timers[3])
+    {
+        assert(timer->cancel());
+    }
+    assert(manager.getNextDeadline(3) == ~0ull);
+    assert(manager.getNextTimer(3) == ~0ull);
+    // 只取出第 0 个分片的定时器，其他分片不受影响
+    usleep(50 * 1000);
+    std::vector<zjl::Timer::TimerFunc> fns;
+    manager.listExpiredCallback(0, fns);
+    assert(fns.size() == COUNT / 2);
+    assert(manager.getNextDeadline(0) == ~0ull);
+    assert(manager.getTimerCount(1) == COUNT);
+    manager.listExpiredCallback(fns);
+    assert(fns.size() == COUNT / 2 + 2 * COUNT);
+    for (auto& fn : fns)
+    {
+        fn();
+    }
+    assert(fired[0] == COUNT / 2 && fired[1] == COUNT && fired[2] == COUNT && fired[3] == 0);
+    assert(!manager.hasTimer());
+}
+
+// 测试松弛时间让相近的定时器在同一批中到期，且不会提前执行
+void TEST_slack(const std::string& backend)
+{
+    zjl::Config::Lookup<std::string>("timer.backend")->setValue(backend);
+    static const int COUNT = 200;
+    static const uint64_t SLACK_US = 20 * 1000;
+    size_t batches[2] = {0, 0};
+    for (uint64_t slack_us : {0ul, SLACK_US})
+    {
+        TestTimerManager manager;
+        manager.setTimerSlack(slack_us);
+        std::vector<uint64_t> deadlines(COUNT);
+        std::atomic_int early{0};
+        int fired = 0;
+        srand(42);
+        for (int i = 0; i < COUNT; i++)
+        {
+            uint64_t ms = static_cast<uint64_t>(rand() % 100) + 1;
+            deadlines[i] = zjl::GetCurrentUS() + ms * 1000;
+            manager.addTimer(ms, [i, &deadlines, &early, &fired]() {
+                early += zjl::GetCurrentUS() < deadlines[i];
+                ++fired;
+            });
+        }
+        batches[slack_us != 0] = manager.runUntil(zjl::GetCurrentUS() + 1000 * 1000);
+        assert(fired == COUNT);
+        assert(early == 0);
+    }
+    LOG_FMT_INFO(g_logger, "slack: backend = %s, batches without slack = %zu, with %lu us slack = %zu",
+                 backend.c_str(), batches[0], SLACK_US, batches[1]);
+    // 100ms 内的到期时间最多落在 6 个 20ms 的时刻上
+    assert(batches[1] <= 6);
+    assert(batches[1] < batches[0]);
+
+    // 单个定时器的松弛时间，重新加入后到期时间对齐到松弛时间的整数倍
+    TestTimerManager manager;
+    auto timer = manager.addTimer(30, []() {});
+    assert(timer->setSlack(50 * 1000));
+    assert(manager.getNextDeadline() % (50 * 1000) == 0);
+    assert(timer->cancel());
+    assert(!timer->setSlack(0));
+}
+
+// 测试远处的定时器不会让事件循环空转：时间轮高层槽位的起点只是下界，越过之后要重新计算
+void TEST_idleWakeups(const std::string& backend)
+{
+    zjl::Config::Lookup<std::string>("timer.backend")->setValue(backend);
+    TestTimerManager manager;
+    int fired = 0;
+    manager.addTimer(10, [&fired]() { ++fired; });
+    manager.addTimer(500, [&fired]() { ++fired; });
+    manager.runUntil(zjl::GetCurrentUS() + 1000 * 1000);
+    LOG_FMT_INFO(g_logger, "idle wakeups: backend = %s, empty wakeups = %zu", backend.c_str(),
+                 manager.m_empty_wakeups);
+    assert(fired == 2);
+    // 时间轮每到一个第 1 层槽位(64ms)的起点可能空醒一次
+    assert(manager.m_empty_wakeups <= 16);
+}
+
+// 测试以 std::chrono 时长添加的定时器精确到微秒
+void TEST_microseconds()
+{
+    TestTimerManager manager;
+    uint64_t before = zjl::GetCurrentUS();
+    auto timer = manager.addTimer(std::chrono::microseconds(300), []() {});
+    uint64_t after = zjl::GetCurrentUS();
+    assert(manager.getNextDeadline() >= before + 300 && manager.getNextDeadline() <= after + 300);
+    // 毫秒、秒等更粗的时长可以隐式转换
+    assert(timer->reset(std::chrono::milliseconds(2), true));
+    assert(manager.getNextDeadline() >= before + 2000);
+    int fired = 0;
+    manager.addConditionTimer(std::chrono::microseconds(500), [&fired]() { ++fired; },
+                              std::make_shared<int>(0));
+    manager.runUntil(zjl::GetCurrentUS() + 100 * 1000);
+    assert(fired == 0);
+    assert(!manager.hasTimer());
+}
+
+// 测试侵入式超时节点按到期时间执行，取消后不执行，到期后 cancel() 返回 false
+void TEST_timeoutNode()
+{
+    static const int COUNT = 1000;
+    TestTimerManager manager;
+    std::vector<zjl::TimeoutNode> nodes(COUNT);
+    std::vector<uint64_t> deadlines(COUNT);
+    std::vector<int> fired(COUNT, 0);
+    std::atomic_int early{0};
+    srand(7);
+    for (int i = 0; i < COUNT; i++)
+    {
+        uint64_t us = static_cast<uint64_t>(rand() % 50000);
+        deadlines[i] = zjl::GetCurrentUS() + us;
+        manager.armTimeout(nodes[i], std::chrono::microseconds(us), [i, &deadlines, &fired, &early]() {
+            early += zjl::GetCurrentUS() < deadlines[i];
+            ++fired[i];
+        });
+    }
+    assert(manager.getTimerCount(0) == COUNT);
+    // 取消偶数节点，奇数节点重新设置为更晚的到期时间
+    for (int i = 0; i < COUNT; i += 2)
+    {
+        assert(nodes[i].cancel());
+        assert(!nodes[i].cancel());
+    }
+    for (int i = 1; i < COUNT; i += 10)
+    {
+        deadlines[i] = zjl::GetCurrentUS() + 60000;
+        manager.armTimeout(nodes[i], std::chrono::microseconds(60000), [i, &fired]() { ++fired[i]; });
+    }
+    assert(manager.getTimerCount(0) == COUNT / 2);
+    manager.runUntil(zjl::GetCurrentUS() + 1000 * 1000);
+    for (int i = 0; i < COUNT; i++)
+    {
+        assert(fired[i] == i % 2);
+        assert(!nodes[i].cancel());
+    }
+    assert(early == 0);
+    assert(!manager.hasTimer());
+}
+
+// 测试按类型统计的定时器数量、每批到期的回调数量，以及最慢的回调
+void TEST_stats()
+{
+    TestTimerManager manager;
+    manager.setCallbackProfiling(true);
+    auto cond = std::make_shared<int>(0);
+    std::vector<zjl::Timer::ptr> timers;
+    for (int i = 0; i < 5; i++)
+    {
+        timers.push_back(manager.addTimer(10, []() {}));
+    }
+    timers.push_back(manager.addTimer(10, []() {}, true));
+    timers.push_back(manager.addConditionTimer(10, []() {}, cond));
+    timers.push_back(manager.addConditionTimer(10, []() {}, cond, true));
+    // 两个节点的回调是同一个类型，最慢的回调中只能出现一次
+    zjl::TimeoutNode nodes[2];
+    for (auto& node : nodes)
+    {
+        manager.armTimeout(node, std::chrono::milliseconds(10), []() { usleep(3000); });
+    }
+    zjl::TimerStats stats = manager.getTimerStats();
+    assert(stats.oneshot == 5 && stats.cyclic == 1 && stats.conditional == 2 && stats.timeouts == 2);
+    assert(timers[0]->cancel());
+    assert(manager.getTimerStats().oneshot == 4);
+    // 同一时刻到期的回调在同一批中取出，执行慢的回调排在最前
+    usleep(20 * 1000);
+    std::vector<zjl::Timer::TimerFunc> fns;
+    manager.listExpiredCallback(fns);
+    assert(fns.size() == 9);
+    for (auto& fn : fns)
+    {
+        fn();
+    }
+    stats = manager.getTimerStats();
+    assert(stats.oneshot == 0 && stats.cyclic == 1 && stats.conditional == 1 && stats.timeouts == 0);
+    assert(stats.lateness_us.count == 9);
+    assert(stats.fired_per_batch.count == 1 && stats.fired_per_batch.max == 9);
+    assert(!stats.slowest.empty() && stats.slowest[0].duration_us >= 3000);
+    assert(stats.slowest[0].name.find("TEST_stats") != std::string::npos);
+    assert(stats.slowest.size() < 2 || stats.slowest[1].duration_us < 3000);
+    LOG_FMT_INFO(g_logger, "stats: slowest = %s, %lu us", stats.slowest[0].name.c_str(),
+                 stats.slowest[0].duration_us);
+    manager.resetTimerStats();
+    stats = manager.getTimerStats();
+    assert(stats.lateness_us.count == 0 && stats.slowest.empty() && stats.cyclic == 1);
+    fns.clear();
+    assert(manager.listAllCallback(fns) == 2);
+    assert(manager.getTimerStats().cyclic == 0 && manager.getTimerStats().conditional == 0);
+}
+
+int main()
+{
+    for (const char* backend : {"set", "wheel"})
+    {
+        TEST_semantics(backend);
+        TEST_cyclic(backend);
+        TEST_addCancelCost(backend);
+        TEST_slack(backend);
+        TEST_idleWakeups(backend);
+    }
+    TEST_shards();
+    TEST_microseconds();
+    TEST_timeoutNode();
+    TEST_stats();
+    return 0;
+}